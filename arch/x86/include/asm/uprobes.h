@@ -49,6 +49,11 @@ struct arch_uprobe {
 			u8	reg_offset;	/* to the start of pt_regs */
 			u8	ilen;
 		}			push;
+		struct {
+			u8	src_offset;	/* to the start of pt_regs */
+			u8	dst_offset;
+			u8	ilen;
+		}			mov;
 	};
 
 	unsigned long flags;
@@ -1356,6 +1356,16 @@ static bool push_emulate_op(struct arch_uprobe *auprobe, struct pt_regs *regs)
 	return true;
 }
 
+static bool mov_emulate_op(struct arch_uprobe *auprobe, struct pt_regs *regs)
+{
+	unsigned long *src_ptr = (void *)regs + auprobe->mov.src_offset;
+	unsigned long *dst_ptr = (void *)regs + auprobe->mov.dst_offset;
+
+	*dst_ptr = *src_ptr;
+	regs->ip += auprobe->mov.ilen;
+	return true;
+}
+
 static int branch_post_xol_op(struct arch_uprobe *auprobe, struct pt_regs *regs)
 {
 	BUG_ON(!branch_is_call(auprobe));
@@ -1398,13 +1408,27 @@ static const struct uprobe_xol_ops push_xol_ops = {
 	.emulate  = push_emulate_op,
 };
 
+static const struct uprobe_xol_ops mov_xol_ops = {
+	.emulate  = mov_emulate_op,
+};
+
+static bool insn_is_endbr(struct arch_uprobe *auprobe, struct insn *insn)
+{
+	/* endbr64 is f3 0f 1e fa, endbr32 is f3 0f 1e fb */
+	return insn->length == 4 &&
+	       auprobe->insn[0] == 0xf3 && auprobe->insn[1] == 0x0f &&
+	       auprobe->insn[2] == 0x1e &&
+	       (auprobe->insn[3] == 0xfa || auprobe->insn[3] == 0xfb);
+}
+
 /* Returns -ENOSYS if branch_xol_ops doesn't handle this insn */
 static int branch_setup_xol_ops(struct arch_uprobe *auprobe, struct insn *insn)
 {
 	u8 opc1 = OPCODE1(insn);
 	insn_byte_t p;
 
-	if (insn_is_nop(insn))
+	/* Without user space IBT, endbr does nothing but take up space. */
+	if (insn_is_nop(insn) || insn_is_endbr(auprobe, insn))
 		goto setup;
 
 	switch (opc1) {
@@ -1530,6 +1554,70 @@ static int push_setup_xol_ops(struct arch_uprobe *auprobe, struct insn *insn)
 	return 0;
 }
 
+#ifdef CONFIG_X86_64
+static const u8 mov_reg_offsets[16] = {
+	offsetof(struct pt_regs, ax),
+	offsetof(struct pt_regs, cx),
+	offsetof(struct pt_regs, dx),
+	offsetof(struct pt_regs, bx),
+	offsetof(struct pt_regs, sp),
+	offsetof(struct pt_regs, bp),
+	offsetof(struct pt_regs, si),
+	offsetof(struct pt_regs, di),
+	offsetof(struct pt_regs, r8),
+	offsetof(struct pt_regs, r9),
+	offsetof(struct pt_regs, r10),
+	offsetof(struct pt_regs, r11),
+	offsetof(struct pt_regs, r12),
+	offsetof(struct pt_regs, r13),
+	offsetof(struct pt_regs, r14),
+	offsetof(struct pt_regs, r15),
+};
+
+/*
+ * Returns -ENOSYS if mov_xol_ops doesn't handle this insn.
+ *
+ * Only register to register 64-bit moves (REX.W 89 /r and REX.W 8b /r
+ * with mod == 3) are handled, e.g. the "mov %rsp,%rbp" of a frame setup
+ * right after the "push %rbp" that push_xol_ops already emulates.
+ */
+static int mov_setup_xol_ops(struct arch_uprobe *auprobe, struct insn *insn)
+{
+	u8 opc1 = OPCODE1(insn), rex, modrm, reg, rm;
+
+	if (opc1 != 0x89 && opc1 != 0x8b)
+		return -ENOSYS;
+
+	if (insn->length != 3 || insn->prefixes.nbytes ||
+	    insn->rex_prefix.nbytes != 1)
+		return -ENOSYS;
+
+	rex = insn->rex_prefix.bytes[0];
+	modrm = insn->modrm.value;
+	if (!X86_REX_W(rex) || X86_REX_X(rex) || X86_MODRM_MOD(modrm) != 3)
+		return -ENOSYS;
+
+	reg = X86_MODRM_REG(modrm) | (X86_REX_R(rex) ? 8 : 0);
+	rm = X86_MODRM_RM(modrm) | (X86_REX_B(rex) ? 8 : 0);
+
+	if (opc1 == 0x89) {
+		auprobe->mov.src_offset = mov_reg_offsets[reg];
+		auprobe->mov.dst_offset = mov_reg_offsets[rm];
+	} else {
+		auprobe->mov.src_offset = mov_reg_offsets[rm];
+		auprobe->mov.dst_offset = mov_reg_offsets[reg];
+	}
+	auprobe->mov.ilen = insn->length;
+	auprobe->ops = &mov_xol_ops;
+	return 0;
+}
+#else
+static int mov_setup_xol_ops(struct arch_uprobe *auprobe, struct insn *insn)
+{
+	return -ENOSYS;
+}
+#endif
+
 /**
  * arch_uprobe_analyze_insn - instruction analysis including validity and fixups.
  * @auprobe: the probepoint information.
@@ -1558,6 +1646,10 @@ int arch_uprobe_analyze_insn(struct arch_uprobe *auprobe, struct mm_struct *mm,
 	if (ret != -ENOSYS)
 		return ret;
 
+	ret = mov_setup_xol_ops(auprobe, &insn);
+	if (ret != -ENOSYS)
+		return ret;
+
 	/*
 	 * Figure out which fixups default_post_xol_op() will need to perform,
 	 * and annotate defparam->fixups accordingly.
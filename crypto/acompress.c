@@ -305,6 +305,40 @@ int crypto_acomp_decompress(struct acomp_req *req)
 }
 EXPORT_SYMBOL_GPL(crypto_acomp_decompress);
 
+static int acomp_do_batch(struct acomp_req *reqs[], int errors[],
+			  unsigned int nr_reqs, bool comp)
+{
+	int ret = 0;
+	unsigned int i;
+
+	for (i = 0; i < nr_reqs; i++) {
+		int err;
+
+		err = comp ? crypto_acomp_compress(reqs[i]) :
+			     crypto_acomp_decompress(reqs[i]);
+		errors[i] = err;
+
+		if (!ret && err && err != -EINPROGRESS && err != -EBUSY)
+			ret = err;
+	}
+
+	return ret;
+}
+
+int crypto_acomp_compress_batch(struct acomp_req *reqs[], int errors[],
+				unsigned int nr_reqs)
+{
+	return acomp_do_batch(reqs, errors, nr_reqs, true);
+}
+EXPORT_SYMBOL_GPL(crypto_acomp_compress_batch);
+
+int crypto_acomp_decompress_batch(struct acomp_req *reqs[], int errors[],
+				  unsigned int nr_reqs)
+{
+	return acomp_do_batch(reqs, errors, nr_reqs, false);
+}
+EXPORT_SYMBOL_GPL(crypto_acomp_decompress_batch);
+
 void comp_prepare_alg(struct comp_alg_common *alg)
 {
 	struct crypto_alg *base = &alg->base;
@@ -8,6 +8,7 @@
 
 #include <crypto/algapi.h>
 #include <crypto/internal/aead.h>
+#include <crypto/internal/skcipher.h>
 #include <linux/atomic.h>
 #include <linux/err.h>
 #include <linux/init.h>
@@ -33,6 +34,32 @@ struct pcrypt_aead_ctx {
 	unsigned int cb_cpu;
 };
 
+struct pcrypt_skcipher_instance_ctx {
+	struct crypto_skcipher_spawn spawn;
+	struct padata_shell *psenc;
+	struct padata_shell *psdec;
+	atomic_t tfm_count;
+};
+
+struct pcrypt_skcipher_ctx {
+	struct crypto_skcipher *child;
+	unsigned int cb_cpu;
+};
+
+/*
+ * Spread the serialization callbacks of the tfms of an instance over the
+ * online cpus.
+ */
+static unsigned int pcrypt_pick_cb_cpu(atomic_t *tfm_count)
+{
+	int cpu_index;
+
+	cpu_index = (unsigned int)atomic_inc_return(tfm_count) %
+		    cpumask_weight(cpu_online_mask);
+
+	return cpumask_nth(cpu_index, cpu_online_mask);
+}
+
 static inline struct pcrypt_instance_ctx *pcrypt_tfm_ictx(
 	struct crypto_aead *tfm)
 {
@@ -178,16 +205,12 @@ static int pcrypt_aead_decrypt(struct aead_request *req)
 
 static int pcrypt_aead_init_tfm(struct crypto_aead *tfm)
 {
-	int cpu_index;
 	struct aead_instance *inst = aead_alg_instance(tfm);
 	struct pcrypt_instance_ctx *ictx = aead_instance_ctx(inst);
 	struct pcrypt_aead_ctx *ctx = crypto_aead_ctx(tfm);
 	struct crypto_aead *cipher;
 
-	cpu_index = (unsigned int)atomic_inc_return(&ictx->tfm_count) %
-		    cpumask_weight(cpu_online_mask);
-
-	ctx->cb_cpu = cpumask_nth(cpu_index, cpu_online_mask);
+	ctx->cb_cpu = pcrypt_pick_cb_cpu(&ictx->tfm_count);
 	cipher = crypto_spawn_aead(&ictx->spawn);
 
 	if (IS_ERR(cipher))
@@ -208,6 +231,166 @@ static void pcrypt_aead_exit_tfm(struct crypto_aead *tfm)
 	crypto_free_aead(ctx->child);
 }
 
+static inline struct pcrypt_skcipher_instance_ctx *pcrypt_skcipher_ictx(
+	struct crypto_skcipher *tfm)
+{
+	return skcipher_instance_ctx(skcipher_alg_instance(tfm));
+}
+
+static int pcrypt_skcipher_setkey(struct crypto_skcipher *parent,
+				  const u8 *key, unsigned int keylen)
+{
+	struct pcrypt_skcipher_ctx *ctx = crypto_skcipher_ctx(parent);
+
+	return crypto_skcipher_setkey(ctx->child, key, keylen);
+}
+
+static void pcrypt_skcipher_serial(struct padata_priv *padata)
+{
+	struct pcrypt_request *preq = pcrypt_padata_request(padata);
+	struct skcipher_request *req = pcrypt_request_ctx(preq);
+
+	skcipher_request_complete(req->base.data, padata->info);
+}
+
+static void pcrypt_skcipher_done(void *data, int err)
+{
+	struct skcipher_request *req = data;
+	struct pcrypt_request *preq = skcipher_request_ctx(req);
+	struct padata_priv *padata = pcrypt_request_padata(preq);
+
+	padata->info = err;
+
+	padata_do_serial(padata);
+}
+
+static void pcrypt_skcipher_enc(struct padata_priv *padata)
+{
+	struct pcrypt_request *preq = pcrypt_padata_request(padata);
+	struct skcipher_request *req = pcrypt_request_ctx(preq);
+	int ret;
+
+	ret = crypto_skcipher_encrypt(req);
+
+	if (ret == -EINPROGRESS)
+		return;
+
+	padata->info = ret;
+	padata_do_serial(padata);
+}
+
+static void pcrypt_skcipher_dec(struct padata_priv *padata)
+{
+	struct pcrypt_request *preq = pcrypt_padata_request(padata);
+	struct skcipher_request *req = pcrypt_request_ctx(preq);
+	int ret;
+
+	ret = crypto_skcipher_decrypt(req);
+
+	if (ret == -EINPROGRESS)
+		return;
+
+	padata->info = ret;
+	padata_do_serial(padata);
+}
+
+static struct skcipher_request *pcrypt_skcipher_prepare(
+	struct skcipher_request *req, void (*parallel)(struct padata_priv *))
+{
+	struct pcrypt_request *preq = skcipher_request_ctx(req);
+	struct skcipher_request *creq = pcrypt_request_ctx(preq);
+	struct padata_priv *padata = pcrypt_request_padata(preq);
+	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
+	struct pcrypt_skcipher_ctx *ctx = crypto_skcipher_ctx(tfm);
+	u32 flags = skcipher_request_flags(req);
+
+	memset(padata, 0, sizeof(struct padata_priv));
+
+	padata->parallel = parallel;
+	padata->serial = pcrypt_skcipher_serial;
+
+	skcipher_request_set_tfm(creq, ctx->child);
+	skcipher_request_set_callback(creq, flags & ~CRYPTO_TFM_REQ_MAY_SLEEP,
+				      pcrypt_skcipher_done, req);
+	skcipher_request_set_crypt(creq, req->src, req->dst,
+				   req->cryptlen, req->iv);
+
+	return creq;
+}
+
+static int pcrypt_skcipher_encrypt(struct skcipher_request *req)
+{
+	int err;
+	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
+	struct pcrypt_skcipher_ctx *ctx = crypto_skcipher_ctx(tfm);
+	struct pcrypt_skcipher_instance_ctx *ictx = pcrypt_skcipher_ictx(tfm);
+	struct pcrypt_request *preq = skcipher_request_ctx(req);
+	struct skcipher_request *creq;
+
+	creq = pcrypt_skcipher_prepare(req, pcrypt_skcipher_enc);
+
+	err = padata_do_parallel(ictx->psenc, pcrypt_request_padata(preq),
+				 &ctx->cb_cpu);
+	if (!err)
+		return -EINPROGRESS;
+	if (err == -EBUSY) {
+		/* try non-parallel mode */
+		return crypto_skcipher_encrypt(creq);
+	}
+
+	return err;
+}
+
+static int pcrypt_skcipher_decrypt(struct skcipher_request *req)
+{
+	int err;
+	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
+	struct pcrypt_skcipher_ctx *ctx = crypto_skcipher_ctx(tfm);
+	struct pcrypt_skcipher_instance_ctx *ictx = pcrypt_skcipher_ictx(tfm);
+	struct pcrypt_request *preq = skcipher_request_ctx(req);
+	struct skcipher_request *creq;
+
+	creq = pcrypt_skcipher_prepare(req, pcrypt_skcipher_dec);
+
+	err = padata_do_parallel(ictx->psdec, pcrypt_request_padata(preq),
+				 &ctx->cb_cpu);
+	if (!err)
+		return -EINPROGRESS;
+	if (err == -EBUSY) {
+		/* try non-parallel mode */
+		return crypto_skcipher_decrypt(creq);
+	}
+
+	return err;
+}
+
+static int pcrypt_skcipher_init_tfm(struct crypto_skcipher *tfm)
+{
+	struct pcrypt_skcipher_instance_ctx *ictx = pcrypt_skcipher_ictx(tfm);
+	struct pcrypt_skcipher_ctx *ctx = crypto_skcipher_ctx(tfm);
+	struct crypto_skcipher *cipher;
+
+	ctx->cb_cpu = pcrypt_pick_cb_cpu(&ictx->tfm_count);
+	cipher = crypto_spawn_skcipher(&ictx->spawn);
+
+	if (IS_ERR(cipher))
+		return PTR_ERR(cipher);
+
+	ctx->child = cipher;
+	crypto_skcipher_set_reqsize(tfm, sizeof(struct pcrypt_request) +
+					 sizeof(struct skcipher_request) +
+					 crypto_skcipher_reqsize(cipher));
+
+	return 0;
+}
+
+static void pcrypt_skcipher_exit_tfm(struct crypto_skcipher *tfm)
+{
+	struct pcrypt_skcipher_ctx *ctx = crypto_skcipher_ctx(tfm);
+
+	crypto_free_skcipher(ctx->child);
+}
+
 static void pcrypt_free(struct aead_instance *inst)
 {
 	struct pcrypt_instance_ctx *ctx = aead_instance_ctx(inst);
@@ -293,6 +476,77 @@ static int pcrypt_create_aead(struct crypto_template *tmpl, struct rtattr **tb,
 	return err;
 }
 
+static void pcrypt_skcipher_free(struct skcipher_instance *inst)
+{
+	struct pcrypt_skcipher_instance_ctx *ctx = skcipher_instance_ctx(inst);
+
+	crypto_drop_skcipher(&ctx->spawn);
+	padata_free_shell(ctx->psdec);
+	padata_free_shell(ctx->psenc);
+	kfree(inst);
+}
+
+static int pcrypt_create_skcipher(struct crypto_template *tmpl,
+				  struct rtattr **tb,
+				  struct crypto_attr_type *algt)
+{
+	struct pcrypt_skcipher_instance_ctx *ctx;
+	struct skcipher_instance *inst;
+	struct skcipher_alg_common *alg;
+	u32 mask = crypto_algt_inherited_mask(algt);
+	int err;
+
+	inst = kzalloc(sizeof(*inst) + sizeof(*ctx), GFP_KERNEL);
+	if (!inst)
+		return -ENOMEM;
+
+	err = -ENOMEM;
+
+	ctx = skcipher_instance_ctx(inst);
+	ctx->psenc = padata_alloc_shell(pencrypt);
+	if (!ctx->psenc)
+		goto err_free_inst;
+
+	ctx->psdec = padata_alloc_shell(pdecrypt);
+	if (!ctx->psdec)
+		goto err_free_inst;
+
+	err = crypto_grab_skcipher(&ctx->spawn, skcipher_crypto_instance(inst),
+				   crypto_attr_alg_name(tb[1]), 0, mask);
+	if (err)
+		goto err_free_inst;
+
+	alg = crypto_spawn_skcipher_alg_common(&ctx->spawn);
+	err = pcrypt_init_instance(skcipher_crypto_instance(inst), &alg->base);
+	if (err)
+		goto err_free_inst;
+
+	inst->alg.base.cra_flags |= CRYPTO_ALG_ASYNC;
+
+	inst->alg.ivsize = alg->ivsize;
+	inst->alg.chunksize = alg->chunksize;
+	inst->alg.min_keysize = alg->min_keysize;
+	inst->alg.max_keysize = alg->max_keysize;
+
+	inst->alg.base.cra_ctxsize = sizeof(struct pcrypt_skcipher_ctx);
+
+	inst->alg.init = pcrypt_skcipher_init_tfm;
+	inst->alg.exit = pcrypt_skcipher_exit_tfm;
+
+	inst->alg.setkey = pcrypt_skcipher_setkey;
+	inst->alg.encrypt = pcrypt_skcipher_encrypt;
+	inst->alg.decrypt = pcrypt_skcipher_decrypt;
+
+	inst->free = pcrypt_skcipher_free;
+
+	err = skcipher_register_instance(tmpl, inst);
+	if (err) {
+err_free_inst:
+		pcrypt_skcipher_free(inst);
+	}
+	return err;
+}
+
 static int pcrypt_create(struct crypto_template *tmpl, struct rtattr **tb)
 {
 	struct crypto_attr_type *algt;
@@ -304,6 +558,8 @@ static int pcrypt_create(struct crypto_template *tmpl, struct rtattr **tb)
 	switch (algt->type & algt->mask & CRYPTO_ALG_TYPE_MASK) {
 	case CRYPTO_ALG_TYPE_AEAD:
 		return pcrypt_create_aead(tmpl, tb, algt);
+	case CRYPTO_ALG_TYPE_SKCIPHER:
+		return pcrypt_create_skcipher(tmpl, tb, algt);
 	}
 
 	return -EINVAL;
@@ -159,6 +159,17 @@ static int crypto_sha256_digest(struct shash_desc *desc,
 	return 0;
 }
 
+static int crypto_sha256_finup_mb(struct shash_desc *desc,
+				  const u8 * const data[], unsigned int len,
+				  u8 * const outs[], unsigned int num_msgs)
+{
+	if (WARN_ON_ONCE(num_msgs != 2))
+		return -EOPNOTSUPP;
+	sha256_finup_2x(SHA256_CTX(desc), data[0], data[1], len,
+			outs[0], outs[1]);
+	return 0;
+}
+
 static int crypto_sha256_export(struct shash_desc *desc, void *out)
 {
 	return __crypto_sha256_export(&SHA256_CTX(desc)->ctx, out);
@@ -349,6 +360,8 @@ static struct shash_alg algs[] = {
 		.import			= crypto_sha256_import,
 		.export_core		= crypto_sha256_export_core,
 		.import_core		= crypto_sha256_import_core,
+		.finup_mb		= crypto_sha256_finup_mb,
+		.mb_max_msgs		= 2,
 		.descsize		= sizeof(struct sha256_ctx),
 		.statesize		= SHA256_SHASH_STATE_SIZE,
 	},
@@ -396,6 +409,22 @@ static struct shash_alg algs[] = {
 
 static int __init crypto_sha256_mod_init(void)
 {
+	int i;
+
+	/*
+	 * Only advertise multibuffer hashing if the library has a real
+	 * interleaved implementation; otherwise callers gain nothing from
+	 * batching and the API falls back to hashing one message at a time.
+	 */
+	if (!sha256_finup_2x_is_optimized()) {
+		for (i = 0; i < ARRAY_SIZE(algs); i++) {
+			if (algs[i].finup_mb == crypto_sha256_finup_mb) {
+				algs[i].finup_mb = NULL;
+				algs[i].mb_max_msgs = 0;
+			}
+		}
+	}
+
 	return crypto_register_shashes(algs, ARRAY_SIZE(algs));
 }
 module_init(crypto_sha256_mod_init);
@@ -173,6 +173,72 @@ int crypto_shash_finup(struct shash_desc *restrict desc, const u8 *data,
 }
 EXPORT_SYMBOL_GPL(crypto_shash_finup);
 
+static noinline_for_stack int
+shash_finup_mb_fallback(struct shash_desc *desc, const u8 * const data[],
+			unsigned int len, u8 * const outs[],
+			unsigned int num_msgs)
+{
+	struct crypto_shash *tfm = desc->tfm;
+	SHASH_DESC_ON_STACK(desc2, tfm);
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < num_msgs - 1; i++) {
+		desc2->tfm = tfm;
+		memcpy(shash_desc_ctx(desc2), shash_desc_ctx(desc),
+		       crypto_shash_descsize(tfm));
+		err = crypto_shash_finup(desc2, data[i], len, outs[i]);
+		if (err) {
+			shash_desc_zero(desc2);
+			memset(shash_desc_ctx(desc), 0,
+			       crypto_shash_descsize(tfm));
+			return err;
+		}
+	}
+	return crypto_shash_finup(desc, data[i], len, outs[i]);
+}
+
+int crypto_shash_finup_mb(struct shash_desc *desc, const u8 * const data[],
+			  unsigned int len, u8 * const outs[],
+			  unsigned int num_msgs)
+{
+	struct crypto_shash *tfm = desc->tfm;
+	struct shash_alg *alg = crypto_shash_alg(tfm);
+	unsigned int n;
+	int err;
+
+	if (WARN_ON_ONCE(!num_msgs))
+		return -EINVAL;
+
+	if (alg->mb_max_msgs < 2)
+		return shash_finup_mb_fallback(desc, data, len, outs, num_msgs);
+
+	/*
+	 * ->finup_mb leaves @desc untouched, so it can be reused for each
+	 * group.  A leftover single message goes through ->finup, which
+	 * also takes care of zeroing @desc.
+	 */
+	while (num_msgs >= 2) {
+		n = min(num_msgs, alg->mb_max_msgs);
+		err = alg->finup_mb(desc, data, len, outs, n);
+		if (err) {
+			memset(shash_desc_ctx(desc), 0,
+			       crypto_shash_descsize(tfm));
+			return err;
+		}
+		data += n;
+		outs += n;
+		num_msgs -= n;
+	}
+
+	if (num_msgs)
+		return crypto_shash_finup(desc, data[0], len, outs[0]);
+
+	memset(shash_desc_ctx(desc), 0, crypto_shash_descsize(tfm));
+	return 0;
+}
+EXPORT_SYMBOL_GPL(crypto_shash_finup_mb);
+
 static int shash_default_digest(struct shash_desc *desc, const u8 *data,
 				unsigned int len, u8 *out)
 {
@@ -467,6 +533,21 @@ static int shash_prepare_alg(struct shash_alg *alg)
 	if ((alg->export && !alg->import) || (alg->import && !alg->export))
 		return -EINVAL;
 
+	/*
+	 * ->finup_mb is handed the desc state directly, so it cannot be used
+	 * with algorithms whose partial blocks are buffered by the API.
+	 */
+	if (alg->finup_mb) {
+		if (base->cra_flags & CRYPTO_AHASH_ALG_BLOCK_ONLY)
+			return -EINVAL;
+		if (alg->mb_max_msgs > HASH_MAX_MB_MSGS)
+			return -EINVAL;
+	} else {
+		alg->mb_max_msgs = 1;
+	}
+	if (!alg->mb_max_msgs)
+		alg->mb_max_msgs = 1;
+
 	err = hash_prepare_alg(&alg->halg);
 	if (err)
 		return err;
@@ -19,6 +19,7 @@
 
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
+#include <crypto/acompress.h>
 #include <crypto/aead.h>
 #include <crypto/hash.h>
 #include <crypto/skcipher.h>
@@ -30,6 +31,7 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/moduleparam.h>
+#include <linux/random.h>
 #include <linux/scatterlist.h>
 #include <linux/slab.h>
 #include <linux/string.h>
@@ -956,6 +958,337 @@ static void test_hash_speed(const char *algo, unsigned int secs,
 	return test_ahash_speed_common(algo, secs, speed, CRYPTO_ALG_ASYNC);
 }
 
+static int do_shash_finup_mb(struct shash_desc *desc, const u8 **data,
+			     int blen, u8 **outs, u32 num_mb)
+{
+	return crypto_shash_init(desc) ?:
+	       crypto_shash_finup_mb(desc, data, blen, outs, num_mb);
+}
+
+static int test_shash_mb_jiffies(struct shash_desc *desc, const u8 **data,
+				 int blen, u8 **outs, u32 num_mb, int secs)
+{
+	unsigned long start, end;
+	int bcount;
+	int ret;
+
+	for (start = jiffies, end = start + secs * HZ, bcount = 0;
+	     time_before(jiffies, end); bcount++) {
+		ret = do_shash_finup_mb(desc, data, blen, outs, num_mb);
+		if (ret)
+			return ret;
+	}
+
+	pr_cont("%6u opers/sec, %9lu bytes/sec\n",
+		bcount * num_mb / secs, ((long)bcount * num_mb * blen) / secs);
+
+	return 0;
+}
+
+static int test_shash_mb_cycles(struct shash_desc *desc, const u8 **data,
+				int blen, u8 **outs, u32 num_mb)
+{
+	unsigned long cycles = 0;
+	int ret, i;
+
+	/* Warm-up run. */
+	for (i = 0; i < 4; i++) {
+		ret = do_shash_finup_mb(desc, data, blen, outs, num_mb);
+		if (ret)
+			return ret;
+	}
+
+	/* The real thing. */
+	for (i = 0; i < 8; i++) {
+		cycles_t start, end;
+
+		start = get_cycles();
+		ret = do_shash_finup_mb(desc, data, blen, outs, num_mb);
+		if (ret)
+			return ret;
+		end = get_cycles();
+
+		cycles += end - start;
+	}
+
+	pr_cont("%6lu cycles/operation, %4lu cycles/byte\n",
+		cycles / (8 * num_mb), cycles / (8 * num_mb * blen));
+
+	return 0;
+}
+
+/*
+ * Hash num_mb independent messages of each size at once through
+ * crypto_shash_finup_mb().  Only the single-update entries of the
+ * template are used, and figures are per message.
+ */
+static void test_shash_mb_speed(const char *algo, unsigned int secs,
+				struct hash_speed *speed, u32 num_mb)
+{
+	struct crypto_shash *tfm;
+	struct shash_desc *desc;
+	const u8 **data;
+	u8 **outs;
+	u8 *output;
+	int i, ret;
+	u32 j;
+
+	tfm = crypto_alloc_shash(algo, 0, 0);
+	if (IS_ERR(tfm)) {
+		pr_err("failed to load transform for %s: %ld\n",
+		       algo, PTR_ERR(tfm));
+		return;
+	}
+
+	pr_info("testing speed of multibuffer %s (%s), %u messages, %u interleaved\n",
+		algo, get_driver_name(crypto_shash, tfm), num_mb,
+		crypto_shash_mb_max_msgs(tfm));
+
+	if (crypto_shash_digestsize(tfm) > MAX_DIGEST_SIZE) {
+		pr_err("digestsize(%u) > %d\n", crypto_shash_digestsize(tfm),
+		       MAX_DIGEST_SIZE);
+		goto out;
+	}
+
+	desc = kmalloc(sizeof(*desc) + crypto_shash_descsize(tfm), GFP_KERNEL);
+	data = kmalloc_array(num_mb, sizeof(*data), GFP_KERNEL);
+	outs = kmalloc_array(num_mb, sizeof(*outs), GFP_KERNEL);
+	output = kmalloc_array(num_mb, MAX_DIGEST_SIZE, GFP_KERNEL);
+	if (!desc || !data || !outs || !output) {
+		pr_err("multibuffer hash allocation failure\n");
+		goto out_free;
+	}
+
+	desc->tfm = tfm;
+	for (j = 0; j < num_mb; j++) {
+		data[j] = (const u8 *)tvmem[j % TVMEMSIZE];
+		outs[j] = output + j * MAX_DIGEST_SIZE;
+	}
+
+	for (i = 0; speed[i].blen != 0; i++) {
+		if (speed[i].blen != speed[i].plen)
+			continue;
+
+		if (speed[i].blen > PAGE_SIZE) {
+			pr_err("template (%u) too big for tvmem (%lu)\n",
+			       speed[i].blen, PAGE_SIZE);
+			break;
+		}
+
+		if (klen)
+			crypto_shash_setkey(tfm, tvmem[0], klen);
+
+		pr_info("test%3u (%5u byte blocks): ", i, speed[i].blen);
+
+		if (secs) {
+			ret = test_shash_mb_jiffies(desc, data, speed[i].blen,
+						    outs, num_mb, secs);
+			cond_resched();
+		} else {
+			ret = test_shash_mb_cycles(desc, data, speed[i].blen,
+						   outs, num_mb);
+		}
+
+		if (ret) {
+			pr_err("hashing failed ret=%d\n", ret);
+			break;
+		}
+	}
+
+out_free:
+	kfree(output);
+	kfree(outs);
+	kfree(data);
+	kfree(desc);
+out:
+	crypto_free_shash(tfm);
+}
+
+struct test_acomp_data {
+	u8 *src;
+	u8 *comp;
+	u8 *out;
+	unsigned int clen;
+};
+
+#define ACOMP_SPEED_DLEN	(2 * PAGE_SIZE)
+
+static int do_acomp_batch(struct acomp_req **reqs, struct test_acomp_data *data,
+			  int *errors, u32 num_mb, bool comp)
+{
+	u32 i;
+	int ret;
+
+	for (i = 0; i < num_mb; i++) {
+		if (comp) {
+			acomp_request_set_src_nondma(reqs[i], data[i].src,
+						     PAGE_SIZE);
+			acomp_request_set_dst_nondma(reqs[i], data[i].comp,
+						     ACOMP_SPEED_DLEN);
+		} else {
+			acomp_request_set_src_nondma(reqs[i], data[i].comp,
+						     data[i].clen);
+			acomp_request_set_dst_nondma(reqs[i], data[i].out,
+						     PAGE_SIZE);
+		}
+	}
+
+	ret = comp ? crypto_acomp_compress_batch(reqs, errors, num_mb) :
+		     crypto_acomp_decompress_batch(reqs, errors, num_mb);
+	if (ret)
+		return ret;
+
+	for (i = 0; comp && i < num_mb; i++)
+		data[i].clen = reqs[i]->dlen;
+
+	return 0;
+}
+
+static int test_acomp_jiffies(struct acomp_req **reqs,
+			      struct test_acomp_data *data, int *errors,
+			      u32 num_mb, bool comp, int secs)
+{
+	unsigned long start, end;
+	unsigned long clen = 0;
+	int bcount;
+	int ret;
+	u32 i;
+
+	for (start = jiffies, end = start + secs * HZ, bcount = 0;
+	     time_before(jiffies, end); bcount++) {
+		ret = do_acomp_batch(reqs, data, errors, num_mb, comp);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < num_mb; i++)
+		clen += data[i].clen;
+
+	pr_cont("%6u opers/sec, %9lu bytes/sec, %lu%% of input\n",
+		bcount * num_mb / secs,
+		((long)bcount * num_mb * PAGE_SIZE) / secs,
+		clen * 100 / (num_mb * PAGE_SIZE));
+
+	return 0;
+}
+
+static void test_acomp_fill(u8 *buf, unsigned int len)
+{
+	static const char words[] =
+		"the quick brown fox jumps over the lazy dog 0123456789 ";
+	unsigned int i;
+
+	/* Text with a sprinkle of noise, so the ratio is neither 0 nor 1. */
+	for (i = 0; i < len; i++)
+		buf[i] = words[(i * 7 + i / 64) % (sizeof(words) - 1)];
+	for (i = 0; i < len / 16; i++)
+		buf[get_random_u32_below(len)] = get_random_u8();
+}
+
+/*
+ * Compress and decompress num_mb independent pages at a time through the
+ * acomp batch interface.  If the algorithm takes a dictionary, repeat the
+ * run with a dictionary built from a page of the same kind of data.
+ */
+static void test_acomp_speed(const char *algo, unsigned int secs, u32 num_mb)
+{
+	struct test_acomp_data *data;
+	struct crypto_acomp *tfm;
+	struct acomp_req **reqs;
+	int *errors;
+	u8 *dict;
+	int pass;
+	int ret;
+	u32 i;
+
+	tfm = crypto_alloc_acomp(algo, 0, CRYPTO_ALG_ASYNC);
+	if (IS_ERR(tfm)) {
+		pr_err("failed to load transform for %s: %ld\n",
+		       algo, PTR_ERR(tfm));
+		return;
+	}
+
+	if (!secs)
+		secs = 1;
+
+	pr_info("testing speed of %s (%s), %u pages per batch\n", algo,
+		get_driver_name(crypto_acomp, tfm), num_mb);
+
+	data = kcalloc(num_mb, sizeof(*data), GFP_KERNEL);
+	reqs = kcalloc(num_mb, sizeof(*reqs), GFP_KERNEL);
+	errors = kcalloc(num_mb, sizeof(*errors), GFP_KERNEL);
+	dict = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!data || !reqs || !errors || !dict)
+		goto out_free;
+
+	for (i = 0; i < num_mb; i++) {
+		data[i].src = kmalloc(PAGE_SIZE, GFP_KERNEL);
+		data[i].comp = kmalloc(ACOMP_SPEED_DLEN, GFP_KERNEL);
+		data[i].out = kmalloc(PAGE_SIZE, GFP_KERNEL);
+		reqs[i] = acomp_request_alloc(tfm);
+		if (!data[i].src || !data[i].comp || !data[i].out || !reqs[i]) {
+			pr_err("acomp allocation failure\n");
+			goto out_free;
+		}
+
+		test_acomp_fill(data[i].src, PAGE_SIZE);
+		acomp_request_set_callback(reqs[i], 0, NULL, NULL);
+	}
+	test_acomp_fill(dict, PAGE_SIZE);
+
+	for (pass = 0; pass < 2; pass++) {
+		if (pass) {
+			ret = crypto_acomp_setdict(tfm, dict, PAGE_SIZE);
+			if (ret == -EOPNOTSUPP)
+				break;
+			if (ret) {
+				pr_err("setting dictionary failed ret=%d\n",
+				       ret);
+				break;
+			}
+		}
+
+		pr_info("%scompression: ", pass ? "dictionary " : "");
+		ret = test_acomp_jiffies(reqs, data, errors, num_mb, true,
+					 secs);
+		if (ret) {
+			pr_err("compression failed ret=%d\n", ret);
+			break;
+		}
+		cond_resched();
+
+		pr_info("%sdecompression: ", pass ? "dictionary " : "");
+		ret = test_acomp_jiffies(reqs, data, errors, num_mb, false,
+					 secs);
+		if (ret) {
+			pr_err("decompression failed ret=%d\n", ret);
+			break;
+		}
+		cond_resched();
+
+		for (i = 0; i < num_mb; i++) {
+			if (reqs[i]->dlen != PAGE_SIZE ||
+			    memcmp(data[i].out, data[i].src, PAGE_SIZE)) {
+				pr_err("round trip mismatch on page %u\n", i);
+				goto out_free;
+			}
+		}
+	}
+
+out_free:
+	for (i = 0; data && reqs && i < num_mb; i++) {
+		acomp_request_free(reqs[i]);
+		kfree(data[i].out);
+		kfree(data[i].comp);
+		kfree(data[i].src);
+	}
+	kfree(dict);
+	kfree(errors);
+	kfree(reqs);
+	kfree(data);
+	crypto_free_acomp(tfm);
+}
+
 struct test_mb_skcipher_data {
 	struct scatterlist sg[XBUFSIZE];
 	struct skcipher_request *req;
@@ -2298,6 +2631,21 @@ static int do_test(const char *alg, u32 type, u32 mask, int m, u32 num_mb)
 				generic_hash_speed_template);
 		if (mode > 300 && mode < 400) break;
 		fallthrough;
+	case 329:
+		if (alg) {
+			test_shash_mb_speed(alg, sec,
+					    generic_hash_speed_template,
+					    num_mb);
+			break;
+		}
+		test_shash_mb_speed("sha256", sec, generic_hash_speed_template,
+				    num_mb);
+		test_shash_mb_speed("sha512", sec, generic_hash_speed_template,
+				    num_mb);
+		test_shash_mb_speed("blake2b-512", sec,
+				    generic_hash_speed_template, num_mb);
+		if (mode > 300 && mode < 400) break;
+		fallthrough;
 	case 399:
 		break;
 
@@ -2800,6 +3148,16 @@ static int do_test(const char *alg, u32 type, u32 mask, int m, u32 num_mb)
 				       speed_template_16_32, num_mb);
 		break;
 
+	case 700:
+		if (alg) {
+			test_acomp_speed(alg, sec, num_mb);
+			break;
+		}
+		test_acomp_speed("lz4", sec, num_mb);
+		test_acomp_speed("zstd", sec, num_mb);
+		test_acomp_speed("deflate", sec, num_mb);
+		break;
+
 	}
 
 	return ret;
@@ -1639,6 +1639,101 @@ static int test_ahash_vec_cfg(const struct hash_testvec *vec,
 				 driver, cfg);
 }
 
+/*
+ * Test crypto_shash_finup_mb() by hashing several variants of the test vector
+ * at once, using the first half of the message as the common prefix held in
+ * the desc.  Message i has its last byte XORed with i, so that swapped or
+ * mixed up messages are caught, and is checked against its own digest.  An
+ * odd number of messages also exercises the single-message tail.
+ */
+#define TEST_MB_MSGS	(HASH_MAX_MB_MSGS - 1)
+
+static int test_shash_finup_mb(const struct hash_testvec *vec,
+			       const char *vec_name, struct shash_desc *desc)
+{
+	struct crypto_shash *tfm = desc->tfm;
+	const unsigned int digestsize = crypto_shash_digestsize(tfm);
+	const char *driver = crypto_shash_driver_name(tfm);
+	const unsigned int prefix_len = vec->psize / 2;
+	const unsigned int psize = vec->psize;
+	const u8 *data[TEST_MB_MSGS];
+	u8 *outs[TEST_MB_MSGS];
+	u8 *results, *refs, *msgs;
+	unsigned int i;
+	int err;
+
+	if (vec->setkey_error || vec->digest_error)
+		return 0;
+
+	if (vec->ksize) {
+		err = crypto_shash_setkey(tfm, vec->key, vec->ksize);
+		if (err) {
+			pr_err("alg: shash: %s setkey failed on test vector %s; err=%d\n",
+			       driver, vec_name, err);
+			return err;
+		}
+	}
+
+	results = kmalloc_array(2 * TEST_MB_MSGS, HASH_MAX_DIGESTSIZE,
+				GFP_KERNEL);
+	msgs = kmalloc_array(TEST_MB_MSGS, psize ?: 1, GFP_KERNEL);
+	if (!results || !msgs) {
+		err = -ENOMEM;
+		goto out;
+	}
+	refs = &results[TEST_MB_MSGS * HASH_MAX_DIGESTSIZE];
+
+	for (i = 0; i < TEST_MB_MSGS; i++) {
+		u8 *msg = &msgs[i * psize];
+
+		memcpy(msg, vec->plaintext, psize);
+		if (psize)
+			msg[psize - 1] ^= i;
+		data[i] = msg + prefix_len;
+		outs[i] = &results[i * HASH_MAX_DIGESTSIZE];
+
+		err = crypto_shash_digest(desc, msg, psize,
+					  &refs[i * HASH_MAX_DIGESTSIZE]);
+		if (err) {
+			pr_err("alg: shash: %s digest() failed with err %d on test vector %s\n",
+			       driver, err, vec_name);
+			goto out;
+		}
+	}
+
+	/* Message 0 is the test vector itself */
+	if (memcmp(refs, vec->digest, digestsize) != 0) {
+		pr_err("alg: shash: %s digest() test failed (wrong result) on test vector %s\n",
+		       driver, vec_name);
+		err = -EINVAL;
+		goto out;
+	}
+
+	err = crypto_shash_init(desc) ?:
+	      crypto_shash_update(desc, vec->plaintext, prefix_len) ?:
+	      crypto_shash_finup_mb(desc, data, psize - prefix_len, outs,
+				    TEST_MB_MSGS);
+	if (err) {
+		pr_err("alg: shash: %s finup_mb() failed with err %d on test vector %s\n",
+		       driver, err, vec_name);
+		goto out;
+	}
+
+	for (i = 0; i < TEST_MB_MSGS; i++) {
+		if (memcmp(outs[i], &refs[i * HASH_MAX_DIGESTSIZE],
+			   digestsize) != 0) {
+			pr_err("alg: shash: %s finup_mb() test failed (wrong result) on test vector %s, message %u\n",
+			       driver, vec_name, i);
+			err = -EINVAL;
+			goto out;
+		}
+	}
+out:
+	kfree(msgs);
+	kfree(results);
+	return err;
+}
+
 static int test_hash_vec_cfg(const struct hash_testvec *vec,
 			     const char *vec_name,
 			     const struct testvec_config *cfg,
@@ -1683,6 +1778,12 @@ static int test_hash_vec(const struct hash_testvec *vec, unsigned int vec_num,
 			return err;
 	}
 
+	if (desc) {
+		err = test_shash_finup_mb(vec, vec_name, desc);
+		if (err)
+			return err;
+	}
+
 	if (!noslowtests) {
 		struct rnd_state rng;
 		struct testvec_config cfg;
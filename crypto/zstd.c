@@ -28,6 +28,12 @@ struct zstd_ctx {
 	u8 wksp[] __aligned(8);
 };
 
+struct zstd_tfm_ctx {
+	void *dict;
+	zstd_cdict *cdict;
+	zstd_ddict *ddict;
+};
+
 static DEFINE_MUTEX(zstd_stream_lock);
 
 static void *zstd_alloc_stream(void)
@@ -64,6 +70,63 @@ static struct crypto_acomp_streams zstd_streams = {
 	.free_ctx = zstd_free_stream,
 };
 
+static void *zstd_dict_alloc(void *opaque, size_t size)
+{
+	return kvmalloc(size, GFP_KERNEL);
+}
+
+static void zstd_dict_free(void *opaque, void *address)
+{
+	kvfree(address);
+}
+
+static const zstd_custom_mem zstd_dict_mem = {
+	.customAlloc = zstd_dict_alloc,
+	.customFree = zstd_dict_free,
+};
+
+static void zstd_free_dict(struct zstd_tfm_ctx *tctx)
+{
+	/* The digested dictionaries reference tctx->dict, free them first. */
+	zstd_free_cdict(tctx->cdict);
+	zstd_free_ddict(tctx->ddict);
+	kvfree(tctx->dict);
+
+	tctx->cdict = NULL;
+	tctx->ddict = NULL;
+	tctx->dict = NULL;
+}
+
+static int zstd_setdict(struct crypto_acomp *acomp_tfm, const void *dict,
+			unsigned int len)
+{
+	struct zstd_tfm_ctx *tctx = acomp_tfm_ctx(acomp_tfm);
+	zstd_parameters params;
+
+	zstd_free_dict(tctx);
+	if (!len)
+		return 0;
+
+	tctx->dict = kvmemdup(dict, len, GFP_KERNEL);
+	if (!tctx->dict)
+		return -ENOMEM;
+
+	/* Must match the parameters the stream workspaces are sized for. */
+	params = zstd_get_params(ZSTD_DEF_LEVEL, ZSTD_MAX_SIZE);
+
+	tctx->cdict = zstd_create_cdict_byreference(tctx->dict, len,
+						    params.cParams,
+						    zstd_dict_mem);
+	tctx->ddict = zstd_create_ddict_byreference(tctx->dict, len,
+						    zstd_dict_mem);
+	if (!tctx->cdict || !tctx->ddict) {
+		zstd_free_dict(tctx);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static int zstd_init(struct crypto_acomp *acomp_tfm)
 {
 	int ret = 0;
@@ -72,16 +135,20 @@ static int zstd_init(struct crypto_acomp *acomp_tfm)
 	ret = crypto_acomp_alloc_streams(&zstd_streams);
 	mutex_unlock(&zstd_stream_lock);
 
+	acomp_tfm->setdict = zstd_setdict;
+
 	return ret;
 }
 
 static void zstd_exit(struct crypto_acomp *acomp_tfm)
 {
+	zstd_free_dict(acomp_tfm_ctx(acomp_tfm));
 	crypto_acomp_free_streams(&zstd_streams);
 }
 
 static int zstd_compress_one(struct acomp_req *req, struct zstd_ctx *ctx,
-			     const void *src, void *dst, unsigned int *dlen)
+			     const zstd_cdict *cdict, const void *src,
+			     void *dst, unsigned int *dlen)
 {
 	size_t out_len;
 
@@ -89,8 +156,12 @@ static int zstd_compress_one(struct acomp_req *req, struct zstd_ctx *ctx,
 	if (!ctx->cctx)
 		return -EINVAL;
 
-	out_len = zstd_compress_cctx(ctx->cctx, dst, req->dlen, src, req->slen,
-				     &ctx->params);
+	if (cdict)
+		out_len = zstd_compress_using_cdict(ctx->cctx, dst, req->dlen,
+						    src, req->slen, cdict);
+	else
+		out_len = zstd_compress_cctx(ctx->cctx, dst, req->dlen, src,
+					     req->slen, &ctx->params);
 	if (zstd_is_error(out_len))
 		return -EINVAL;
 
@@ -101,6 +172,7 @@ static int zstd_compress_one(struct acomp_req *req, struct zstd_ctx *ctx,
 
 static int zstd_compress(struct acomp_req *req)
 {
+	struct zstd_tfm_ctx *tctx = acomp_tfm_ctx(crypto_acomp_reqtfm(req));
 	struct crypto_acomp_stream *s;
 	unsigned int pos, scur, dcur;
 	unsigned int total_out = 0;
@@ -140,13 +212,20 @@ static int zstd_compress(struct acomp_req *req)
 		do {
 			scur = acomp_walk_next_src(&walk);
 			if (dcur == req->dlen && scur == req->slen) {
-				ret = zstd_compress_one(req, ctx, walk.src.virt.addr,
+				ret = zstd_compress_one(req, ctx, tctx->cdict,
+							walk.src.virt.addr,
 							walk.dst.virt.addr, &total_out);
 				acomp_walk_done_src(&walk, scur);
 				acomp_walk_done_dst(&walk, dcur);
 				goto out;
 			}
 
+			/* Dictionaries are only supported for linear buffers. */
+			if (tctx->cdict) {
+				ret = -EINVAL;
+				goto out;
+			}
+
 			if (scur) {
 				inbuf.pos = 0;
 				inbuf.src = walk.src.virt.addr;
@@ -193,7 +272,8 @@ static int zstd_compress(struct acomp_req *req)
 }
 
 static int zstd_decompress_one(struct acomp_req *req, struct zstd_ctx *ctx,
-			       const void *src, void *dst, unsigned int *dlen)
+			       const zstd_ddict *ddict, const void *src,
+			       void *dst, unsigned int *dlen)
 {
 	size_t out_len;
 
@@ -201,7 +281,12 @@ static int zstd_decompress_one(struct acomp_req *req, struct zstd_ctx *ctx,
 	if (!ctx->dctx)
 		return -EINVAL;
 
-	out_len = zstd_decompress_dctx(ctx->dctx, dst, req->dlen, src, req->slen);
+	if (ddict)
+		out_len = zstd_decompress_using_ddict(ctx->dctx, dst, req->dlen,
+						      src, req->slen, ddict);
+	else
+		out_len = zstd_decompress_dctx(ctx->dctx, dst, req->dlen, src,
+					       req->slen);
 	if (zstd_is_error(out_len))
 		return -EINVAL;
 
@@ -212,6 +297,7 @@ static int zstd_decompress_one(struct acomp_req *req, struct zstd_ctx *ctx,
 
 static int zstd_decompress(struct acomp_req *req)
 {
+	struct zstd_tfm_ctx *tctx = acomp_tfm_ctx(crypto_acomp_reqtfm(req));
 	struct crypto_acomp_stream *s;
 	unsigned int total_out = 0;
 	unsigned int scur, dcur;
@@ -248,13 +334,19 @@ static int zstd_decompress(struct acomp_req *req)
 		do {
 			dcur = acomp_walk_next_dst(&walk);
 			if (dcur == req->dlen && scur == req->slen) {
-				ret = zstd_decompress_one(req, ctx, walk.src.virt.addr,
+				ret = zstd_decompress_one(req, ctx, tctx->ddict,
+							  walk.src.virt.addr,
 							  walk.dst.virt.addr, &total_out);
 				acomp_walk_done_dst(&walk, dcur);
 				acomp_walk_done_src(&walk, scur);
 				goto out;
 			}
 
+			if (tctx->ddict) {
+				ret = -EINVAL;
+				goto out;
+			}
+
 			if (!dcur) {
 				ret = -ENOSPC;
 				goto out;
@@ -294,6 +386,7 @@ static struct acomp_alg zstd_acomp = {
 		.cra_name = "zstd",
 		.cra_driver_name = "zstd-generic",
 		.cra_flags = CRYPTO_ALG_REQ_VIRT,
+		.cra_ctxsize = sizeof(struct zstd_tfm_ctx),
 		.cra_module = THIS_MODULE,
 	},
 	.init = zstd_init,
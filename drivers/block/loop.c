@@ -79,6 +79,7 @@ struct loop_device {
 struct loop_cmd {
 	struct list_head list_entry;
 	bool use_aio; /* use AIO interface to handle I/O */
+	bool nowait_again; /* NOWAIT submission got -EAGAIN, use a worker */
 	atomic_t ref; /* only for aio */
 	long ret;
 	struct kiocb iocb;
@@ -286,6 +287,12 @@ static void lo_complete_rq(struct request *rq)
 	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
 	blk_status_t ret = BLK_STS_OK;
 
+	/* Issued from ->queue_rq but the backing file would have blocked */
+	if (unlikely(cmd->nowait_again)) {
+		blk_mq_requeue_request(rq, true);
+		return;
+	}
+
 	if (cmd->ret < 0 || cmd->ret == blk_rq_bytes(rq) ||
 	    req_op(rq) != REQ_OP_READ) {
 		if (cmd->ret < 0)
@@ -333,12 +340,19 @@ static void lo_rw_aio_complete(struct kiocb *iocb, long ret)
 {
 	struct loop_cmd *cmd = container_of(iocb, struct loop_cmd, iocb);
 
+	if (ret == -EAGAIN && (iocb->ki_flags & IOCB_NOWAIT))
+		cmd->nowait_again = true;
 	cmd->ret = ret;
 	lo_rw_aio_do_completion(cmd);
 }
 
+/*
+ * With @nowait, the I/O is issued with IOCB_NOWAIT and -EAGAIN is returned
+ * if the backing file would have to block before it was queued. Nothing
+ * is completed in that case and the command can be issued again.
+ */
 static int lo_rw_aio(struct loop_device *lo, struct loop_cmd *cmd,
-		     loff_t pos, int rw)
+		     loff_t pos, int rw, bool nowait)
 {
 	struct iov_iter iter;
 	struct req_iterator rq_iter;
@@ -394,6 +408,8 @@ static int lo_rw_aio(struct loop_device *lo, struct loop_cmd *cmd,
 	if (cmd->use_aio) {
 		cmd->iocb.ki_complete = lo_rw_aio_complete;
 		cmd->iocb.ki_flags = IOCB_DIRECT;
+		if (nowait)
+			cmd->iocb.ki_flags |= IOCB_NOWAIT;
 	} else {
 		cmd->iocb.ki_complete = NULL;
 		cmd->iocb.ki_flags = 0;
@@ -405,6 +421,14 @@ static int lo_rw_aio(struct loop_device *lo, struct loop_cmd *cmd,
 	} else
 		ret = file->f_op->read_iter(&cmd->iocb, &iter);
 
+	if (nowait && ret == -EAGAIN) {
+		if (rw == ITER_SOURCE)
+			kiocb_end_write(&cmd->iocb);
+		kfree(cmd->bvec);
+		cmd->bvec = NULL;
+		return -EAGAIN;
+	}
+
 	lo_rw_aio_do_completion(cmd);
 
 	if (ret != -EIOCBQUEUED)
@@ -432,9 +456,9 @@ static int do_req_filebacked(struct loop_device *lo, struct request *rq)
 	case REQ_OP_DISCARD:
 		return lo_fallocate(lo, rq, pos, FALLOC_FL_PUNCH_HOLE);
 	case REQ_OP_WRITE:
-		return lo_rw_aio(lo, cmd, pos, ITER_SOURCE);
+		return lo_rw_aio(lo, cmd, pos, ITER_SOURCE, false);
 	case REQ_OP_READ:
-		return lo_rw_aio(lo, cmd, pos, ITER_DEST);
+		return lo_rw_aio(lo, cmd, pos, ITER_DEST, false);
 	default:
 		WARN_ON_ONCE(1);
 		return -EIO;
@@ -1846,10 +1870,102 @@ static const struct kernel_param_ops loop_hw_qdepth_param_ops = {
 device_param_cb(hw_queue_depth, &loop_hw_qdepth_param_ops, &hw_queue_depth, 0444);
 MODULE_PARM_DESC(hw_queue_depth, "Queue depth for each hardware queue. Default: " __stringify(LOOP_DEFAULT_HW_Q_DEPTH));
 
+static unsigned int nr_hw_queues = 1;
+
+static int loop_set_nr_hw_queues(const char *s, const struct kernel_param *p)
+{
+	unsigned int nr;
+	int ret;
+
+	ret = kstrtouint(s, 0, &nr);
+	if (ret < 0)
+		return ret;
+	if (nr < 1)
+		return -EINVAL;
+	nr_hw_queues = nr;
+	return 0;
+}
+
+static const struct kernel_param_ops loop_nr_hw_queues_param_ops = {
+	.set	= loop_set_nr_hw_queues,
+	.get	= param_get_uint,
+};
+
+device_param_cb(nr_hw_queues, &loop_nr_hw_queues_param_ops, &nr_hw_queues, 0444);
+MODULE_PARM_DESC(nr_hw_queues, "Number of hardware queues, capped at the number of CPUs. Default: 1");
+
+static bool nowait_dio;
+module_param(nowait_dio, bool, 0444);
+MODULE_PARM_DESC(nowait_dio, "Issue direct I/O with IOCB_NOWAIT from the submitter before using a worker. Default: false");
+
 MODULE_DESCRIPTION("Loopback device support");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
+/*
+ * With nowait_dio, direct I/O reads and writes are first issued right from
+ * ->queue_rq with IOCB_NOWAIT, which saves the hop to a worker for backing
+ * files that can take the I/O without blocking. Preparing the I/O may still
+ * sleep, so this is only done for devices with a BLK_MQ_F_BLOCKING tag set.
+ */
+static bool loop_can_nowait(struct loop_device *lo, struct loop_cmd *cmd)
+{
+	struct request *rq = blk_mq_rq_from_pdu(cmd);
+	bool again = cmd->nowait_again;
+
+	/* Once the backing file asked us to wait, leave it to a worker */
+	cmd->nowait_again = false;
+	if (again || !cmd->use_aio || !(lo->tag_set.flags & BLK_MQ_F_BLOCKING))
+		return false;
+
+	if (req_op(rq) != REQ_OP_READ && req_op(rq) != REQ_OP_WRITE)
+		return false;
+
+	if (!(lo->lo_backing_file->f_mode & FMODE_NOWAIT))
+		return false;
+
+	if (op_is_write(req_op(rq)) && (lo->lo_flags & LO_FLAGS_READ_ONLY))
+		return false;
+
+	return true;
+}
+
+static int loop_issue_nowait(struct loop_device *lo, struct loop_cmd *cmd)
+{
+	struct cgroup_subsys_state *cmd_blkcg_css = cmd->blkcg_css;
+	struct cgroup_subsys_state *cmd_memcg_css = cmd->memcg_css;
+	struct request *rq = blk_mq_rq_from_pdu(cmd);
+	loff_t pos = ((loff_t) blk_rq_pos(rq) << 9) + lo->lo_offset;
+	int rw = op_is_write(req_op(rq)) ? ITER_SOURCE : ITER_DEST;
+	struct mem_cgroup *old_memcg = NULL;
+	unsigned int noio_flags;
+	int ret;
+
+	/* Charge the I/O to the cgroups of the request, as loop_handle_cmd() */
+	if (cmd_blkcg_css)
+		kthread_associate_blkcg(cmd_blkcg_css);
+	if (cmd_memcg_css)
+		old_memcg = set_active_memcg(
+			mem_cgroup_from_css(cmd_memcg_css));
+
+	/* Same as the workers, don't recurse into I/O from reclaim */
+	noio_flags = memalloc_noio_save();
+	ret = lo_rw_aio(lo, cmd, pos, rw, true);
+	memalloc_noio_restore(noio_flags);
+
+	if (cmd_blkcg_css)
+		kthread_associate_blkcg(NULL);
+
+	if (cmd_memcg_css) {
+		set_active_memcg(old_memcg);
+		/* On -EAGAIN the command goes to a worker, which drops it */
+		if (ret == -EIOCBQUEUED)
+			css_put(cmd_memcg_css);
+	}
+
+	return ret;
+}
+
 static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		const struct blk_mq_queue_data *bd)
 {
@@ -1888,6 +2004,11 @@ static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 #endif
 	}
 #endif
+
+	if (loop_can_nowait(lo, cmd) &&
+	    loop_issue_nowait(lo, cmd) == -EIOCBQUEUED)
+		return BLK_STS_OK;
+
 	loop_queue_work(lo, cmd);
 
 	return BLK_STS_OK;
@@ -2033,11 +2154,18 @@ static int loop_add(int i)
 	i = err;
 
 	lo->tag_set.ops = &loop_mq_ops;
-	lo->tag_set.nr_hw_queues = 1;
+	lo->tag_set.nr_hw_queues = min(nr_hw_queues, nr_cpu_ids);
 	lo->tag_set.queue_depth = hw_queue_depth;
 	lo->tag_set.numa_node = NUMA_NO_NODE;
 	lo->tag_set.cmd_size = sizeof(struct loop_cmd);
 	lo->tag_set.flags = BLK_MQ_F_STACKING | BLK_MQ_F_NO_SCHED_BY_DEFAULT;
+	/*
+	 * ->queue_rq issues the NOWAIT I/O itself, which can still sleep. The
+	 * flag is fixed once the tag set is allocated, so it can't follow
+	 * LOOP_SET_DIRECT_IO and is decided here for the device's lifetime.
+	 */
+	if (nowait_dio)
+		lo->tag_set.flags |= BLK_MQ_F_BLOCKING;
 	lo->tag_set.driver_data = lo;
 
 	err = blk_mq_alloc_tag_set(&lo->tag_set);
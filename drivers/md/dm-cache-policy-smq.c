@@ -14,6 +14,8 @@
 #include <linux/jiffies.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/seqlock.h>
 #include <linux/vmalloc.h>
 #include <linux/math64.h>
 
@@ -576,6 +578,12 @@ struct smq_hash_table {
 	struct entry_space *es;
 	unsigned long long hash_bits;
 	unsigned int *buckets;
+
+	/*
+	 * Optional, bumped around every change to the chains so readers
+	 * can walk them without holding the policy lock.
+	 */
+	seqcount_spinlock_t *seq;
 };
 
 /*
@@ -587,6 +595,7 @@ static int h_init(struct smq_hash_table *ht, struct entry_space *es, unsigned in
 	unsigned int i, nr_buckets;
 
 	ht->es = es;
+	ht->seq = NULL;
 	nr_buckets = roundup_pow_of_two(max(nr_entries / 4u, 16u));
 	ht->hash_bits = __ffs(nr_buckets);
 
@@ -605,6 +614,18 @@ static void h_exit(struct smq_hash_table *ht)
 	vfree(ht->buckets);
 }
 
+static void h_write_begin(struct smq_hash_table *ht)
+{
+	if (ht->seq)
+		write_seqcount_begin(ht->seq);
+}
+
+static void h_write_end(struct smq_hash_table *ht)
+{
+	if (ht->seq)
+		write_seqcount_end(ht->seq);
+}
+
 static struct entry *h_head(struct smq_hash_table *ht, unsigned int bucket)
 {
 	return to_entry(ht->es, ht->buckets[bucket]);
@@ -625,7 +646,9 @@ static void h_insert(struct smq_hash_table *ht, struct entry *e)
 {
 	unsigned int h = hash_64(from_oblock(e->oblock), ht->hash_bits);
 
+	h_write_begin(ht);
 	__h_insert(ht, h, e);
+	h_write_end(ht);
 }
 
 static struct entry *__h_lookup(struct smq_hash_table *ht, unsigned int h, dm_oblock_t oblock,
@@ -667,8 +690,10 @@ static struct entry *h_lookup(struct smq_hash_table *ht, dm_oblock_t oblock)
 		 * Move to the front because this entry is likely
 		 * to be hit again.
 		 */
+		h_write_begin(ht);
 		__h_unlink(ht, h, e, prev);
 		__h_insert(ht, h, e);
+		h_write_end(ht);
 	}
 
 	return e;
@@ -684,8 +709,11 @@ static void h_remove(struct smq_hash_table *ht, struct entry *e)
 	 * iterate the bucket to remove an item.
 	 */
 	e = __h_lookup(ht, h, e->oblock, &prev);
-	if (e)
+	if (e) {
+		h_write_begin(ht);
 		__h_unlink(ht, h, e, prev);
+		h_write_end(ht);
+	}
 }
 
 /*----------------------------------------------------------------*/
@@ -794,11 +822,44 @@ static struct entry *get_entry(struct entry_alloc *ea, unsigned int index)
 #define HOTSPOT_UPDATE_PERIOD (HZ)
 #define CACHE_UPDATE_PERIOD (60ul * HZ)
 
+/*
+ * Hits on clean mappings are found without taking the policy lock.  Rather
+ * than requeue the entry there and then, each cpu buffers the blocks it
+ * hit and folds them into the queues in one go.
+ */
+#define HIT_BATCH_SIZE 64u
+
+/*
+ * Maximum number of writebacks queued per call to get_background_work.
+ */
+#define WRITEBACK_BATCH_SIZE 16u
+
+struct hit_buffer {
+	/*
+	 * Nests outside the policy lock, smq_tick() folds the buffers of
+	 * all cpus.
+	 */
+	spinlock_t lock;
+	unsigned int nr;
+	struct {
+		dm_oblock_t oblock;
+		unsigned int cblock;
+	} hit[HIT_BATCH_SIZE];
+};
+
 struct smq_policy {
 	struct dm_cache_policy policy;
 
 	/* protects everything */
 	spinlock_t lock;
+
+	/*
+	 * Covers the chains of the main hash table, and the dirty and
+	 * pending_work flags of the entries in it.  Writers hold the lock.
+	 */
+	seqcount_spinlock_t table_seq;
+	struct hit_buffer __percpu *hits;
+
 	dm_cblock_t cache_size;
 	sector_t cache_block_size;
 
@@ -1173,13 +1234,17 @@ static void mark_pending(struct smq_policy *mq, struct entry *e)
 	BUG_ON(e->sentinel);
 	BUG_ON(!e->allocated);
 	BUG_ON(e->pending_work);
+	write_seqcount_begin(&mq->table_seq);
 	e->pending_work = true;
+	write_seqcount_end(&mq->table_seq);
 }
 
 static void clear_pending(struct smq_policy *mq, struct entry *e)
 {
 	BUG_ON(!e->pending_work);
+	write_seqcount_begin(&mq->table_seq);
 	e->pending_work = false;
+	write_seqcount_end(&mq->table_seq);
 }
 
 static void queue_writeback(struct smq_policy *mq, bool idle)
@@ -1363,6 +1428,7 @@ static void smq_destroy(struct dm_cache_policy *p)
 	struct smq_policy *mq = to_smq_policy(p);
 
 	btracker_destroy(mq->bg_work);
+	free_percpu(mq->hits);
 	h_exit(&mq->hotspot_table);
 	h_exit(&mq->table);
 	free_bitset(mq->hotspot_hit_bits);
@@ -1373,6 +1439,113 @@ static void smq_destroy(struct dm_cache_policy *p)
 
 /*----------------------------------------------------------------*/
 
+/*
+ * Replays hits that were recorded without the lock.  The mapping may have
+ * been demoted, invalidated or even reused for another block in the
+ * meantime, so entries that no longer map the block that was hit are
+ * skipped.  Pending entries are ignored by requeue().
+ */
+static void __fold_hits(struct smq_policy *mq, struct hit_buffer *hb)
+{
+	unsigned int i;
+	struct entry *e;
+
+	for (i = 0; i < hb->nr; i++) {
+		e = get_entry(&mq->cache_alloc, hb->hit[i].cblock);
+		if (!e->allocated || e->oblock != hb->hit[i].oblock)
+			continue;
+
+		stats_level_accessed(&mq->cache_stats, e->level);
+		requeue(mq, e);
+	}
+
+	hb->nr = 0;
+}
+
+static void record_hit(struct smq_policy *mq, dm_oblock_t oblock, dm_cblock_t cblock)
+{
+	struct hit_buffer *hb = raw_cpu_ptr(mq->hits);
+	unsigned long flags;
+
+	/*
+	 * The buffer lock is only contended by smq_tick(), so it doesn't
+	 * matter if we migrate and use another cpu's buffer.
+	 */
+	spin_lock_irqsave(&hb->lock, flags);
+	hb->hit[hb->nr].oblock = oblock;
+	hb->hit[hb->nr].cblock = from_cblock(cblock);
+	if (++hb->nr == HIT_BATCH_SIZE) {
+		spin_lock(&mq->lock);
+		__fold_hits(mq, hb);
+		spin_unlock(&mq->lock);
+	}
+	spin_unlock_irqrestore(&hb->lock, flags);
+}
+
+/*
+ * Folds the hits buffered by every cpu, so that they count towards the
+ * period they were made in.
+ */
+static void fold_all_hits(struct smq_policy *mq)
+{
+	struct hit_buffer *hb;
+	unsigned long flags;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		hb = per_cpu_ptr(mq->hits, cpu);
+		if (!READ_ONCE(hb->nr))
+			continue;
+
+		spin_lock_irqsave(&hb->lock, flags);
+		spin_lock(&mq->lock);
+		__fold_hits(mq, hb);
+		spin_unlock(&mq->lock);
+		spin_unlock_irqrestore(&hb->lock, flags);
+	}
+}
+
+/*
+ * Looks up a clean mapping without taking the lock.  Returns false if
+ * the block isn't mapped, the mapping is dirty or has background work
+ * pending, or we raced with a writer; the caller should then fall back
+ * to the locked path.
+ */
+static bool lookup_clean_lockless(struct smq_policy *mq, dm_oblock_t oblock,
+				  dm_cblock_t *cblock)
+{
+	struct smq_hash_table *ht = &mq->table;
+	unsigned int h = hash_64(from_oblock(oblock), ht->hash_bits);
+	unsigned int seq, index;
+	struct entry *e;
+
+	seq = read_seqcount_begin(&mq->table_seq);
+	for (index = READ_ONCE(ht->buckets[h]); index != INDEXER_NULL; index = e->hash_next) {
+		/*
+		 * The chains are only guaranteed to be acyclic if nobody
+		 * is changing them under us.
+		 */
+		if (read_seqcount_retry(&mq->table_seq, seq))
+			return false;
+
+		e = __get_entry(ht->es, index);
+		if (e->oblock != oblock)
+			continue;
+
+		if (e->dirty || e->pending_work)
+			return false;
+
+		*cblock = infer_cblock(mq, e);
+		if (read_seqcount_retry(&mq->table_seq, seq))
+			return false;
+
+		record_hit(mq, oblock, *cblock);
+		return true;
+	}
+
+	return false;
+}
+
 static int __lookup(struct smq_policy *mq, dm_oblock_t oblock, dm_cblock_t *cblock,
 		    int data_dir, bool fast_copy,
 		    struct policy_work **work, bool *background_work)
@@ -1416,6 +1589,11 @@ static int smq_lookup(struct dm_cache_policy *p, dm_oblock_t oblock, dm_cblock_t
 	unsigned long flags;
 	struct smq_policy *mq = to_smq_policy(p);
 
+	if (lookup_clean_lockless(mq, oblock, cblock)) {
+		*background_work = false;
+		return 0;
+	}
+
 	spin_lock_irqsave(&mq->lock, flags);
 	r = __lookup(mq, oblock, cblock,
 		     data_dir, fast_copy,
@@ -1435,6 +1613,9 @@ static int smq_lookup_with_work(struct dm_cache_policy *p,
 	unsigned long flags;
 	struct smq_policy *mq = to_smq_policy(p);
 
+	if (lookup_clean_lockless(mq, oblock, cblock))
+		return 0;
+
 	spin_lock_irqsave(&mq->lock, flags);
 	r = __lookup(mq, oblock, cblock, data_dir, fast_copy, work, &background_queued);
 	spin_unlock_irqrestore(&mq->lock, flags);
@@ -1446,16 +1627,24 @@ static int smq_get_background_work(struct dm_cache_policy *p, bool idle,
 				   struct policy_work **result)
 {
 	int r;
+	unsigned int i;
 	unsigned long flags;
 	struct smq_policy *mq = to_smq_policy(p);
 
 	spin_lock_irqsave(&mq->lock, flags);
 	r = btracker_issue(mq->bg_work, result);
 	if (r == -ENODATA) {
-		if (!clean_target_met(mq, idle)) {
+		/*
+		 * Queue a batch of writebacks so the following calls can
+		 * be satisfied straight from the tracker.  Promotions are
+		 * decided by __lookup() for the block that missed, so there
+		 * is nothing to batch for them here.
+		 */
+		for (i = 0; i < WRITEBACK_BATCH_SIZE && !clean_target_met(mq, idle); i++)
 			queue_writeback(mq, idle);
+
+		if (i)
 			r = btracker_issue(mq->bg_work, result);
-		}
 	}
 	spin_unlock_irqrestore(&mq->lock, flags);
 
@@ -1529,11 +1718,15 @@ static void __smq_set_clear_dirty(struct smq_policy *mq, dm_cblock_t cblock, boo
 {
 	struct entry *e = get_entry(&mq->cache_alloc, from_cblock(cblock));
 
-	if (e->pending_work)
+	if (e->pending_work) {
+		write_seqcount_begin(&mq->table_seq);
 		e->dirty = set;
-	else {
+		write_seqcount_end(&mq->table_seq);
+	} else {
 		del_queue(mq, e);
+		write_seqcount_begin(&mq->table_seq);
 		e->dirty = set;
+		write_seqcount_end(&mq->table_seq);
 		push_queue(mq, e);
 	}
 }
@@ -1569,7 +1762,9 @@ static int smq_load_mapping(struct dm_cache_policy *p,
 {
 	struct smq_policy *mq = to_smq_policy(p);
 	struct entry *e;
+	unsigned long flags;
 
+	spin_lock_irqsave(&mq->lock, flags);
 	e = alloc_particular_entry(&mq->cache_alloc, from_cblock(cblock));
 	e->oblock = oblock;
 	e->dirty = dirty;
@@ -1581,6 +1776,7 @@ static int smq_load_mapping(struct dm_cache_policy *p,
 	 * allow demotions and cleaning to occur immediately.
 	 */
 	push_front(mq, e);
+	spin_unlock_irqrestore(&mq->lock, flags);
 
 	return 0;
 }
@@ -1589,14 +1785,24 @@ static int smq_invalidate_mapping(struct dm_cache_policy *p, dm_cblock_t cblock)
 {
 	struct smq_policy *mq = to_smq_policy(p);
 	struct entry *e = get_entry(&mq->cache_alloc, from_cblock(cblock));
+	unsigned long flags;
 
-	if (!e->allocated)
+	/*
+	 * Lockless lookups may be walking the table, so the removal must
+	 * be visible to them through the seqcount.
+	 */
+	spin_lock_irqsave(&mq->lock, flags);
+	if (!e->allocated) {
+		spin_unlock_irqrestore(&mq->lock, flags);
 		return -ENODATA;
+	}
 
 	// FIXME: what if this block has pending background work?
 	del_queue(mq, e);
 	h_remove(&mq->table, e);
 	free_entry(&mq->cache_alloc, e);
+	spin_unlock_irqrestore(&mq->lock, flags);
+
 	return 0;
 }
 
@@ -1629,6 +1835,8 @@ static void smq_tick(struct dm_cache_policy *p, bool can_block)
 	struct smq_policy *mq = to_smq_policy(p);
 	unsigned long flags;
 
+	fold_all_hits(mq);
+
 	spin_lock_irqsave(&mq->lock, flags);
 	mq->tick++;
 	update_sentinels(mq);
@@ -1733,6 +1941,7 @@ __smq_create(dm_cblock_t cache_size, sector_t origin_size, sector_t cache_block_
 	     bool mimic_mq, bool migrations_allowed, bool cleaner)
 {
 	unsigned int i;
+	int cpu;
 	unsigned int nr_sentinels_per_queue = 2u * NR_CACHE_LEVELS;
 	unsigned int total_sentinels = 2u * nr_sentinels_per_queue;
 	struct smq_policy *mq = kzalloc(sizeof(*mq), GFP_KERNEL);
@@ -1788,6 +1997,7 @@ __smq_create(dm_cblock_t cache_size, sector_t origin_size, sector_t cache_block_
 
 	mq->tick = 0;
 	spin_lock_init(&mq->lock);
+	seqcount_spinlock_init(&mq->table_seq, &mq->lock);
 
 	q_init(&mq->hotspot, &mq->es, NR_HOTSPOT_LEVELS);
 	mq->hotspot.nr_top_levels = 8;
@@ -1806,6 +2016,15 @@ __smq_create(dm_cblock_t cache_size, sector_t origin_size, sector_t cache_block_
 	if (h_init(&mq->hotspot_table, &mq->es, mq->nr_hotspot_blocks))
 		goto bad_alloc_hotspot_table;
 
+	mq->table.seq = &mq->table_seq;
+
+	mq->hits = alloc_percpu(struct hit_buffer);
+	if (!mq->hits)
+		goto bad_hits;
+
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(mq->hits, cpu)->lock);
+
 	sentinels_init(mq);
 	mq->write_promote_level = mq->read_promote_level = NR_HOTSPOT_LEVELS;
 
@@ -1822,6 +2041,8 @@ __smq_create(dm_cblock_t cache_size, sector_t origin_size, sector_t cache_block_
 	return &mq->policy;
 
 bad_btracker:
+	free_percpu(mq->hits);
+bad_hits:
 	h_exit(&mq->hotspot_table);
 bad_alloc_hotspot_table:
 	h_exit(&mq->table);
@@ -13,8 +13,10 @@
 #include <linux/dm-io.h>
 #include <linux/dm-kcopyd.h>
 #include <linux/jiffies.h>
+#include <linux/ktime.h>
 #include <linux/log2.h>
 #include <linux/list.h>
+#include <linux/math64.h>
 #include <linux/rculist.h>
 #include <linux/init.h>
 #include <linux/module.h>
@@ -333,6 +335,36 @@ struct pool_c {
 	struct pool_features adjusted_pf;  /* Features used after adjusting for constituent devices */
 };
 
+/*
+ * Latency accounting for one kind of event on a thin device.  Samples are
+ * added from the pool's ordered workqueue, so adds never race each other,
+ * but the "stats" and "clear_stats" messages read and zero the fields
+ * concurrently.  Each field is therefore atomic on its own; a report taken
+ * while samples are being added or cleared may mix old and new values.
+ */
+struct thin_latency {
+	atomic64_t count;
+	atomic64_t total_ns;
+	atomic64_t max_ns;
+};
+
+static void thin_latency_add(struct thin_latency *l, u64 ns)
+{
+	s64 max = atomic64_read(&l->max_ns);
+
+	atomic64_inc(&l->count);
+	atomic64_add(ns, &l->total_ns);
+	while (ns > max && !atomic64_try_cmpxchg(&l->max_ns, &max, ns))
+		;
+}
+
+static void thin_latency_clear(struct thin_latency *l)
+{
+	atomic64_set(&l->count, 0);
+	atomic64_set(&l->total_ns, 0);
+	atomic64_set(&l->max_ns, 0);
+}
+
 /*
  * Target context for a thin.
  */
@@ -360,6 +392,13 @@ struct thin_c {
 	 */
 	refcount_t refcount;
 	struct completion can_destroy;
+
+	/*
+	 * Time from a block being allocated to its mapping being inserted,
+	 * and time flush bios spent waiting on the group commit.
+	 */
+	struct thin_latency provision_latency;
+	struct thin_latency commit_latency;
 };
 
 /*----------------------------------------------------------------*/
@@ -822,6 +861,8 @@ struct dm_thin_new_mapping {
 	 */
 	struct bio *bio;
 	bio_end_io_t *saved_bi_end_io;
+
+	u64 start_ns;
 };
 
 static void __complete_mapping_preparation(struct dm_thin_new_mapping *m)
@@ -1012,6 +1053,7 @@ static void process_prepared_mapping(struct dm_thin_new_mapping *m)
 		cell_error(pool, m->cell);
 		goto out;
 	}
+	thin_latency_add(&tc->provision_latency, ktime_get_ns() - m->start_ns);
 
 	/*
 	 * Release any bios held while the block was being provisioned.
@@ -1271,6 +1313,7 @@ static struct dm_thin_new_mapping *get_next_mapping(struct pool *pool)
 	memset(m, 0, sizeof(struct dm_thin_new_mapping));
 	INIT_LIST_HEAD(&m->list);
 	m->bio = NULL;
+	m->start_ns = ktime_get_ns();
 
 	pool->next_mapping = NULL;
 
@@ -2357,11 +2400,23 @@ static struct thin_c *get_next_thin(struct pool *pool, struct thin_c *tc)
 	return NULL;
 }
 
+/*
+ * Every flush bio in a batch waits for the same commit, so charge its
+ * duration to the thin device each one came from.
+ */
+static void account_commit_wait(struct bio *bio, u64 commit_ns)
+{
+	struct dm_thin_endio_hook *h = dm_per_bio_data(bio, sizeof(struct dm_thin_endio_hook));
+
+	thin_latency_add(&h->tc->commit_latency, commit_ns);
+}
+
 static void process_deferred_bios(struct pool *pool)
 {
 	struct bio *bio;
 	struct bio_list bios, bio_completions;
 	struct thin_c *tc;
+	u64 commit_start, commit_ns;
 
 	tc = get_first_thin(pool);
 	while (tc) {
@@ -2389,6 +2444,7 @@ static void process_deferred_bios(struct pool *pool)
 	    !(dm_pool_changed_this_transaction(pool->pmd) && need_commit_due_to_time(pool)))
 		return;
 
+	commit_start = ktime_get_ns();
 	if (commit(pool)) {
 		bio_list_merge(&bios, &bio_completions);
 
@@ -2397,11 +2453,16 @@ static void process_deferred_bios(struct pool *pool)
 		return;
 	}
 	pool->last_commit_jiffies = jiffies;
+	commit_ns = ktime_get_ns() - commit_start;
 
-	while ((bio = bio_list_pop(&bio_completions)))
+	while ((bio = bio_list_pop(&bio_completions))) {
+		account_commit_wait(bio, commit_ns);
 		bio_endio(bio);
+	}
 
 	while ((bio = bio_list_pop(&bios))) {
+		account_commit_wait(bio, commit_ns);
+
 		/*
 		 * The data device was flushed as part of metadata commit,
 		 * so complete redundant flushes immediately.
@@ -4459,6 +4520,55 @@ static void thin_status(struct dm_target *ti, status_type_t type,
 	DMEMIT("Error");
 }
 
+static void emit_latency(const char *name, struct thin_latency *l,
+			 char *result, unsigned int maxlen, ssize_t *sz_ptr)
+{
+	ssize_t sz = *sz_ptr;
+	u64 count = atomic64_read(&l->count);
+
+	DMEMIT("%s%s %llu %llu %llu", sz ? " " : "", name, count,
+	       count ? div64_u64(atomic64_read(&l->total_ns), count) : 0,
+	       (u64)atomic64_read(&l->max_ns));
+
+	*sz_ptr = sz;
+}
+
+/*
+ * Messages supported:
+ *   stats
+ *   clear_stats
+ *
+ * "stats" emits, for provisioning and for flushes waiting on a metadata
+ * commit: <name> <count> <mean ns> <max ns>
+ * "clear_stats" zeroes both sets of counters.
+ */
+static int thin_message(struct dm_target *ti, unsigned int argc, char **argv,
+			char *result, unsigned int maxlen)
+{
+	ssize_t sz = 0;
+	struct thin_c *tc = ti->private;
+
+	if (argc != 1) {
+		DMWARN("Incorrect number of arguments for thin target message");
+		return -EINVAL;
+	}
+
+	if (!strcasecmp(argv[0], "stats")) {
+		emit_latency("provision", &tc->provision_latency, result, maxlen, &sz);
+		emit_latency("commit", &tc->commit_latency, result, maxlen, &sz);
+		return 1;
+	}
+
+	if (!strcasecmp(argv[0], "clear_stats")) {
+		thin_latency_clear(&tc->provision_latency);
+		thin_latency_clear(&tc->commit_latency);
+		return 0;
+	}
+
+	DMWARN("Unrecognised thin target message received: %s", argv[0]);
+	return -EINVAL;
+}
+
 static int thin_iterate_devices(struct dm_target *ti,
 				iterate_devices_callout_fn fn, void *data)
 {
@@ -4495,7 +4605,7 @@ static void thin_io_hints(struct dm_target *ti, struct queue_limits *limits)
 static struct target_type thin_target = {
 	.name = "thin",
 	.features = DM_TARGET_PASSES_CRYPTO,
-	.version = {1, 24, 0},
+	.version = {1, 25, 0},
 	.module	= THIS_MODULE,
 	.ctr = thin_ctr,
 	.dtr = thin_dtr,
@@ -4505,6 +4615,7 @@ static struct target_type thin_target = {
 	.presuspend = thin_presuspend,
 	.postsuspend = thin_postsuspend,
 	.status = thin_status,
+	.message = thin_message,
 	.iterate_devices = thin_iterate_devices,
 	.io_hints = thin_io_hints,
 };
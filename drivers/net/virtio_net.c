@@ -58,6 +58,9 @@ static unsigned int virtio_offload_to_feature(unsigned int obit)
 
 #define VIRTNET_RX_PAD (NET_IP_ALIGN + NET_SKB_PAD)
 
+/* Upper bound for the driver emulated rx-usecs */
+#define VIRTNET_SW_COAL_MAX_USECS	1000
+
 /* Separating two types of XDP xmit */
 #define VIRTIO_XDP_TX		BIT(0)
 #define VIRTIO_XDP_REDIR	BIT(1)
@@ -129,6 +132,8 @@ struct virtnet_rq_stats {
 	u64_stats_t xdp_redirects;
 	u64_stats_t xdp_drops;
 	u64_stats_t kicks;
+	u64_stats_t coal_defers;
+	u64_stats_t coal_idle;
 };
 
 #define VIRTNET_SQ_STAT(name, m) {name, offsetof(struct virtnet_sq_stats, m), -1}
@@ -162,6 +167,8 @@ static const struct virtnet_stat_desc virtnet_rq_stats_desc[] = {
 	VIRTNET_RQ_STAT("xdp_redirects", xdp_redirects),
 	VIRTNET_RQ_STAT("xdp_drops",     xdp_drops),
 	VIRTNET_RQ_STAT("kicks",         kicks),
+	VIRTNET_RQ_STAT("coal_defers",   coal_defers),
+	VIRTNET_RQ_STAT("coal_idle",     coal_idle),
 };
 
 static const struct virtnet_stat_desc virtnet_sq_stats_desc_qstat[] = {
@@ -348,6 +355,14 @@ struct receive_queue {
 
 	u32 packets_in_napi;
 
+	/* Driver side RX coalescing, used when the device cannot moderate
+	 * its own notifications: after a NAPI run that found packets, keep
+	 * callbacks disabled and poll again once sw_coal_usecs have passed.
+	 */
+	u32 sw_coal_usecs;
+	bool sw_coal_deferred;
+	struct hrtimer sw_coal_timer;
+
 	struct virtnet_interrupt_coalesce intr_coal;
 
 	/* Chain pages by the private ptr. */
@@ -2925,6 +2940,8 @@ static void virtnet_napi_disable(struct receive_queue *rq)
 
 	netif_queue_set_napi(vi->dev, qidx, NETDEV_QUEUE_TYPE_RX, NULL);
 	napi_disable(napi);
+	hrtimer_cancel(&rq->sw_coal_timer);
+	rq->sw_coal_deferred = false;
 }
 
 static void refill_work(struct work_struct *work)
@@ -3105,6 +3122,50 @@ static void virtnet_rx_dim_update(struct virtnet_info *vi, struct receive_queue
 	rq->packets_in_napi = 0;
 }
 
+static enum hrtimer_restart virtnet_sw_coal_timer(struct hrtimer *timer)
+{
+	struct receive_queue *rq =
+		container_of(timer, struct receive_queue, sw_coal_timer);
+
+	rq->calls++;
+	virtqueue_napi_schedule(&rq->napi, rq->vq);
+	return HRTIMER_NORESTART;
+}
+
+static bool virtnet_rx_napi_complete(struct receive_queue *rq, int received)
+{
+	u32 usecs = READ_ONCE(rq->sw_coal_usecs);
+	bool deferred = rq->sw_coal_deferred;
+
+	rq->sw_coal_deferred = false;
+
+	/* Go back to interrupts once a deferred poll comes up empty. */
+	if (!usecs || !received) {
+		if (deferred && !received) {
+			u64_stats_update_begin(&rq->stats.syncp);
+			u64_stats_inc(&rq->stats.coal_idle);
+			u64_stats_update_end(&rq->stats.syncp);
+		}
+		return virtqueue_napi_complete(&rq->napi, rq->vq, received);
+	}
+
+	if (!napi_complete_done(&rq->napi, received))
+		return false;
+
+	/* Callbacks stay disabled: whatever the device adds in the next
+	 * usecs is picked up by a single poll instead of one interrupt per
+	 * used ring update.
+	 */
+	rq->sw_coal_deferred = true;
+	hrtimer_start(&rq->sw_coal_timer, us_to_ktime(usecs),
+		      HRTIMER_MODE_REL_PINNED);
+
+	u64_stats_update_begin(&rq->stats.syncp);
+	u64_stats_inc(&rq->stats.coal_defers);
+	u64_stats_update_end(&rq->stats.syncp);
+	return true;
+}
+
 static int virtnet_poll(struct napi_struct *napi, int budget)
 {
 	struct receive_queue *rq =
@@ -3125,7 +3186,7 @@ static int virtnet_poll(struct napi_struct *napi, int budget)
 
 	/* Out of packets? */
 	if (received < budget) {
-		napi_complete = virtqueue_napi_complete(napi, rq->vq, received);
+		napi_complete = virtnet_rx_napi_complete(rq, received);
 		/* Intentionally not taking dim_lock here. This may result in a
 		 * spurious net_dim call. But if that happens virtnet_rx_dim_work
 		 * will not act on the scheduled work.
@@ -3179,9 +3240,24 @@ static int virtnet_enable_queue_pair(struct virtnet_info *vi, int qp_index)
 	return err;
 }
 
+/* Neither global nor per-queue notification coalescing is offered by the
+ * device, so rx-usecs and adaptive-rx are emulated in the driver.
+ */
+static bool virtnet_sw_coal(struct virtnet_info *vi)
+{
+	return !virtio_has_feature(vi->vdev, VIRTIO_NET_F_NOTF_COAL) &&
+	       !virtio_has_feature(vi->vdev, VIRTIO_NET_F_VQ_NOTF_COAL);
+}
+
+static bool virtnet_has_dim(struct virtnet_info *vi)
+{
+	return virtio_has_feature(vi->vdev, VIRTIO_NET_F_VQ_NOTF_COAL) ||
+	       virtnet_sw_coal(vi);
+}
+
 static void virtnet_cancel_dim(struct virtnet_info *vi, struct dim *dim)
 {
-	if (!virtio_has_feature(vi->vdev, VIRTIO_NET_F_VQ_NOTF_COAL))
+	if (!virtnet_has_dim(vi))
 		return;
 	net_dim_work_cancel(dim);
 }
@@ -5374,6 +5450,13 @@ static void virtnet_rx_dim_work(struct work_struct *work)
 		goto out;
 
 	update_moder = net_dim_get_rx_irq_moder(dev, dim);
+	if (virtnet_sw_coal(vi)) {
+		/* Only the time based part of the profile can be emulated. */
+		WRITE_ONCE(rq->sw_coal_usecs,
+			   min_t(u32, update_moder.usec,
+				 VIRTNET_SW_COAL_MAX_USECS));
+		goto out;
+	}
 	if (update_moder.usec != rq->intr_coal.max_usecs ||
 	    update_moder.pkts != rq->intr_coal.max_packets) {
 		err = virtnet_send_rx_ctrl_coal_vq_cmd(vi, qnum,
@@ -5388,6 +5471,37 @@ static void virtnet_rx_dim_work(struct work_struct *work)
 	mutex_unlock(&rq->dim_lock);
 }
 
+static int virtnet_set_sw_coal(struct virtnet_info *vi,
+			       struct ethtool_coalesce *ec, u16 queue)
+{
+	struct receive_queue *rq = &vi->rq[queue];
+
+	mutex_lock(&rq->dim_lock);
+	rq->dim_enabled = !!ec->use_adaptive_rx_coalesce;
+	rq->intr_coal.max_usecs = ec->rx_coalesce_usecs;
+	/* With adaptive-rx on, the DIM work picks the delay. */
+	if (!rq->dim_enabled)
+		WRITE_ONCE(rq->sw_coal_usecs, ec->rx_coalesce_usecs);
+	mutex_unlock(&rq->dim_lock);
+
+	return 0;
+}
+
+static int virtnet_sw_coal_params_supported(struct ethtool_coalesce *ec)
+{
+	if (ec->tx_coalesce_usecs)
+		return -EOPNOTSUPP;
+
+	if (ec->rx_coalesce_usecs > VIRTNET_SW_COAL_MAX_USECS)
+		return -EINVAL;
+
+	if (ec->tx_max_coalesced_frames > 1 ||
+	    ec->rx_max_coalesced_frames != 1)
+		return -EINVAL;
+
+	return 0;
+}
+
 static int virtnet_coal_params_supported(struct ethtool_coalesce *ec)
 {
 	/* usecs coalescing is supported only if VIRTIO_NET_F_NOTF_COAL
@@ -5443,12 +5557,21 @@ static int virtnet_set_coalesce(struct net_device *dev,
 
 	if (virtio_has_feature(vi->vdev, VIRTIO_NET_F_NOTF_COAL))
 		ret = virtnet_send_notf_coal_cmds(vi, ec);
+	else if (virtnet_sw_coal(vi))
+		ret = virtnet_sw_coal_params_supported(ec);
 	else
 		ret = virtnet_coal_params_supported(ec);
 
 	if (ret)
 		return ret;
 
+	if (virtnet_sw_coal(vi)) {
+		vi->rx_dim_enabled = !!ec->use_adaptive_rx_coalesce;
+		vi->intr_coal_rx.max_usecs = ec->rx_coalesce_usecs;
+		for (i = 0; i < vi->max_queue_pairs; i++)
+			virtnet_set_sw_coal(vi, ec, i);
+	}
+
 	if (update_napi) {
 		/* xsk xmit depends on the tx napi. So if xsk is active,
 		 * prevent modifications to tx napi.
@@ -5483,6 +5606,11 @@ static int virtnet_get_coalesce(struct net_device *dev,
 
 		if (vi->sq[0].napi.weight)
 			ec->tx_max_coalesced_frames = 1;
+
+		if (virtnet_sw_coal(vi)) {
+			ec->rx_coalesce_usecs = vi->intr_coal_rx.max_usecs;
+			ec->use_adaptive_rx_coalesce = vi->rx_dim_enabled;
+		}
 	}
 
 	return 0;
@@ -5509,6 +5637,9 @@ static int virtnet_set_per_queue_coalesce(struct net_device *dev,
 
 	if (virtio_has_feature(vi->vdev, VIRTIO_NET_F_VQ_NOTF_COAL))
 		ret = virtnet_send_notf_coal_vq_cmds(vi, ec, queue);
+	else if (virtnet_sw_coal(vi))
+		ret = virtnet_sw_coal_params_supported(ec) ?:
+		      virtnet_set_sw_coal(vi, ec, queue);
 	else
 		ret = virtnet_coal_params_supported(ec);
 
@@ -5543,6 +5674,13 @@ static int virtnet_get_per_queue_coalesce(struct net_device *dev,
 
 		if (vi->sq[queue].napi.weight)
 			ec->tx_max_coalesced_frames = 1;
+
+		if (virtnet_sw_coal(vi)) {
+			mutex_lock(&vi->rq[queue].dim_lock);
+			ec->rx_coalesce_usecs = vi->rq[queue].intr_coal.max_usecs;
+			ec->use_adaptive_rx_coalesce = vi->rq[queue].dim_enabled;
+			mutex_unlock(&vi->rq[queue].dim_lock);
+		}
 	}
 
 	return 0;
@@ -6249,7 +6387,7 @@ static int virtnet_init_irq_moder(struct virtnet_info *vi)
 
 static void virtnet_free_irq_moder(struct virtnet_info *vi)
 {
-	if (!virtio_has_feature(vi->vdev, VIRTIO_NET_F_VQ_NOTF_COAL))
+	if (!virtnet_has_dim(vi))
 		return;
 
 	rtnl_lock();
@@ -6561,6 +6699,8 @@ static int virtnet_alloc_queues(struct virtnet_info *vi)
 		u64_stats_init(&vi->rq[i].stats.syncp);
 		u64_stats_init(&vi->sq[i].stats.syncp);
 		mutex_init(&vi->rq[i].dim_lock);
+		hrtimer_setup(&vi->rq[i].sw_coal_timer, virtnet_sw_coal_timer,
+			      CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED);
 	}
 
 	return 0;
@@ -7013,6 +7153,9 @@ static int virtnet_probe(struct virtio_device *vdev)
 			if (vi->sq[i].napi.weight)
 				vi->sq[i].intr_coal.max_packets = 1;
 
+	}
+
+	if (virtnet_has_dim(vi)) {
 		err = virtnet_init_irq_moder(vi);
 		if (err)
 			goto free;
@@ -11,6 +11,7 @@
 #include <linux/crc32.h>
 #include <linux/nvme-tcp.h>
 #include <linux/nvme-keyring.h>
+#include <linux/sched/clock.h>
 #include <net/sock.h>
 #include <net/tcp.h>
 #include <net/tls.h>
@@ -53,8 +54,28 @@ MODULE_PARM_DESC(tls_handshake_timeout,
 		 "nvme TLS handshake timeout in seconds (default 10)");
 #endif
 
+/*
+ * Command PDUs without inline data that are queued back to back are sent
+ * with a single sendmsg, up to this many at a time.
+ */
+#define NVME_TCP_MAX_CMD_BATCH	16U
+static unsigned int cmd_batch = NVME_TCP_MAX_CMD_BATCH;
+module_param(cmd_batch, uint, 0644);
+MODULE_PARM_DESC(cmd_batch,
+		 "max command PDUs per sendmsg, 0 or 1 to disable (default 16, max 16)");
+
 static atomic_t nvme_tcp_cpu_queues[NR_CPUS];
 
+/*
+ * Time spent in io_work on each cpu, halved for every second that passes.
+ * Updated and read locklessly, it only needs to be roughly right.
+ */
+struct nvme_tcp_cpu_load {
+	u64		busy_ns;
+	unsigned long	stamp;
+};
+static DEFINE_PER_CPU(struct nvme_tcp_cpu_load, nvme_tcp_cpu_load);
+
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 /* lockdep can detect a circular dependency of the form
  *   sk_lock -> mmap_lock (page fault) -> fs locks -> sk_lock
@@ -1239,6 +1260,84 @@ static int nvme_tcp_try_send_cmd_pdu(struct nvme_tcp_request *req)
 	return -EAGAIN;
 }
 
+static inline bool nvme_tcp_can_batch_cmd(struct nvme_tcp_request *req)
+{
+	return req->state == NVME_TCP_SEND_CMD_PDU && !req->offset &&
+		!nvme_tcp_has_inline_data(req);
+}
+
+/*
+ * Send the command PDU of queue->request together with the command PDUs
+ * queued right behind it that don't carry data either. Requests that were
+ * not (fully) sent go back to the front of the send_list, and the first of
+ * them becomes queue->request if it was partially sent. Fully sent requests
+ * may be completed by the RX path at any time, so they are not touched
+ * after the sendmsg.
+ */
+static int nvme_tcp_try_send_cmd_batch(struct nvme_tcp_queue *queue)
+{
+	struct nvme_tcp_request *reqs[NVME_TCP_MAX_CMD_BATCH];
+	struct bio_vec bvecs[NVME_TCP_MAX_CMD_BATCH];
+	struct msghdr msg = { .msg_flags = MSG_DONTWAIT | MSG_SPLICE_PAGES, };
+	size_t len = sizeof(struct nvme_tcp_cmd_pdu) + nvme_tcp_hdgst_len(queue);
+	unsigned int i, nr = 1, max = min(cmd_batch, NVME_TCP_MAX_CMD_BATCH);
+	struct nvme_tcp_request *req;
+	int ret;
+
+	reqs[0] = queue->request;
+	while (nr < max) {
+		req = list_first_entry_or_null(&queue->send_list,
+				struct nvme_tcp_request, entry);
+		if (!req) {
+			nvme_tcp_process_req_list(queue);
+			req = list_first_entry_or_null(&queue->send_list,
+					struct nvme_tcp_request, entry);
+		}
+		if (!req || !nvme_tcp_can_batch_cmd(req))
+			break;
+		list_del_init(&req->entry);
+		init_llist_node(&req->lentry);
+		reqs[nr++] = req;
+	}
+
+	if (nr == 1)
+		return nvme_tcp_try_send_cmd_pdu(reqs[0]);
+
+	for (i = 0; i < nr; i++) {
+		struct nvme_tcp_cmd_pdu *pdu = nvme_tcp_req_cmd_pdu(reqs[i]);
+
+		if (queue->hdr_digest)
+			nvme_tcp_set_hdgst(pdu, sizeof(*pdu));
+		bvec_set_virt(&bvecs[i], pdu, len);
+	}
+
+	if (nvme_tcp_queue_more(queue))
+		msg.msg_flags |= MSG_MORE;
+	else
+		msg.msg_flags |= MSG_EOR;
+
+	iov_iter_bvec(&msg.msg_iter, ITER_SOURCE, bvecs, nr, nr * len);
+	ret = sock_sendmsg(queue->sock, &msg);
+	/* Number of PDUs that made it out entirely */
+	i = ret > 0 ? ret / len : 0;
+
+	/* Put back what wasn't sent, in order */
+	while (nr > i + 1)
+		list_add(&reqs[--nr]->entry, &queue->send_list);
+
+	if (unlikely(ret <= 0))
+		return ret;
+
+	if (i == nr) {
+		nvme_tcp_done_send_req(queue);
+	} else {
+		/* reqs[i] was partially sent, or not at all */
+		queue->request = reqs[i];
+		reqs[i]->offset = ret % len;
+	}
+	return 1;
+}
+
 static int nvme_tcp_try_send_data_pdu(struct nvme_tcp_request *req)
 {
 	struct nvme_tcp_queue *queue = req->queue;
@@ -1320,6 +1419,13 @@ static int nvme_tcp_try_send(struct nvme_tcp_queue *queue)
 	req = queue->request;
 
 	noreclaim_flag = memalloc_noreclaim_save();
+	if (nvme_tcp_can_batch_cmd(req)) {
+		ret = nvme_tcp_try_send_cmd_batch(queue);
+		if (ret <= 0)
+			goto done;
+		goto out;
+	}
+
 	if (req->state == NVME_TCP_SEND_CMD_PDU) {
 		ret = nvme_tcp_try_send_cmd_pdu(req);
 		if (ret <= 0)
@@ -1372,11 +1478,33 @@ static int nvme_tcp_try_recv(struct nvme_tcp_queue *queue)
 	return consumed == -EAGAIN ? 0 : consumed;
 }
 
+static u64 nvme_tcp_cpu_busy(struct nvme_tcp_cpu_load *load, unsigned long now)
+{
+	unsigned long secs = (now - READ_ONCE(load->stamp)) / HZ;
+
+	return secs >= 64 ? 0 : READ_ONCE(load->busy_ns) >> secs;
+}
+
+static void nvme_tcp_account_busy(u64 ns)
+{
+	struct nvme_tcp_cpu_load *load = raw_cpu_ptr(&nvme_tcp_cpu_load);
+	unsigned long now = jiffies;
+	unsigned long secs = (now - load->stamp) / HZ;
+
+	WRITE_ONCE(load->busy_ns, nvme_tcp_cpu_busy(load, now) + ns);
+	/* Keep the fraction of the second that hasn't been decayed yet */
+	if (secs >= 64)
+		WRITE_ONCE(load->stamp, now);
+	else if (secs)
+		WRITE_ONCE(load->stamp, load->stamp + secs * HZ);
+}
+
 static void nvme_tcp_io_work(struct work_struct *w)
 {
 	struct nvme_tcp_queue *queue =
 		container_of(w, struct nvme_tcp_queue, io_work);
 	unsigned long deadline = jiffies + msecs_to_jiffies(1);
+	u64 start = local_clock();
 
 	do {
 		bool pending = false;
@@ -1395,7 +1523,7 @@ static void nvme_tcp_io_work(struct work_struct *w)
 		if (result > 0)
 			pending = true;
 		else if (unlikely(result < 0))
-			return;
+			goto out;
 
 		/* did we get some space after spending time in recv? */
 		if (nvme_tcp_queue_has_pending(queue) &&
@@ -1403,11 +1531,13 @@ static void nvme_tcp_io_work(struct work_struct *w)
 			pending = true;
 
 		if (!pending || !queue->rd_enabled)
-			return;
+			goto out;
 
 	} while (!time_after(jiffies, deadline)); /* quota is exhausted */
 
 	queue_work_on(queue->io_cpu, nvme_tcp_wq, &queue->io_work);
+out:
+	nvme_tcp_account_busy(local_clock() - start);
 }
 
 static void nvme_tcp_free_async_req(struct nvme_tcp_ctrl *ctrl)
@@ -1627,7 +1757,9 @@ static bool nvme_tcp_poll_queue(struct nvme_tcp_queue *queue)
 /*
  * Track the number of queues assigned to each cpu using a global per-cpu
  * counter and select the least used cpu from the mq_map. Our goal is to spread
- * different controllers I/O threads across different cpu cores.
+ * different controllers I/O threads across different cpu cores. Between cpus
+ * with the same number of queues, pick the one that recently spent the least
+ * time in io_work, as queues differ a lot in how busy they are.
  *
  * Note that the accounting is not 100% perfect, but we don't need to be, we're
  * simply putting our best effort to select the best candidate cpu core that we
@@ -1640,6 +1772,8 @@ static void nvme_tcp_set_queue_io_cpu(struct nvme_tcp_queue *queue)
 	int qid = nvme_tcp_queue_id(queue) - 1;
 	unsigned int *mq_map = NULL;
 	int cpu, min_queues = INT_MAX, io_cpu;
+	unsigned long now = jiffies;
+	u64 min_busy = U64_MAX;
 
 	if (wq_unbound)
 		goto out;
@@ -1658,12 +1792,17 @@ static void nvme_tcp_set_queue_io_cpu(struct nvme_tcp_queue *queue)
 	io_cpu = WORK_CPU_UNBOUND;
 	for_each_online_cpu(cpu) {
 		int num_queues = atomic_read(&nvme_tcp_cpu_queues[cpu]);
+		u64 busy;
 
 		if (mq_map[cpu] != qid)
 			continue;
-		if (num_queues < min_queues) {
+		busy = nvme_tcp_cpu_busy(per_cpu_ptr(&nvme_tcp_cpu_load, cpu),
+					 now);
+		if (num_queues < min_queues ||
+		    (num_queues == min_queues && busy < min_busy)) {
 			io_cpu = cpu;
 			min_queues = num_queues;
+			min_busy = busy;
 		}
 	}
 	if (io_cpu != WORK_CPU_UNBOUND) {
@@ -605,6 +605,7 @@ int nvmet_ns_enable(struct nvmet_ns *ns)
 	nvmet_ns_changed(subsys, ns->nsid);
 	ns->enabled = true;
 	xa_set_mark(&subsys->namespaces, ns->nsid, NVMET_NS_ENABLED);
+	nvmet_debugfs_ns_setup(ns);
 	ret = 0;
 out_unlock:
 	mutex_unlock(&subsys->lock);
@@ -631,6 +632,7 @@ void nvmet_ns_disable(struct nvmet_ns *ns)
 
 	ns->enabled = false;
 	xa_clear_mark(&subsys->namespaces, ns->nsid, NVMET_NS_ENABLED);
+	nvmet_debugfs_ns_free(ns);
 
 	list_for_each_entry(ctrl, &subsys->ctrls, subsys_entry)
 		pci_dev_put(radix_tree_delete(&ctrl->p2p_ns_map, ns->nsid));
@@ -680,6 +682,9 @@ void nvmet_ns_free(struct nvmet_ns *ns)
 	up_write(&nvmet_ana_sem);
 
 	kfree(ns->device_path);
+#ifdef CONFIG_NVME_TARGET_DEBUGFS
+	free_percpu(ns->lat);
+#endif
 	kfree(ns);
 }
 
@@ -698,6 +703,12 @@ struct nvmet_ns *nvmet_ns_alloc(struct nvmet_subsys *subsys, u32 nsid)
 
 	init_completion(&ns->disable_done);
 
+#ifdef CONFIG_NVME_TARGET_DEBUGFS
+	ns->lat = alloc_percpu(struct nvmet_ns_lat);
+	if (!ns->lat)
+		goto out_free;
+#endif
+
 	ns->nsid = nsid;
 	ns->subsys = subsys;
 
@@ -723,6 +734,10 @@ struct nvmet_ns *nvmet_ns_alloc(struct nvmet_subsys *subsys, u32 nsid)
 	return ns;
 out_exit:
 	subsys->max_nsid = nvmet_max_nsid(subsys);
+#ifdef CONFIG_NVME_TARGET_DEBUGFS
+out_free:
+	free_percpu(ns->lat);
+#endif
 	kfree(ns);
 out_unlock:
 	mutex_unlock(&subsys->lock);
@@ -771,6 +786,45 @@ static void nvmet_set_error(struct nvmet_req *req, u16 status)
 	req->cqe->status |= cpu_to_le16(1 << 14);
 }
 
+#ifdef CONFIG_NVME_TARGET_DEBUGFS
+static void nvmet_ns_account_latency(struct nvmet_req *req)
+{
+	u64 delta, us;
+	int op, bucket;
+
+	if (!req->start_ns)
+		return;
+
+	switch (req->cmd->common.opcode) {
+	case nvme_cmd_read:
+		op = NVMET_LAT_READ;
+		break;
+	case nvme_cmd_write:
+		op = NVMET_LAT_WRITE;
+		break;
+	default:
+		op = NVMET_LAT_OTHER;
+		break;
+	}
+
+	delta = ktime_get_ns() - req->start_ns;
+	us = div_u64(delta, NSEC_PER_USEC);
+	bucket = us ? min(ilog2(us) + 1, NVMET_LAT_BUCKETS - 1) : 0;
+
+	/* Completions may run in irq context, so use irq safe updates */
+	this_cpu_inc(req->ns->lat->count[op][bucket]);
+	this_cpu_add(req->ns->lat->total_ns[op], delta);
+}
+
+static inline void nvmet_req_start_latency(struct nvmet_req *req)
+{
+	req->start_ns = ktime_get_ns();
+}
+#else
+static inline void nvmet_ns_account_latency(struct nvmet_req *req) {}
+static inline void nvmet_req_start_latency(struct nvmet_req *req) {}
+#endif
+
 static void __nvmet_req_complete(struct nvmet_req *req, u16 status)
 {
 	struct nvmet_ns *ns = req->ns;
@@ -786,6 +840,10 @@ static void __nvmet_req_complete(struct nvmet_req *req, u16 status)
 
 	trace_nvmet_req_complete(req);
 
+	/* req may be reused as soon as the response is queued */
+	if (ns)
+		nvmet_ns_account_latency(req);
+
 	req->ops->queue_response(req);
 
 	if (pc_ref)
@@ -1099,6 +1157,7 @@ static u16 nvmet_parse_io_cmd(struct nvmet_req *req)
 	ret = nvmet_req_find_ns(req);
 	if (unlikely(ret))
 		return ret;
+	nvmet_req_start_latency(req);
 
 	ret = nvmet_check_ana_state(req->port, req->ns);
 	if (unlikely(ret)) {
@@ -1168,6 +1227,9 @@ bool nvmet_req_init(struct nvmet_req *req, struct nvmet_sq *sq,
 	req->error_loc = NVMET_NO_ERROR_LOC;
 	req->error_slba = 0;
 	req->pc_ref = NULL;
+#ifdef CONFIG_NVME_TARGET_DEBUGFS
+	req->start_ns = 0;
+#endif
 
 	/* no support for fused commands yet */
 	if (unlikely(flags & (NVME_CMD_FUSE_FIRST | NVME_CMD_FUSE_SECOND))) {
@@ -9,6 +9,7 @@
 #include <linux/fs.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
+#include <linux/math64.h>
 
 #include "nvmet.h"
 #include "debugfs.h"
@@ -192,6 +193,96 @@ void nvmet_debugfs_ctrl_free(struct nvmet_ctrl *ctrl)
 	debugfs_remove_recursive(ctrl->debugfs_dir);
 }
 
+static int nvmet_ns_latency_show(struct seq_file *m, void *p)
+{
+	static const char *const names[NVMET_LAT_NR] = {
+		[NVMET_LAT_READ]	= "read",
+		[NVMET_LAT_WRITE]	= "write",
+		[NVMET_LAT_OTHER]	= "other",
+	};
+	struct nvmet_ns *ns = m->private;
+	struct nvmet_ns_lat sum = { };
+	int cpu, op, i;
+
+	for_each_possible_cpu(cpu) {
+		struct nvmet_ns_lat *lat = per_cpu_ptr(ns->lat, cpu);
+
+		for (op = 0; op < NVMET_LAT_NR; op++) {
+			for (i = 0; i < NVMET_LAT_BUCKETS; i++)
+				sum.count[op][i] += READ_ONCE(lat->count[op][i]);
+			sum.total_ns[op] += READ_ONCE(lat->total_ns[op]);
+		}
+	}
+
+	seq_printf(m, "%-12s", "usecs");
+	for (op = 0; op < NVMET_LAT_NR; op++)
+		seq_printf(m, " %12s", names[op]);
+	seq_putc(m, '\n');
+
+	for (i = 0; i < NVMET_LAT_BUCKETS; i++) {
+		if (i == NVMET_LAT_BUCKETS - 1)
+			seq_printf(m, ">=%-10llu", 1ULL << (i - 1));
+		else
+			seq_printf(m, "<%-11llu", 1ULL << i);
+		for (op = 0; op < NVMET_LAT_NR; op++)
+			seq_printf(m, " %12llu", sum.count[op][i]);
+		seq_putc(m, '\n');
+	}
+
+	seq_printf(m, "%-12s", "avg_ns");
+	for (op = 0; op < NVMET_LAT_NR; op++) {
+		u64 nr = 0;
+
+		for (i = 0; i < NVMET_LAT_BUCKETS; i++)
+			nr += sum.count[op][i];
+		seq_printf(m, " %12llu",
+			   nr ? div64_u64(sum.total_ns[op], nr) : 0);
+	}
+	seq_putc(m, '\n');
+	return 0;
+}
+
+static ssize_t nvmet_ns_latency_write(struct file *file,
+				      const char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct nvmet_ns *ns = m->private;
+	int cpu;
+
+	/* Any write resets the histogram. */
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(ns->lat, cpu), 0, sizeof(struct nvmet_ns_lat));
+	return count;
+}
+NVMET_DEBUGFS_RW_ATTR(nvmet_ns_latency);
+
+int nvmet_debugfs_ns_setup(struct nvmet_ns *ns)
+{
+	char name[32];
+	struct dentry *parent = ns->subsys->debugfs_dir;
+	int ret;
+
+	if (!parent)
+		return -ENODEV;
+	snprintf(name, sizeof(name), "ns%u", ns->nsid);
+	ns->debugfs_dir = debugfs_create_dir(name, parent);
+	if (IS_ERR(ns->debugfs_dir)) {
+		ret = PTR_ERR(ns->debugfs_dir);
+		ns->debugfs_dir = NULL;
+		return ret;
+	}
+	debugfs_create_file("latency", S_IRUSR | S_IWUSR, ns->debugfs_dir, ns,
+			    &nvmet_ns_latency_fops);
+	return 0;
+}
+
+void nvmet_debugfs_ns_free(struct nvmet_ns *ns)
+{
+	debugfs_remove_recursive(ns->debugfs_dir);
+	ns->debugfs_dir = NULL;
+}
+
 int nvmet_debugfs_subsys_setup(struct nvmet_subsys *subsys)
 {
 	int ret = 0;
@@ -6,6 +6,7 @@
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 #include <linux/scatterlist.h>
 #include <linux/blk-mq.h>
+#include <linux/llist.h>
 #include <linux/nvme.h>
 #include <linux/module.h>
 #include <linux/parser.h>
@@ -22,6 +23,7 @@ struct nvme_loop_iod {
 	struct nvmet_req	req;
 	struct nvme_loop_queue	*queue;
 	struct work_struct	work;
+	struct llist_node	batch_node;
 	struct sg_table		sg_table;
 	struct scatterlist	first_sgl[];
 };
@@ -55,6 +57,10 @@ struct nvme_loop_queue {
 	struct nvmet_sq		nvme_sq;
 	struct nvme_loop_ctrl	*ctrl;
 	unsigned long		flags;
+
+	/* I/O commands queued by ->queue_rq, executed under one plug */
+	struct llist_head	batch;
+	struct work_struct	batch_work;
 };
 
 static LIST_HEAD(nvme_loop_ports);
@@ -130,7 +136,38 @@ static void nvme_loop_execute_work(struct work_struct *work)
 	iod->req.execute(&iod->req);
 }
 
-static blk_status_t nvme_loop_queue_rq(struct blk_mq_hw_ctx *hctx,
+static void nvme_loop_batch_work(struct work_struct *work)
+{
+	struct nvme_loop_queue *queue =
+		container_of(work, struct nvme_loop_queue, batch_work);
+	struct nvme_loop_iod *iod, *next;
+	struct llist_node *list;
+	struct blk_plug plug;
+
+	list = llist_reverse_order(llist_del_all(&queue->batch));
+	if (!list)
+		return;
+
+	/*
+	 * Execute everything blk-mq handed us in one dispatch run under a
+	 * single plug, so that the backend bios of adjacent commands can be
+	 * merged and are issued to the backing device together.
+	 */
+	blk_start_plug(&plug);
+	llist_for_each_entry_safe(iod, next, list, batch_node)
+		iod->req.execute(&iod->req);
+	blk_finish_plug(&plug);
+}
+
+static void nvme_loop_commit_rqs(struct blk_mq_hw_ctx *hctx)
+{
+	struct nvme_loop_queue *queue = hctx->driver_data;
+
+	if (!llist_empty(&queue->batch))
+		queue_work(nvmet_wq, &queue->batch_work);
+}
+
+static blk_status_t __nvme_loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		const struct blk_mq_queue_data *bd)
 {
 	struct nvme_ns *ns = hctx->queue->queuedata;
@@ -167,10 +204,30 @@ static blk_status_t nvme_loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		iod->req.transfer_len = blk_rq_payload_bytes(req);
 	}
 
-	queue_work(nvmet_wq, &iod->work);
+	if (queue == &queue->ctrl->queues[0]) {
+		queue_work(nvmet_wq, &iod->work);
+		return BLK_STS_OK;
+	}
+
+	llist_add(&iod->batch_node, &queue->batch);
 	return BLK_STS_OK;
 }
 
+static blk_status_t nvme_loop_queue_rq(struct blk_mq_hw_ctx *hctx,
+		const struct blk_mq_queue_data *bd)
+{
+	blk_status_t ret = __nvme_loop_queue_rq(hctx, bd);
+
+	/*
+	 * Kick off the batch whatever happened to the last request, blk-mq
+	 * won't call ->commit_rqs if it failed it with BLK_STS_OK, and the
+	 * earlier requests of the run would otherwise stay queued.
+	 */
+	if (bd->last)
+		nvme_loop_commit_rqs(hctx);
+	return ret;
+}
+
 static void nvme_loop_submit_async_event(struct nvme_ctrl *arg)
 {
 	struct nvme_loop_ctrl *ctrl = to_loop_ctrl(arg);
@@ -249,6 +306,7 @@ static int nvme_loop_init_admin_hctx(struct blk_mq_hw_ctx *hctx, void *data,
 
 static const struct blk_mq_ops nvme_loop_mq_ops = {
 	.queue_rq	= nvme_loop_queue_rq,
+	.commit_rqs	= nvme_loop_commit_rqs,
 	.complete	= nvme_loop_complete_rq,
 	.init_request	= nvme_loop_init_request,
 	.init_hctx	= nvme_loop_init_hctx,
@@ -302,6 +360,9 @@ static void nvme_loop_destroy_io_queues(struct nvme_loop_ctrl *ctrl)
 
 	for (i = 1; i < ctrl->ctrl.queue_count; i++) {
 		clear_bit(NVME_LOOP_Q_LIVE, &ctrl->queues[i].flags);
+		/* Batched commands hold sq references, run them first */
+		queue_work(nvmet_wq, &ctrl->queues[i].batch_work);
+		flush_work(&ctrl->queues[i].batch_work);
 		nvmet_sq_destroy(&ctrl->queues[i].nvme_sq);
 		nvmet_cq_put(&ctrl->queues[i].nvme_cq);
 	}
@@ -329,6 +390,8 @@ static int nvme_loop_init_io_queues(struct nvme_loop_ctrl *ctrl)
 
 	for (i = 1; i <= nr_io_queues; i++) {
 		ctrl->queues[i].ctrl = ctrl;
+		init_llist_head(&ctrl->queues[i].batch);
+		INIT_WORK(&ctrl->queues[i].batch_work, nvme_loop_batch_work);
 		nvmet_cq_init(&ctrl->queues[i].nvme_cq);
 		ret = nvmet_sq_init(&ctrl->queues[i].nvme_sq,
 				&ctrl->queues[i].nvme_cq);
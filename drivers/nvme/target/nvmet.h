@@ -97,6 +97,27 @@ struct nvmet_pr_per_ctrl_ref {
 	uuid_t			hostid;
 };
 
+#ifdef CONFIG_NVME_TARGET_DEBUGFS
+/*
+ * Per-namespace completion latency histogram.  Bucket 0 counts commands
+ * that completed in under 1us, bucket n those in [2^(n-1), 2^n) us, and
+ * the last bucket everything slower.
+ */
+#define NVMET_LAT_BUCKETS	24
+
+enum {
+	NVMET_LAT_READ,
+	NVMET_LAT_WRITE,
+	NVMET_LAT_OTHER,
+	NVMET_LAT_NR,
+};
+
+struct nvmet_ns_lat {
+	u64			count[NVMET_LAT_NR][NVMET_LAT_BUCKETS];
+	u64			total_ns[NVMET_LAT_NR];
+};
+#endif
+
 struct nvmet_ns {
 	struct percpu_ref	ref;
 	struct file		*bdev_file;
@@ -128,6 +149,10 @@ struct nvmet_ns {
 	u8			csi;
 	struct nvmet_pr		pr;
 	struct xarray		pr_per_ctrl_refs;
+#ifdef CONFIG_NVME_TARGET_DEBUGFS
+	struct nvmet_ns_lat __percpu *lat;
+	struct dentry		*debugfs_dir;
+#endif
 };
 
 static inline struct nvmet_ns *to_nvmet_ns(struct config_item *item)
@@ -494,6 +519,9 @@ struct nvmet_req {
 	u16			error_loc;
 	u64			error_slba;
 	struct nvmet_pr_per_ctrl_ref *pc_ref;
+#ifdef CONFIG_NVME_TARGET_DEBUGFS
+	u64			start_ns;
+#endif
 };
 
 #define NVMET_MAX_MPOOL_BVEC		16
@@ -19,6 +19,7 @@
 #include <linux/sched/clock.h>
 #include <linux/sched/signal.h>
 #include <linux/vmalloc.h>
+#include <linux/seq_file.h>
 
 #include <linux/net.h>
 #include <linux/if_packet.h>
@@ -131,6 +132,22 @@ struct vhost_net_virtqueue {
 	struct vhost_net_buf rxq;
 	/* Batched XDP buffs */
 	struct xdp_buff *xdp;
+	/* Used entries published since the guest was last signalled */
+	bool used_unsignalled;
+	/* Batching statistics, protected by vq mutex. */
+	struct {
+		u64 packets;
+		/* used ring index updates */
+		u64 used_flushes;
+		/* guest notifications */
+		u64 signals;
+		/* RX: batched consumes from the tun/tap ptr_ring */
+		u64 ring_batches;
+		u64 ring_entries;
+		/* TX: XDP batches handed to tun and their frames */
+		u64 xdp_batches;
+		u64 xdp_frames;
+	} stats;
 };
 
 struct vhost_net {
@@ -183,6 +200,10 @@ static int vhost_net_buf_produce(struct vhost_net_virtqueue *nvq)
 	rxq->head = 0;
 	rxq->tail = ptr_ring_consume_batched(nvq->rx_ring, rxq->queue,
 					      VHOST_NET_BATCH);
+	if (rxq->tail) {
+		nvq->stats.ring_batches++;
+		nvq->stats.ring_entries += rxq->tail;
+	}
 	return rxq->tail;
 }
 
@@ -458,18 +479,33 @@ static int vhost_net_enable_vq(struct vhost_net *n,
 	return vhost_poll_start(poll, sock->file);
 }
 
-static void vhost_net_signal_used(struct vhost_net_virtqueue *nvq,
-				  unsigned int count)
+/* Publish batched heads to the used ring without notifying the guest. */
+static void vhost_net_flush_used(struct vhost_net_virtqueue *nvq,
+				 unsigned int count)
 {
 	struct vhost_virtqueue *vq = &nvq->vq;
-	struct vhost_dev *dev = vq->dev;
 
 	if (!nvq->done_idx)
 		return;
 
-	vhost_add_used_and_signal_n(dev, vq, vq->heads,
-				    vq->nheads, count);
+	vhost_add_used_n(vq, vq->heads, vq->nheads, count);
 	nvq->done_idx = 0;
+	nvq->used_unsignalled = true;
+	nvq->stats.used_flushes++;
+}
+
+static void vhost_net_signal_used(struct vhost_net_virtqueue *nvq,
+				  unsigned int count)
+{
+	struct vhost_virtqueue *vq = &nvq->vq;
+
+	vhost_net_flush_used(nvq, count);
+	if (!nvq->used_unsignalled)
+		return;
+
+	vhost_signal(vq->dev, vq);
+	nvq->used_unsignalled = false;
+	nvq->stats.signals++;
 }
 
 static void vhost_tx_batch(struct vhost_net *net,
@@ -494,6 +530,9 @@ static void vhost_tx_batch(struct vhost_net *net,
 	if (nvq->batched_xdp == 0)
 		goto signal_used;
 
+	nvq->stats.xdp_batches++;
+	nvq->stats.xdp_frames += nvq->batched_xdp;
+
 	msghdr->msg_control = &ctl;
 	msghdr->msg_controllen = sizeof(ctl);
 	err = sock->ops->sendmsg(sock, msghdr, 0);
@@ -847,6 +886,7 @@ static void handle_tx_copy(struct vhost_net *net, struct socket *sock)
 		++nvq->done_idx;
 	} while (likely(!vhost_exceeds_weight(vq, ++sent_pkts, total_len)));
 
+	nvq->stats.packets += sent_pkts;
 	vhost_tx_batch(net, nvq, sock, &msg);
 }
 
@@ -955,6 +995,8 @@ static void handle_tx_zerocopy(struct vhost_net *net, struct socket *sock)
 			vhost_zerocopy_signal_used(net, vq);
 		vhost_net_tx_packet(net);
 	} while (likely(!vhost_exceeds_weight(vq, ++sent_pkts, total_len)));
+
+	nvq->stats.packets += sent_pkts;
 }
 
 /* Expects to be always run from workqueue - which acts as
@@ -1257,14 +1299,19 @@ static void handle_rx(struct vhost_net *net)
 		}
 		nvq->done_idx += headcount;
 		count += in_order ? 1 : headcount;
+		/* Publish the heads so a polling guest can make progress,
+		 * but leave the notification to the end of this run: the
+		 * whole burst then costs the guest a single interrupt.
+		 */
 		if (nvq->done_idx > VHOST_NET_BATCH) {
-			vhost_net_signal_used(nvq, count);
+			vhost_net_flush_used(nvq, count);
 			count = 0;
 		}
 		if (unlikely(vq_log))
 			vhost_log_write(vq, vq_log, log, vhost_len,
 					vq->iov, in);
 		total_len += vhost_len;
+		nvq->stats.packets++;
 	} while (likely(!vhost_exceeds_weight(vq, ++recv_pkts, total_len)));
 
 	if (unlikely(busyloop_intr))
@@ -1358,6 +1405,8 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 		n->vqs[i].vhost_hlen = 0;
 		n->vqs[i].sock_hlen = 0;
 		n->vqs[i].rx_ring = NULL;
+		n->vqs[i].used_unsignalled = false;
+		memset(&n->vqs[i].stats, 0, sizeof(n->vqs[i].stats));
 		vhost_net_buf_init(&n->vqs[i].rxq);
 	}
 	vhost_dev_init(dev, vqs, VHOST_NET_VQ_MAX,
@@ -1844,6 +1893,40 @@ static __poll_t vhost_net_chr_poll(struct file *file, poll_table *wait)
 	return vhost_chr_poll(file, dev, wait);
 }
 
+static void vhost_net_show_fdinfo(struct seq_file *m, struct file *f)
+{
+	static const char *const names[VHOST_NET_VQ_MAX] = {
+		[VHOST_NET_VQ_RX] = "rx",
+		[VHOST_NET_VQ_TX] = "tx",
+	};
+	struct vhost_net *n = f->private_data;
+	int i;
+
+	for (i = 0; i < VHOST_NET_VQ_MAX; i++) {
+		struct vhost_net_virtqueue *nvq = &n->vqs[i];
+
+		mutex_lock(&nvq->vq.mutex);
+		seq_printf(m, "%s_packets:\t%llu\n", names[i],
+			   nvq->stats.packets);
+		seq_printf(m, "%s_used_flushes:\t%llu\n", names[i],
+			   nvq->stats.used_flushes);
+		seq_printf(m, "%s_signals:\t%llu\n", names[i],
+			   nvq->stats.signals);
+		if (i == VHOST_NET_VQ_RX) {
+			seq_printf(m, "rx_ring_batches:\t%llu\n",
+				   nvq->stats.ring_batches);
+			seq_printf(m, "rx_ring_entries:\t%llu\n",
+				   nvq->stats.ring_entries);
+		} else {
+			seq_printf(m, "tx_xdp_batches:\t%llu\n",
+				   nvq->stats.xdp_batches);
+			seq_printf(m, "tx_xdp_frames:\t%llu\n",
+				   nvq->stats.xdp_frames);
+		}
+		mutex_unlock(&nvq->vq.mutex);
+	}
+}
+
 static const struct file_operations vhost_net_fops = {
 	.owner          = THIS_MODULE,
 	.release        = vhost_net_release,
@@ -1854,6 +1937,7 @@ static const struct file_operations vhost_net_fops = {
 	.compat_ioctl   = compat_ptr_ioctl,
 	.open           = vhost_net_open,
 	.llseek		= noop_llseek,
+	.show_fdinfo	= vhost_net_show_fdinfo,
 };
 
 static struct miscdevice vhost_net_misc = {
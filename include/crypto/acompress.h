@@ -106,6 +106,8 @@ struct acomp_req {
  *
  * @compress:		Function performs a compress operation
  * @decompress:		Function performs a de-compress operation
+ * @setdict:		Optional function loading a pre-trained dictionary,
+ *			installed by the algorithm's init function
  * @reqsize:		Context size for (de)compression requests
  * @fb:			Synchronous fallback tfm
  * @base:		Common crypto API algorithm data structure
@@ -113,6 +115,8 @@ struct acomp_req {
 struct crypto_acomp {
 	int (*compress)(struct acomp_req *req);
 	int (*decompress)(struct acomp_req *req);
+	int (*setdict)(struct crypto_acomp *tfm, const void *dict,
+		       unsigned int len);
 	unsigned int reqsize;
 	struct crypto_tfm base;
 };
@@ -239,6 +243,31 @@ static inline const char *crypto_acomp_driver_name(struct crypto_acomp *tfm)
 	return crypto_tfm_alg_driver_name(crypto_acomp_tfm(tfm));
 }
 
+/**
+ * crypto_acomp_setdict() -- load a pre-trained dictionary
+ *
+ * @tfm:	ACOMPRESS tfm handle allocated with crypto_alloc_acomp()
+ * @dict:	dictionary contents, in the algorithm's own format
+ * @len:	size of @dict in bytes
+ *
+ * All subsequent compress and decompress operations on @tfm use @dict, so
+ * data compressed with a dictionary can only be decompressed by a tfm that
+ * has loaded the same one.  The dictionary is copied; passing a zero @len
+ * drops it again.  Like setkey, this must not be called concurrently with
+ * requests on @tfm.
+ *
+ * Return:	zero on success; -EOPNOTSUPP if the algorithm has no
+ *		dictionary support, another error code otherwise
+ */
+static inline int crypto_acomp_setdict(struct crypto_acomp *tfm,
+				       const void *dict, unsigned int len)
+{
+	if (!tfm->setdict)
+		return -EOPNOTSUPP;
+
+	return tfm->setdict(tfm, dict, len);
+}
+
 /**
  * acomp_request_alloc() -- allocates asynchronous (de)compression request
  *
@@ -542,6 +571,39 @@ int crypto_acomp_compress(struct acomp_req *req);
  */
 int crypto_acomp_decompress(struct acomp_req *req);
 
+/**
+ * crypto_acomp_compress_batch() -- Invoke compress on a batch of requests
+ *
+ * Submits each request of @reqs, which must all belong to the same tfm, and
+ * stores its return value in the matching slot of @errors.  Requests that
+ * an asynchronous implementation queued report -EINPROGRESS or -EBUSY there
+ * and complete through their own callback.
+ *
+ * @reqs:	array of asynchronous compress requests
+ * @errors:	array receiving the per-request return codes
+ * @nr_reqs:	number of entries in @reqs and @errors
+ *
+ * Return:	zero if every request completed or was queued; otherwise the
+ *		first error code found in @errors
+ */
+int crypto_acomp_compress_batch(struct acomp_req *reqs[], int errors[],
+				unsigned int nr_reqs);
+
+/**
+ * crypto_acomp_decompress_batch() -- Invoke decompress on a batch of requests
+ *
+ * The decompression counterpart of crypto_acomp_compress_batch().
+ *
+ * @reqs:	array of asynchronous compress requests
+ * @errors:	array receiving the per-request return codes
+ * @nr_reqs:	number of entries in @reqs and @errors
+ *
+ * Return:	zero if every request completed or was queued; otherwise the
+ *		first error code found in @errors
+ */
+int crypto_acomp_decompress_batch(struct acomp_req *reqs[], int errors[],
+				  unsigned int nr_reqs);
+
 static inline struct acomp_req *acomp_request_on_stack_init(
 	char *buf, struct crypto_acomp *tfm)
 {
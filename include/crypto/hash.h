@@ -177,6 +177,9 @@ struct shash_desc {
 
 #define HASH_MAX_DIGESTSIZE	 64
 
+/* Maximum number of messages an algorithm's ->finup_mb may hash at once. */
+#define HASH_MAX_MB_MSGS	8
+
 /*
  * The size of a core hash state and a partial block.  The final byte
  * is the length of the partial block.
@@ -227,6 +230,11 @@ struct shash_desc {
  * @import: see struct ahash_alg
  * @export_core: see struct ahash_alg
  * @import_core: see struct ahash_alg
+ * @finup_mb: Finish hashing @num_msgs independent messages of equal length,
+ *	      all starting from the state in @desc, and write each digest to
+ *	      the corresponding entry of @outs.  Implementations interleave the
+ *	      messages (e.g. across SIMD lanes) and must not modify @desc.
+ *	      Only called with 2 <= @num_msgs <= @mb_max_msgs.  Optional.
  * @setkey: see struct ahash_alg
  * @init_tfm: Initialize the cryptographic transformation object.
  *	      This function is called only once at the instantiation
@@ -240,6 +248,8 @@ struct shash_desc {
  *	      This is a counterpart to @init_tfm, used to remove
  *	      various changes set in @init_tfm.
  * @clone_tfm: Copy transform into new object, may allocate memory.
+ * @mb_max_msgs: Maximum number of messages @finup_mb can hash at once, up to
+ *		 HASH_MAX_MB_MSGS.  Set to 1 if @finup_mb is not provided.
  * @descsize: Size of the operational state for the message digest. This state
  * 	      size is the memory size that needs to be allocated for
  *	      shash_desc.__ctx
@@ -259,12 +269,16 @@ struct shash_alg {
 	int (*import)(struct shash_desc *desc, const void *in);
 	int (*export_core)(struct shash_desc *desc, void *out);
 	int (*import_core)(struct shash_desc *desc, const void *in);
+	int (*finup_mb)(struct shash_desc *desc, const u8 * const data[],
+			unsigned int len, u8 * const outs[],
+			unsigned int num_msgs);
 	int (*setkey)(struct crypto_shash *tfm, const u8 *key,
 		      unsigned int keylen);
 	int (*init_tfm)(struct crypto_shash *tfm);
 	void (*exit_tfm)(struct crypto_shash *tfm);
 	int (*clone_tfm)(struct crypto_shash *dst, struct crypto_shash *src);
 
+	unsigned int mb_max_msgs;
 	unsigned int descsize;
 
 	union {
@@ -872,6 +886,19 @@ static inline void *shash_desc_ctx(struct shash_desc *desc)
 	return desc->__ctx;
 }
 
+/**
+ * crypto_shash_mb_max_msgs() - obtain the number of messages hashed in parallel
+ * @tfm: cipher handle
+ *
+ * Return: the number of messages the algorithm can hash at once in an
+ *	   interleaved fashion.  Callers of crypto_shash_finup_mb() should batch
+ *	   up to this many messages; 1 means there is no benefit in batching.
+ */
+static inline unsigned int crypto_shash_mb_max_msgs(struct crypto_shash *tfm)
+{
+	return crypto_shash_alg(tfm)->mb_max_msgs;
+}
+
 /**
  * crypto_shash_setkey() - set key for message digest
  * @tfm: cipher handle
@@ -988,6 +1015,29 @@ int crypto_shash_init(struct shash_desc *desc);
 int crypto_shash_finup(struct shash_desc *desc, const u8 *data,
 		       unsigned int len, u8 *out);
 
+/**
+ * crypto_shash_finup_mb() - finish hashing several messages at once
+ * @desc: operational state handle holding the state common to all messages,
+ *	  e.g. after crypto_shash_init() and an optional salt update
+ * @data: the remaining data of each message
+ * @len: length of each entry of @data; all messages must have the same length
+ * @outs: output buffers, one per message, each of digest size
+ * @num_msgs: number of messages
+ *
+ * This is equivalent to duplicating @desc @num_msgs times and calling
+ * crypto_shash_finup() on each copy, but algorithms that support it hash the
+ * messages interleaved, which is considerably faster on CPUs that can make use
+ * of it.  Any number of messages is accepted; they are split into groups of
+ * crypto_shash_mb_max_msgs() internally.
+ *
+ * Context: Softirq or process context.
+ * Return: 0 if the message digest creation was successful; < 0 if an error
+ *	   occurred
+ */
+int crypto_shash_finup_mb(struct shash_desc *desc, const u8 * const data[],
+			  unsigned int len, u8 * const outs[],
+			  unsigned int num_msgs);
+
 /**
  * crypto_shash_update() - add data to message digest for processing
  * @desc: operational state handle that is already initialized
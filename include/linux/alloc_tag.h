@@ -20,6 +20,24 @@ struct alloc_tag_counters {
 	u64 calls;
 };
 
+#ifdef CONFIG_MEM_ALLOC_PROFILING_SAMPLING
+/* Latency buckets: <256ns, then one per power of 4, the last one is >=1ms */
+#define ALLOC_TAG_LAT_BUCKETS	8
+
+/*
+ * Statistics for the allocations picked by sampling. Only one allocation
+ * per sample interval is recorded, so these are shared rather than per-cpu.
+ */
+struct alloc_tag_samples {
+	atomic_long_t	nr;		/* sampled allocations */
+	atomic_long_t	bytes;		/* bytes in sampled allocations */
+	atomic_long_t	remote;		/* samples served by a remote node */
+	atomic64_t	ns;		/* total latency of sampled allocations */
+	atomic_t	lat[ALLOC_TAG_LAT_BUCKETS];
+	int		nid;		/* node that served the last sample */
+};
+#endif
+
 /*
  * An instance of this structure is created in a special ELF section at every
  * allocation callsite. At runtime, the special section is treated as
@@ -28,6 +46,9 @@ struct alloc_tag_counters {
 struct alloc_tag {
 	struct codetag			ct;
 	struct alloc_tag_counters __percpu	*counters;
+#ifdef CONFIG_MEM_ALLOC_PROFILING_SAMPLING
+	struct alloc_tag_samples	samples;
+#endif
 } __aligned(8);
 
 struct alloc_tag_kernel_section {
@@ -194,10 +215,70 @@ static inline bool alloc_tag_ref_set(union codetag_ref *ref, struct alloc_tag *t
 	return true;
 }
 
+#ifdef CONFIG_MEM_ALLOC_PROFILING_SAMPLING
+struct page;
+
+DECLARE_STATIC_KEY_FALSE(mem_alloc_sampling_key);
+DECLARE_PER_CPU(long, alloc_tag_sample_budget);
+
+bool __alloc_tag_sample_begin(void);
+void __alloc_tag_sample_end(void);
+void __alloc_tag_sample(struct alloc_tag *tag, size_t bytes, struct page *page);
+
+/* Charge allocated bytes against this cpu's sample interval */
+static inline void alloc_tag_sample_account(size_t bytes)
+{
+	if (static_branch_unlikely(&mem_alloc_sampling_key))
+		this_cpu_sub(alloc_tag_sample_budget, bytes);
+}
+
+/*
+ * Called by the allocation hooks right before allocating. Returns true if
+ * the interval on this cpu has run out and the allocation is being timed.
+ * Interrupt context allocations are never sampled because the start time
+ * is kept in the interrupted task.
+ */
+static inline bool alloc_tag_sample_begin(void)
+{
+	if (!static_branch_unlikely(&mem_alloc_sampling_key))
+		return false;
+	if (likely(raw_cpu_read(alloc_tag_sample_budget) > 0) || !in_task())
+		return false;
+
+	return __alloc_tag_sample_begin();
+}
+
+static inline void alloc_tag_sample_end(bool sampled)
+{
+	if (unlikely(sampled))
+		__alloc_tag_sample_end();
+}
+
+/*
+ * Record the latency and node of a timed allocation. Called by the
+ * accounting hooks with the page or the slab page the allocation came from;
+ * its node is only looked up if the allocation is actually being timed.
+ */
+static inline void alloc_tag_sample(struct alloc_tag *tag, size_t bytes,
+				    struct page *page)
+{
+	if (static_branch_unlikely(&mem_alloc_sampling_key) && tag)
+		__alloc_tag_sample(tag, bytes, page);
+}
+#else
+static inline void alloc_tag_sample_account(size_t bytes) {}
+static inline bool alloc_tag_sample_begin(void) { return false; }
+static inline void alloc_tag_sample_end(bool sampled) {}
+static inline void alloc_tag_sample(struct alloc_tag *tag, size_t bytes,
+				    struct page *page) {}
+#endif
+
 static inline void alloc_tag_add(union codetag_ref *ref, struct alloc_tag *tag, size_t bytes)
 {
-	if (likely(alloc_tag_ref_set(ref, tag)))
+	if (likely(alloc_tag_ref_set(ref, tag))) {
 		this_cpu_add(tag->counters->bytes, bytes);
+		alloc_tag_sample_account(bytes);
+	}
 }
 
 static inline void alloc_tag_sub(union codetag_ref *ref, size_t bytes)
@@ -242,6 +323,10 @@ static inline void alloc_tag_add(union codetag_ref *ref, struct alloc_tag *tag,
 static inline void alloc_tag_sub(union codetag_ref *ref, size_t bytes) {}
 static inline void alloc_tag_set_inaccurate(struct alloc_tag *tag) {}
 static inline bool alloc_tag_is_inaccurate(struct alloc_tag *tag) { return false; }
+static inline bool alloc_tag_sample_begin(void) { return false; }
+static inline void alloc_tag_sample_end(bool sampled) {}
+static inline void alloc_tag_sample(struct alloc_tag *tag, size_t bytes,
+				    struct page *page) {}
 #define alloc_tag_record(p)	do {} while (0)
 
 #endif /* CONFIG_MEM_ALLOC_PROFILING */
@@ -251,8 +336,11 @@ static inline bool alloc_tag_is_inaccurate(struct alloc_tag *tag) { return false
 	typeof(_do_alloc) _res;						\
 	if (mem_alloc_profiling_enabled()) {				\
 		struct alloc_tag * __maybe_unused _old;			\
+		bool _sampled;						\
 		_old = alloc_tag_save(_tag);				\
+		_sampled = alloc_tag_sample_begin();			\
 		_res = _do_alloc;					\
+		alloc_tag_sample_end(_sampled);				\
 		alloc_tag_restore(_tag, _old);				\
 	} else								\
 		_res = _do_alloc;					\
@@ -348,6 +348,26 @@ void *mtree_erase(struct maple_tree *mt, unsigned long index);
 int mtree_dup(struct maple_tree *mt, struct maple_tree *new, gfp_t gfp);
 int __mt_dup(struct maple_tree *mt, struct maple_tree *new, gfp_t gfp);
 
+/**
+ * struct maple_bulk_entry - A range for the bulk interfaces.
+ * @index: The first index of the range
+ * @last: The last index of the range (inclusive)
+ * @entry: The entry to store, must not be NULL
+ */
+struct maple_bulk_entry {
+	unsigned long index;
+	unsigned long last;
+	void *entry;
+};
+
+int mtree_bulk_load(struct maple_tree *mt, const struct maple_bulk_entry *ents,
+		unsigned long nr, gfp_t gfp);
+int __mt_bulk_load(struct maple_tree *mt, const struct maple_bulk_entry *ents,
+		unsigned long nr, gfp_t gfp);
+int mtree_store_ranges(struct maple_tree *mt, unsigned long first,
+		unsigned long last, const struct maple_bulk_entry *ents,
+		unsigned long nr, gfp_t gfp);
+
 void mtree_destroy(struct maple_tree *mt);
 void __mt_destroy(struct maple_tree *mt);
 
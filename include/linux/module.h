@@ -444,6 +444,9 @@ struct module {
 	const u32 *gpl_crcs;
 	bool using_gplonly_symbols;
 
+	/* Lookup hash nodes for all exported symbols above. */
+	struct module_ksym *ksyms;
+
 #ifdef CONFIG_MODULE_SIG
 	/* Signature was verified. */
 	bool sig_ok;
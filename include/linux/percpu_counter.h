@@ -283,4 +283,84 @@ percpu_counter_sub_local(struct percpu_counter *fbc, s64 amount)
 	percpu_counter_add_local(fbc, -amount);
 }
 
+/*
+ * A percpu_counter with a per-node layer between the per-cpu deltas and
+ * the global count. Per-cpu deltas that exceed the batch are folded into a
+ * per-node count first, and only reach the global count once the node as a
+ * whole exceeds the batch times its number of cpus. This takes the counter
+ * lock off the update path of hot counters on large multi-node machines,
+ * at the price of a per-node walk in percpu_counter_numa_read(). On
+ * single-node systems it behaves like a plain percpu_counter.
+ */
+struct percpu_counter_node;
+
+struct percpu_counter_numa {
+	struct percpu_counter fbc;
+#if defined(CONFIG_SMP) && defined(CONFIG_NUMA)
+	struct percpu_counter_node **nodes;
+#endif
+};
+
+#if defined(CONFIG_SMP) && defined(CONFIG_NUMA)
+int __percpu_counter_numa_init(struct percpu_counter_numa *pcn, s64 amount,
+			       gfp_t gfp, struct lock_class_key *key);
+
+#define percpu_counter_numa_init(pcn, value, gfp)			\
+	({								\
+		static struct lock_class_key __key;			\
+									\
+		__percpu_counter_numa_init(pcn, value, gfp, &__key);	\
+	})
+
+void percpu_counter_numa_destroy(struct percpu_counter_numa *pcn);
+void percpu_counter_numa_add_batch(struct percpu_counter_numa *pcn,
+				   s64 amount, s32 batch);
+s64 __percpu_counter_numa_read(struct percpu_counter_numa *pcn);
+s64 percpu_counter_numa_sum(struct percpu_counter_numa *pcn);
+
+static inline void
+percpu_counter_numa_add(struct percpu_counter_numa *pcn, s64 amount)
+{
+	percpu_counter_numa_add_batch(pcn, amount, percpu_counter_batch);
+}
+
+static inline s64 percpu_counter_numa_read(struct percpu_counter_numa *pcn)
+{
+	if (pcn->nodes)
+		return __percpu_counter_numa_read(pcn);
+	return percpu_counter_read(&pcn->fbc);
+}
+#else
+#define percpu_counter_numa_init(pcn, value, gfp)			\
+	percpu_counter_init(&(pcn)->fbc, value, gfp)
+
+static inline void percpu_counter_numa_destroy(struct percpu_counter_numa *pcn)
+{
+	percpu_counter_destroy(&pcn->fbc);
+}
+
+static inline void
+percpu_counter_numa_add_batch(struct percpu_counter_numa *pcn, s64 amount,
+			      s32 batch)
+{
+	percpu_counter_add_batch(&pcn->fbc, amount, batch);
+}
+
+static inline void
+percpu_counter_numa_add(struct percpu_counter_numa *pcn, s64 amount)
+{
+	percpu_counter_add(&pcn->fbc, amount);
+}
+
+static inline s64 percpu_counter_numa_read(struct percpu_counter_numa *pcn)
+{
+	return percpu_counter_read(&pcn->fbc);
+}
+
+static inline s64 percpu_counter_numa_sum(struct percpu_counter_numa *pcn)
+{
+	return percpu_counter_sum(&pcn->fbc);
+}
+#endif
+
 #endif /* _LINUX_PERCPU_COUNTER_H */
@@ -1175,6 +1175,8 @@ struct perf_cgroup_info {
 	u64				timestamp;
 	u64				timeoffset;
 	int				active;
+	/* enabled events of this cgroup on this CPU */
+	int				nr_events;
 };
 
 struct perf_cgroup {
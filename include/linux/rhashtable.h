@@ -25,6 +25,7 @@
 #include <linux/workqueue.h>
 #include <linux/rculist.h>
 #include <linux/bit_spinlock.h>
+#include <linux/tracepoint-defs.h>
 
 #include <linux/rhashtable-types.h>
 /*
@@ -65,11 +66,16 @@ struct rhash_lock_head {};
  * struct bucket_table - Table of hash buckets
  * @size: Number of hash buckets
  * @nest: Number of bits of first-level nested table.
- * @rehash: Current bucket being rehashed
  * @hash_rnd: Random seed to fold into hash
  * @walkers: List of active walkers
  * @rcu: RCU structure for freeing the table
  * @future_tbl: Table under construction during rehashing
+ * @rehash_next: Next bucket to be claimed for rehashing
+ * @rehash_done: Number of claimed buckets whose rehashing has finished
+ * @rehash_helped: Number of buckets rehashed by inserters
+ * @rehash_failed: Some bucket could not be rehashed and needs another pass
+ * @rehash_start: Time at which @future_tbl was attached
+ * @double_probes: Lookups that also had to search @future_tbl
  * @ntbl: Nested table used when out of memory.
  * @buckets: size * hash buckets
  */
@@ -82,6 +88,13 @@ struct bucket_table {
 
 	struct bucket_table __rcu *future_tbl;
 
+	atomic_t		rehash_next;
+	atomic_t		rehash_done;
+	atomic_t		rehash_helped;
+	bool			rehash_failed;
+	u64			rehash_start;
+	atomic_long_t		double_probes;
+
 	struct lockdep_map	dep_map;
 
 	struct rhash_lock_head __rcu *buckets[] ____cacheline_aligned_in_smp;
@@ -598,6 +611,15 @@ static inline void rht_assign_unlock(struct bucket_table *tbl,
 	for (pos = list; pos && rht_entry(tpos, pos, member);		\
 	     pos = rcu_dereference_all(pos->next))
 
+DECLARE_TRACEPOINT(rhashtable_rehash);
+
+/* Only pay for the shared counter while resizes are being traced. */
+static inline void rht_note_double_probe(struct bucket_table *tbl)
+{
+	if (tracepoint_enabled(rhashtable_rehash))
+		atomic_long_inc(&tbl->double_probes);
+}
+
 static inline int rhashtable_compare(struct rhashtable_compare_arg *arg,
 				     const void *obj)
 {
@@ -618,7 +640,7 @@ static __always_inline struct rhash_head *__rhashtable_lookup(
 		.key = key,
 	};
 	struct rhash_lock_head __rcu *const *bkt;
-	struct bucket_table *tbl;
+	struct bucket_table *tbl, *future_tbl;
 	struct rhash_head *he;
 	unsigned int hash;
 
@@ -643,9 +665,12 @@ static __always_inline struct rhash_head *__rhashtable_lookup(
 	/* Ensure we see any new tables. */
 	smp_rmb();
 
-	tbl = rht_dereference_rcu(tbl->future_tbl, ht);
-	if (unlikely(tbl))
+	future_tbl = rht_dereference_rcu(tbl->future_tbl, ht);
+	if (unlikely(future_tbl)) {
+		rht_note_double_probe(tbl);
+		tbl = future_tbl;
 		goto restart;
+	}
 
 	return NULL;
 }
@@ -12,6 +12,7 @@
 #include <linux/atomic.h>
 #include <linux/bitops.h>
 #include <linux/cache.h>
+#include <linux/jump_label.h>
 #include <linux/list.h>
 #include <linux/log2.h>
 #include <linux/minmax.h>
@@ -43,6 +44,50 @@ struct sbitmap_word {
 	raw_spinlock_t swap_lock;
 } ____cacheline_aligned_in_smp;
 
+/**
+ * struct sbitmap_node - Words of a NUMA-aware &struct sbitmap owned by one
+ * node, allocated on that node.
+ */
+struct sbitmap_node {
+	/**
+	 * @hint: Last bit freed by a CPU of this node, used as the allocation
+	 * hint by CPUs whose own hint points at another node's words.
+	 */
+	unsigned int hint;
+
+	/**
+	 * @map: The words owned by this node.
+	 */
+	struct sbitmap_word map[];
+};
+
+/**
+ * struct sbitmap_numa - Layout of a &struct sbitmap set up by
+ * sbitmap_init_numa().
+ */
+struct sbitmap_numa {
+	/**
+	 * @node_shift: log2(number of words owned by each node).
+	 */
+	unsigned int node_shift;
+
+	/**
+	 * @nr_nodes: Number of entries in @nodes.
+	 */
+	unsigned int nr_nodes;
+
+	/**
+	 * @node_slot: Index into @nodes of the words owned by each NUMA node.
+	 */
+	unsigned short *node_slot;
+
+	/**
+	 * @nodes: Per-node word arrays.  Word i is word
+	 * (i & ((1 << @node_shift) - 1)) of @nodes[i >> @node_shift].
+	 */
+	struct sbitmap_node *nodes[];
+};
+
 /**
  * struct sbitmap - Scalable bitmap.
  *
@@ -71,10 +116,17 @@ struct sbitmap {
 	bool round_robin;
 
 	/**
-	 * @map: Allocated bitmap.
+	 * @map: Allocated bitmap, %NULL if @numa is used.
 	 */
 	struct sbitmap_word *map;
 
+#ifdef CONFIG_NUMA
+	/**
+	 * @numa: Per-node words set up by sbitmap_init_numa(), or %NULL.
+	 */
+	struct sbitmap_numa *numa;
+#endif
+
 	/*
 	 * @alloc_hint: Cache of last successfully allocated or freed bit.
 	 *
@@ -170,6 +222,65 @@ struct sbitmap_queue {
 int sbitmap_init_node(struct sbitmap *sb, unsigned int depth, int shift,
 		      gfp_t flags, int node, bool round_robin, bool alloc_hint);
 
+/**
+ * sbitmap_init_numa() - Initialize a &struct sbitmap spread over NUMA nodes.
+ * @sb: Bitmap to initialize.
+ * @depth: Number of bits to allocate.
+ * @shift: See sbitmap_init_node().
+ * @flags: Allocation flags.
+ * @round_robin: See sbitmap_init_node().
+ * @alloc_hint: See sbitmap_init_node().
+ *
+ * The words are split into contiguous ranges, one per node with CPUs, and each
+ * range is allocated on its node.  Allocations start in the range of the
+ * allocating CPU's node and only fall back to other nodes' words once that
+ * range is exhausted, and a freed bit only becomes the hint of CPUs on the
+ * node owning it.  This keeps tag allocation and freeing on node-local
+ * cachelines when a bitmap is shared by CPUs on several nodes.
+ *
+ * On machines with a single node this is equivalent to sbitmap_init_node().
+ * Otherwise the first call enables the NUMA lookups for all bitmaps, so it
+ * must be made from a context that can sleep.
+ *
+ * Return: Zero on success or negative errno on failure.
+ */
+int sbitmap_init_numa(struct sbitmap *sb, unsigned int depth, int shift,
+		      gfp_t flags, bool round_robin, bool alloc_hint);
+
+void __sbitmap_free_numa(struct sbitmap *sb);
+
+#ifdef CONFIG_NUMA
+DECLARE_STATIC_KEY_FALSE(sbitmap_numa_key);
+
+/*
+ * sbitmap internal helper.  The key is only enabled once a NUMA-aware map
+ * has been set up, so other maps don't pay for the check until then.
+ */
+static inline struct sbitmap_numa *__sbitmap_numa(const struct sbitmap *sb)
+{
+	if (static_branch_unlikely(&sbitmap_numa_key))
+		return sb->numa;
+	return NULL;
+}
+#else
+static inline struct sbitmap_numa *__sbitmap_numa(const struct sbitmap *sb)
+{
+	return NULL;
+}
+#endif
+
+/* sbitmap internal helper */
+static inline struct sbitmap_word *__sbitmap_map(const struct sbitmap *sb,
+						 unsigned int index)
+{
+	struct sbitmap_numa *numa = __sbitmap_numa(sb);
+
+	if (unlikely(numa))
+		return &numa->nodes[index >> numa->node_shift]->map[index &
+				((1U << numa->node_shift) - 1)];
+	return &sb->map[index];
+}
+
 /* sbitmap internal helper */
 static inline unsigned int __map_depth(const struct sbitmap *sb, int index)
 {
@@ -185,6 +296,8 @@ static inline unsigned int __map_depth(const struct sbitmap *sb, int index)
 static inline void sbitmap_free(struct sbitmap *sb)
 {
 	free_percpu(sb->alloc_hint);
+	if (__sbitmap_numa(sb))
+		__sbitmap_free_numa(sb);
 	kvfree(sb->map);
 	sb->map = NULL;
 }
@@ -246,13 +359,14 @@ static inline void __sbitmap_for_each_set(struct sbitmap *sb,
 	nr = SB_NR_TO_BIT(sb, start);
 
 	while (scanned < sb->depth) {
+		struct sbitmap_word *map = __sbitmap_map(sb, index);
 		unsigned long word;
 		unsigned int depth = min_t(unsigned int,
 					   __map_depth(sb, index) - nr,
 					   sb->depth - scanned);
 
 		scanned += depth;
-		word = sb->map[index].word & ~sb->map[index].cleared;
+		word = map->word & ~map->cleared;
 		if (!word)
 			goto next;
 
@@ -293,7 +407,7 @@ static inline void sbitmap_for_each_set(struct sbitmap *sb, sb_for_each_fn fn,
 static inline unsigned long *__sbitmap_word(struct sbitmap *sb,
 					    unsigned int bitnr)
 {
-	return &sb->map[SB_NR_TO_INDEX(sb, bitnr)].word;
+	return &__sbitmap_map(sb, SB_NR_TO_INDEX(sb, bitnr))->word;
 }
 
 /* Helpers equivalent to the operations in asm/bitops.h and linux/bitmap.h */
@@ -316,9 +430,9 @@ static inline void sbitmap_clear_bit(struct sbitmap *sb, unsigned int bitnr)
  */
 static inline void sbitmap_deferred_clear_bit(struct sbitmap *sb, unsigned int bitnr)
 {
-	unsigned long *addr = &sb->map[SB_NR_TO_INDEX(sb, bitnr)].cleared;
+	struct sbitmap_word *map = __sbitmap_map(sb, SB_NR_TO_INDEX(sb, bitnr));
 
-	set_bit(SB_NR_TO_BIT(sb, bitnr), addr);
+	set_bit(SB_NR_TO_BIT(sb, bitnr), &map->cleared);
 }
 
 /*
@@ -401,6 +515,20 @@ void sbitmap_bitmap_show(struct sbitmap *sb, struct seq_file *m);
 int sbitmap_queue_init_node(struct sbitmap_queue *sbq, unsigned int depth,
 			    int shift, bool round_robin, gfp_t flags, int node);
 
+/**
+ * sbitmap_queue_init_numa() - Initialize a &struct sbitmap_queue whose words
+ * are spread over NUMA nodes.
+ * @sbq: Bitmap queue to initialize.
+ * @depth: See sbitmap_init_numa().
+ * @shift: See sbitmap_init_numa().
+ * @round_robin: See sbitmap_get().
+ * @flags: Allocation flags.
+ *
+ * Return: Zero on success or negative errno on failure.
+ */
+int sbitmap_queue_init_numa(struct sbitmap_queue *sbq, unsigned int depth,
+			    int shift, bool round_robin, gfp_t flags);
+
 /**
  * sbitmap_queue_free() - Free memory used by a &struct sbitmap_queue.
  *
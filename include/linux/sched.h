@@ -843,6 +843,10 @@ struct task_struct {
 
 #ifdef CONFIG_MEM_ALLOC_PROFILING
 	struct alloc_tag		*alloc_tag;
+#ifdef CONFIG_MEM_ALLOC_PROFILING_SAMPLING
+	/* local_clock() when a sampled allocation started, 0 otherwise */
+	u64				alloc_sample_start;
+#endif
 #endif
 
 	int				on_cpu;
@@ -34,4 +34,31 @@ void sort_nonatomic(void *base, size_t num, size_t size,
 		    cmp_func_t cmp_func,
 		    swap_func_t swap_func);
 
+/* Introsort: quicksort with heapsort fallback, faster on large arrays */
+
+void sort_intro_r(void *base, size_t num, size_t size,
+		  cmp_r_func_t cmp_func,
+		  swap_r_func_t swap_func,
+		  const void *priv);
+
+void sort_intro_r_nonatomic(void *base, size_t num, size_t size,
+			    cmp_r_func_t cmp_func,
+			    swap_r_func_t swap_func,
+			    const void *priv);
+
+void sort_intro(void *base, size_t num, size_t size,
+		cmp_func_t cmp_func,
+		swap_func_t swap_func);
+
+/*
+ * LSD radix sort of integer keys. @tmp must provide radix_sort_tmp_size()
+ * bytes: room for @num keys followed by the digit counters.
+ */
+#define RADIX_SORT_DIGITS	256
+#define radix_sort_tmp_size(num, size) \
+	((num) * (size) + RADIX_SORT_DIGITS * sizeof(u32))
+
+void radix_sort_u32(u32 *base, u32 *tmp, size_t num);
+void radix_sort_u64(u64 *base, u64 *tmp, size_t num);
+
 #endif
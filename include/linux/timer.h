@@ -40,18 +40,28 @@
  * timer was enqueued. When a particular CPU is required, add_timer_on()
  * has to be used. Enqueue via mod_timer() and add_timer() is always done
  * on the local CPU.
+ *
+ * @TIMER_LAZY: mod_timer() on a pending lazy timer which only moves the
+ * expiry time further out just updates @timer->expires. The timer stays
+ * in its wheel bucket and is requeued when that bucket expires, without
+ * invoking the callback. This suits timers which are re-armed far more
+ * often than they fire, like the networking retransmit timers. Users
+ * must serialize mod_timer() calls on the same lazy timer.
  */
-#define TIMER_CPUMASK		0x0003FFFF
+#define TIMER_CPUMASK		0x0001FFFF
+#define TIMER_LAZY		0x00020000
 #define TIMER_MIGRATING		0x00040000
 #define TIMER_BASEMASK		(TIMER_CPUMASK | TIMER_MIGRATING)
 #define TIMER_DEFERRABLE	0x00080000
 #define TIMER_PINNED		0x00100000
 #define TIMER_IRQSAFE		0x00200000
-#define TIMER_INIT_FLAGS	(TIMER_DEFERRABLE | TIMER_PINNED | TIMER_IRQSAFE)
+#define TIMER_INIT_FLAGS	(TIMER_DEFERRABLE | TIMER_PINNED | TIMER_IRQSAFE | \
+				 TIMER_LAZY)
 #define TIMER_ARRAYSHIFT	22
 #define TIMER_ARRAYMASK		0xFFC00000
 
-#define TIMER_TRACE_FLAGMASK	(TIMER_MIGRATING | TIMER_DEFERRABLE | TIMER_PINNED | TIMER_IRQSAFE)
+#define TIMER_TRACE_FLAGMASK	(TIMER_MIGRATING | TIMER_DEFERRABLE | TIMER_PINNED | TIMER_IRQSAFE | \
+				 TIMER_LAZY)
 
 #define __TIMER_INITIALIZER(_function, _flags) {		\
 		.entry = { .next = TIMER_ENTRY_STATIC },	\
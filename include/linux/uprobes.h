@@ -62,6 +62,21 @@ struct uprobe_consumer {
 	__u64 id;	/* set when uprobe_consumer is registered */
 };
 
+/*
+ * One element of a batched registration, filled in by the caller's
+ * uprobe_batch_fn for index @idx. The registered uprobe is stored to
+ * *@uprobe and read back from there on unregistration.
+ */
+struct uprobe_batch_item {
+	loff_t			offset;
+	loff_t			ref_ctr_offset;
+	struct uprobe_consumer	*uc;
+	struct uprobe		**uprobe;
+};
+
+typedef void (*uprobe_batch_fn)(unsigned int idx, void *ctx,
+				struct uprobe_batch_item *item);
+
 #ifdef CONFIG_UPROBES
 #include <asm/uprobes.h>
 
@@ -184,11 +199,31 @@ enum rp_check {
 
 struct xol_area;
 
+#define UPROBE_HIT_CACHE_BITS	3
+#define UPROBE_HIT_CACHE_SIZE	(1 << UPROBE_HIT_CACHE_BITS)
+
+/*
+ * Per-mm cache of breakpoint address -> uprobe lookups. An entry is only
+ * trusted while neither the mm layout (mm_lock_seq) nor uprobes_tree
+ * changed since it was filled.
+ */
+struct uprobe_hit_cache_entry {
+	unsigned long		vaddr;
+	struct uprobe		*uprobe;
+	unsigned int		mm_seq;
+	unsigned int		tree_seq;
+};
+
 struct uprobes_state {
 	struct xol_area		*xol_area;
 #ifdef CONFIG_X86_64
 	struct hlist_head	head_tramps;
 #endif
+#ifdef CONFIG_PER_VMA_LOCK
+	spinlock_t		hit_lock;
+	seqcount_spinlock_t	hit_seq;
+	struct uprobe_hit_cache_entry hit_cache[UPROBE_HIT_CACHE_SIZE];
+#endif
 };
 
 typedef int (*uprobe_write_verify_t)(struct page *page, unsigned long vaddr,
@@ -207,6 +242,8 @@ extern int uprobe_write(struct arch_uprobe *auprobe, struct vm_area_struct *vma,
 			uprobe_opcode_t *insn, int nbytes, uprobe_write_verify_t verify, bool is_register, bool do_update_ref_ctr,
 			void *data);
 extern struct uprobe *uprobe_register(struct inode *inode, loff_t offset, loff_t ref_ctr_offset, struct uprobe_consumer *uc);
+extern int uprobe_register_batch(struct inode *inode, unsigned int cnt, uprobe_batch_fn get, void *ctx);
+extern void uprobe_unregister_batch_nosync(struct inode *inode, unsigned int cnt, uprobe_batch_fn get, void *ctx);
 extern int uprobe_apply(struct uprobe *uprobe, struct uprobe_consumer *uc, bool);
 extern void uprobe_unregister_nosync(struct uprobe *uprobe, struct uprobe_consumer *uc);
 extern void uprobe_unregister_sync(void);
@@ -223,6 +260,7 @@ extern void uprobe_notify_resume(struct pt_regs *regs);
 extern bool uprobe_deny_signal(void);
 extern bool arch_uprobe_skip_sstep(struct arch_uprobe *aup, struct pt_regs *regs);
 extern void uprobe_clear_state(struct mm_struct *mm);
+extern void uprobe_init_state(struct mm_struct *mm);
 extern int  arch_uprobe_analyze_insn(struct arch_uprobe *aup, struct mm_struct *mm, unsigned long addr);
 extern int  arch_uprobe_pre_xol(struct arch_uprobe *aup, struct pt_regs *regs);
 extern int  arch_uprobe_post_xol(struct arch_uprobe *aup, struct pt_regs *regs);
@@ -269,6 +307,15 @@ uprobe_unregister_nosync(struct uprobe *uprobe, struct uprobe_consumer *uc)
 static inline void uprobe_unregister_sync(void)
 {
 }
+static inline int
+uprobe_register_batch(struct inode *inode, unsigned int cnt, uprobe_batch_fn get, void *ctx)
+{
+	return -ENOSYS;
+}
+static inline void
+uprobe_unregister_batch_nosync(struct inode *inode, unsigned int cnt, uprobe_batch_fn get, void *ctx)
+{
+}
 static inline int uprobe_mmap(struct vm_area_struct *vma)
 {
 	return 0;
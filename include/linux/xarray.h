@@ -366,6 +366,12 @@ void *xa_find_after(struct xarray *xa, unsigned long *index,
 		unsigned long max, xa_mark_t) __attribute__((nonnull(2)));
 unsigned int xa_extract(struct xarray *, void **dst, unsigned long start,
 		unsigned long max, unsigned int n, xa_mark_t);
+int xa_store_batch(struct xarray *, unsigned long index, void **entries,
+		unsigned int nr, unsigned int order, gfp_t);
+unsigned long xa_load_range(struct xarray *, unsigned long first,
+		unsigned long last, void **entries);
+unsigned long xa_erase_range(struct xarray *, unsigned long first,
+		unsigned long last);
 void xa_destroy(struct xarray *);
 
 /**
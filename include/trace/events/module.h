@@ -47,6 +47,41 @@ TRACE_EVENT(module_load,
 	TP_printk("%s %s", __get_str(name), show_module_flags(__entry->taints))
 );
 
+/*
+ * Time spent in the main phases of load_module(), up to but not including
+ * the module's init function, which is covered by the initcall events.
+ * Enable with trace_event=module:module_load_time to see boot time costs.
+ */
+TRACE_EVENT(module_load_time,
+
+	TP_PROTO(struct module *mod, u64 layout_ns, u64 symbols_ns,
+		 u64 relocs_ns, u64 post_ns, u64 total_ns),
+
+	TP_ARGS(mod, layout_ns, symbols_ns, relocs_ns, post_ns, total_ns),
+
+	TP_STRUCT__entry(
+		__field(	u64,		layout_ns	)
+		__field(	u64,		symbols_ns	)
+		__field(	u64,		relocs_ns	)
+		__field(	u64,		post_ns		)
+		__field(	u64,		total_ns	)
+		__string(	name,		mod->name	)
+	),
+
+	TP_fast_assign(
+		__entry->layout_ns = layout_ns;
+		__entry->symbols_ns = symbols_ns;
+		__entry->relocs_ns = relocs_ns;
+		__entry->post_ns = post_ns;
+		__entry->total_ns = total_ns;
+		__assign_str(name);
+	),
+
+	TP_printk("%s layout=%llu symbols=%llu relocs=%llu post=%llu total=%llu ns",
+		  __get_str(name), __entry->layout_ns, __entry->symbols_ns,
+		  __entry->relocs_ns, __entry->post_ns, __entry->total_ns)
+);
+
 TRACE_EVENT(module_free,
 
 	TP_PROTO(struct module *mod),
@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM rhashtable
+
+#if !defined(_TRACE_RHASHTABLE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_RHASHTABLE_H
+
+#include <linux/tracepoint.h>
+
+struct rhashtable;
+
+/*
+ * Emitted when a resize completes and the new bucket table is published.
+ * @duration_ns covers the whole window in which lookups could have to
+ * search two tables, starting from when the new table was attached.
+ * @double_probes is only counted while this event is enabled.
+ */
+TRACE_EVENT(rhashtable_rehash,
+
+	TP_PROTO(const struct rhashtable *ht, unsigned int old_size,
+		 unsigned int new_size, unsigned int nelems, u64 duration_ns,
+		 unsigned int workers, unsigned int helped,
+		 unsigned long double_probes),
+
+	TP_ARGS(ht, old_size, new_size, nelems, duration_ns, workers, helped,
+		double_probes),
+
+	TP_STRUCT__entry(
+		__field(const void *, ht)
+		__field(unsigned int, old_size)
+		__field(unsigned int, new_size)
+		__field(unsigned int, nelems)
+		__field(u64, duration_ns)
+		__field(unsigned int, workers)
+		__field(unsigned int, helped)
+		__field(unsigned long, double_probes)
+	),
+
+	TP_fast_assign(
+		__entry->ht		= ht;
+		__entry->old_size	= old_size;
+		__entry->new_size	= new_size;
+		__entry->nelems		= nelems;
+		__entry->duration_ns	= duration_ns;
+		__entry->workers	= workers;
+		__entry->helped		= helped;
+		__entry->double_probes	= double_probes;
+	),
+
+	TP_printk("ht=%p size=%u->%u nelems=%u duration_ns=%llu workers=%u helped=%u double_probes=%lu",
+		  __entry->ht, __entry->old_size, __entry->new_size,
+		  __entry->nelems, __entry->duration_ns, __entry->workers,
+		  __entry->helped, __entry->double_probes)
+);
+
+#endif /* _TRACE_RHASHTABLE_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
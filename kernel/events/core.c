@@ -937,13 +937,66 @@ perf_cgroup_set_timestamp(struct perf_cpu_context *cpuctx)
 	}
 }
 
+/*
+ * Return the closest ancestor of @cgrp (including itself) that has enabled
+ * events on this CPU. Since cgroup events match all descendants, two cgroups
+ * with the same such ancestor match exactly the same set of events.
+ */
+static struct perf_cgroup *perf_cgroup_events_root(struct perf_cgroup *cgrp)
+{
+	struct cgroup_subsys_state *css;
+
+	if (!cgrp)
+		return NULL;
+
+	for (css = &cgrp->css; css; css = css->parent) {
+		cgrp = container_of(css, struct perf_cgroup, css);
+		if (this_cpu_ptr(cgrp->info)->nr_events)
+			return cgrp;
+	}
+
+	return NULL;
+}
+
+/*
+ * Switch cgroup time from @prev to @next without rescheduling any event.
+ * Only the part of the hierarchy below @root differs between the two;
+ * @root and its ancestors keep running.
+ */
+static void perf_cgroup_switch_time(struct perf_cpu_context *cpuctx,
+				    struct perf_cgroup *prev,
+				    struct perf_cgroup *next,
+				    struct perf_cgroup *root)
+{
+	struct cgroup_subsys_state *css, *stop = root ? &root->css : NULL;
+	struct perf_cgroup_info *info;
+	u64 now;
+
+	if (!(cpuctx->ctx.is_active & EVENT_TIME))
+		return;
+
+	now = perf_clock();
+
+	for (css = prev ? &prev->css : NULL; css != stop; css = css->parent) {
+		info = this_cpu_ptr(container_of(css, struct perf_cgroup, css)->info);
+		__update_cgrp_time(info, now, true);
+		__store_release(&info->active, 0);
+	}
+
+	for (css = next ? &next->css : NULL; css != stop; css = css->parent) {
+		info = this_cpu_ptr(container_of(css, struct perf_cgroup, css)->info);
+		__update_cgrp_time(info, now, false);
+		__store_release(&info->active, 1);
+	}
+}
+
 /*
  * reschedule events based on the cgroup constraint of task.
  */
 static void perf_cgroup_switch(struct task_struct *task)
 {
 	struct perf_cpu_context *cpuctx = this_cpu_ptr(&perf_cpu_context);
-	struct perf_cgroup *cgrp;
+	struct perf_cgroup *cgrp, *root;
 
 	/*
 	 * cpuctx->cgrp is set when the first cgroup event enabled,
@@ -965,6 +1018,18 @@ static void perf_cgroup_switch(struct task_struct *task)
 
 	WARN_ON_ONCE(cpuctx->ctx.nr_cgroups == 0);
 
+	/*
+	 * Switching within a subtree that has no events of its own leaves
+	 * the set of matching events unchanged; this is the common case
+	 * with many monitored cgroups, so avoid the O(nr_events) resched.
+	 */
+	root = perf_cgroup_events_root(cpuctx->cgrp);
+	if (root == perf_cgroup_events_root(cgrp)) {
+		perf_cgroup_switch_time(cpuctx, cpuctx->cgrp, cgrp, root);
+		cpuctx->cgrp = cgrp;
+		return;
+	}
+
 	perf_ctx_disable(&cpuctx->ctx, true);
 
 	ctx_sched_out(&cpuctx->ctx, NULL, EVENT_ALL|EVENT_CGROUP);
@@ -1070,6 +1135,7 @@ perf_cgroup_event_enable(struct perf_event *event, struct perf_event_context *ct
 		return;
 
 	event->pmu_ctx->nr_cgroups++;
+	per_cpu_ptr(event->cgrp->info, event->cpu)->nr_events++;
 
 	/*
 	 * Because cgroup events are always per-cpu events,
@@ -1092,6 +1158,7 @@ perf_cgroup_event_disable(struct perf_event *event, struct perf_event_context *c
 		return;
 
 	event->pmu_ctx->nr_cgroups--;
+	per_cpu_ptr(event->cgrp->info, event->cpu)->nr_events--;
 
 	/*
 	 * Because cgroup events are always per-cpu events,
@@ -30,6 +30,7 @@
 #include <linux/srcu.h>
 #include <linux/oom.h>          /* check_stable_address_space */
 #include <linux/pagewalk.h>
+#include <linux/hash.h>
 
 #include <linux/uprobes.h>
 
@@ -1198,10 +1199,14 @@ static inline struct map_info *free_map_info(struct map_info *info)
 	return next;
 }
 
+/*
+ * Collect the mms mapping [@first, @last] of @mapping. ->vaddr is the
+ * address of @offset in the (last seen) vma of each mm.
+ */
 static struct map_info *
-build_map_info(struct address_space *mapping, loff_t offset, bool is_register)
+__build_map_info(struct address_space *mapping, pgoff_t first, pgoff_t last,
+		 loff_t offset, bool is_register)
 {
-	unsigned long pgoff = offset >> PAGE_SHIFT;
 	struct vm_area_struct *vma;
 	struct map_info *curr = NULL;
 	struct map_info *prev = NULL;
@@ -1210,7 +1215,7 @@ build_map_info(struct address_space *mapping, loff_t offset, bool is_register)
 
  again:
 	i_mmap_lock_read(mapping);
-	vma_interval_tree_foreach(vma, &mapping->i_mmap, pgoff, pgoff) {
+	vma_interval_tree_foreach(vma, &mapping->i_mmap, first, last) {
 		if (!valid_vma(vma, is_register))
 			continue;
 
@@ -1268,6 +1273,14 @@ build_map_info(struct address_space *mapping, loff_t offset, bool is_register)
 	return curr;
 }
 
+static struct map_info *
+build_map_info(struct address_space *mapping, loff_t offset, bool is_register)
+{
+	pgoff_t pgoff = offset >> PAGE_SHIFT;
+
+	return __build_map_info(mapping, pgoff, pgoff, offset, is_register);
+}
+
 static int
 register_for_each_vma(struct uprobe *uprobe, struct uprobe_consumer *new)
 {
@@ -1329,6 +1342,113 @@ register_for_each_vma(struct uprobe *uprobe, struct uprobe_consumer *new)
 	return err;
 }
 
+static bool map_info_seen(struct map_info *head, struct map_info *info)
+{
+	for (; head != info; head = head->next) {
+		if (head->mm == info->mm)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Like register_for_each_vma() for all @cnt uprobes of a batch on @inode:
+ * the file's mappings are collected once, and each mm is write-locked
+ * once for all of the batch's breakpoints rather than once per uprobe.
+ *
+ * Unlike register_for_each_vma() this runs without ->register_rwsem of
+ * each uprobe (there can be thousands), which is fine because every
+ * consumer of the batch is already on (or already off) its uprobe's
+ * list, and install/remove are serialized against each other by
+ * dup_mmap_sem and the mmap_lock.
+ */
+static int register_for_each_vma_batch(struct inode *inode, unsigned int cnt,
+				       uprobe_batch_fn get, void *ctx,
+				       bool is_register)
+{
+	struct uprobe_batch_item item;
+	struct map_info *info, *head;
+	loff_t lo = LLONG_MAX, hi = 0;
+	unsigned int i;
+	int err = 0;
+
+	if (!cnt)
+		return 0;
+
+	for (i = 0; i < cnt; i++) {
+		get(i, ctx, &item);
+		lo = min(lo, item.offset);
+		hi = max(hi, item.offset);
+	}
+
+	percpu_down_write(&dup_mmap_sem);
+	info = __build_map_info(inode->i_mapping, lo >> PAGE_SHIFT,
+				hi >> PAGE_SHIFT, lo, is_register);
+	if (IS_ERR(info)) {
+		err = PTR_ERR(info);
+		goto out;
+	}
+
+	head = info;
+	while (info) {
+		struct mm_struct *mm = info->mm;
+		struct vm_area_struct *vma;
+		VMA_ITERATOR(vmi, mm, 0);
+
+		if ((err && is_register) || map_info_seen(head, info))
+			goto free;
+
+		mmap_write_lock(mm);
+		if (check_stable_address_space(mm))
+			goto unlock;
+
+		for_each_vma(vmi, vma) {
+			loff_t start, end;
+
+			if (!valid_vma(vma, is_register) ||
+			    file_inode(vma->vm_file) != inode)
+				continue;
+
+			start = (loff_t)vma->vm_pgoff << PAGE_SHIFT;
+			end = start + (vma->vm_end - vma->vm_start);
+
+			for (i = 0; i < cnt; i++) {
+				struct uprobe *uprobe;
+				unsigned long vaddr;
+
+				get(i, ctx, &item);
+				if (item.offset < start || item.offset >= end)
+					continue;
+
+				uprobe = *item.uprobe;
+				vaddr = offset_to_vaddr(vma, item.offset);
+				if (is_register) {
+					if (!consumer_filter(item.uc, mm))
+						continue;
+					err = install_breakpoint(uprobe, vma, vaddr);
+					if (err)
+						goto unlock;
+				} else if (mm_flags_test(MMF_HAS_UPROBES, mm)) {
+					if (!filter_chain(uprobe, mm))
+						err |= remove_breakpoint(uprobe, vma, vaddr);
+				}
+			}
+		}
+ unlock:
+		mmap_write_unlock(mm);
+ free:
+		/* head stays valid for map_info_seen() until the walk ends */
+		mmput(mm);
+		info = info->next;
+	}
+
+	while (head)
+		head = free_map_info(head);
+ out:
+	percpu_up_write(&dup_mmap_sem);
+	return err;
+}
+
 /**
  * uprobe_unregister_nosync - unregister an already registered probe.
  * @uprobe: uprobe to remove
@@ -1369,6 +1489,33 @@ void uprobe_unregister_sync(void)
 }
 EXPORT_SYMBOL_GPL(uprobe_unregister_sync);
 
+static int uprobe_register_check(struct inode *inode, loff_t offset,
+				 loff_t ref_ctr_offset, struct uprobe_consumer *uc)
+{
+	/* Uprobe must have at least one set consumer */
+	if (!uc->handler && !uc->ret_handler)
+		return -EINVAL;
+
+	/* copy_insn() uses read_mapping_page() or shmem_read_mapping_page() */
+	if (!inode->i_mapping->a_ops->read_folio &&
+	    !shmem_mapping(inode->i_mapping))
+		return -EIO;
+	/* Racy, just to catch the obvious mistakes */
+	if (offset > i_size_read(inode))
+		return -EINVAL;
+
+	/*
+	 * This ensures that uprobe_copy_from_page(), copy_to_page() and
+	 * __update_ref_ctr() can't cross page boundary.
+	 */
+	if (!IS_ALIGNED(offset, UPROBE_SWBP_INSN_SIZE))
+		return -EINVAL;
+	if (!IS_ALIGNED(ref_ctr_offset, sizeof(short)))
+		return -EINVAL;
+
+	return 0;
+}
+
 /**
  * uprobe_register - register a probe
  * @inode: the file in which the probe has to be placed.
@@ -1394,26 +1541,9 @@ struct uprobe *uprobe_register(struct inode *inode,
 	struct uprobe *uprobe;
 	int ret;
 
-	/* Uprobe must have at least one set consumer */
-	if (!uc->handler && !uc->ret_handler)
-		return ERR_PTR(-EINVAL);
-
-	/* copy_insn() uses read_mapping_page() or shmem_read_mapping_page() */
-	if (!inode->i_mapping->a_ops->read_folio &&
-	    !shmem_mapping(inode->i_mapping))
-		return ERR_PTR(-EIO);
-	/* Racy, just to catch the obvious mistakes */
-	if (offset > i_size_read(inode))
-		return ERR_PTR(-EINVAL);
-
-	/*
-	 * This ensures that uprobe_copy_from_page(), copy_to_page() and
-	 * __update_ref_ctr() can't cross page boundary.
-	 */
-	if (!IS_ALIGNED(offset, UPROBE_SWBP_INSN_SIZE))
-		return ERR_PTR(-EINVAL);
-	if (!IS_ALIGNED(ref_ctr_offset, sizeof(short)))
-		return ERR_PTR(-EINVAL);
+	ret = uprobe_register_check(inode, offset, ref_ctr_offset, uc);
+	if (ret)
+		return ERR_PTR(ret);
 
 	uprobe = alloc_uprobe(inode, offset, ref_ctr_offset);
 	if (IS_ERR(uprobe))
@@ -1439,6 +1569,103 @@ struct uprobe *uprobe_register(struct inode *inode,
 }
 EXPORT_SYMBOL_GPL(uprobe_register);
 
+/**
+ * uprobe_unregister_batch_nosync - unregister a batch of probes on one file
+ * @inode: the file all probes of the batch are placed in.
+ * @cnt: number of probes.
+ * @get: fills in the description of probe @idx.
+ * @ctx: passed to @get.
+ *
+ * Batched uprobe_unregister_nosync(); the caller still has to call
+ * uprobe_unregister_sync() before freeing the consumers.
+ */
+void uprobe_unregister_batch_nosync(struct inode *inode, unsigned int cnt,
+				    uprobe_batch_fn get, void *ctx)
+{
+	struct uprobe_batch_item item;
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < cnt; i++) {
+		struct uprobe *uprobe;
+
+		get(i, ctx, &item);
+		uprobe = *item.uprobe;
+		down_write(&uprobe->register_rwsem);
+		consumer_del(uprobe, item.uc);
+		up_write(&uprobe->register_rwsem);
+	}
+
+	err = register_for_each_vma_batch(inode, cnt, get, ctx, false);
+	if (unlikely(err)) {
+		uprobe_warn(current, "unregister, leaking uprobes");
+		return;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		get(i, ctx, &item);
+		put_uprobe(*item.uprobe);
+	}
+}
+EXPORT_SYMBOL_GPL(uprobe_unregister_batch_nosync);
+
+/**
+ * uprobe_register_batch - register a batch of probes on one file
+ * @inode: the file all probes of the batch are placed in.
+ * @cnt: number of probes.
+ * @get: fills in the description of probe @idx.
+ * @ctx: passed to @get.
+ *
+ * Equivalent to calling uprobe_register() for each probe, but walks the
+ * file's mappings and takes each mm's mmap_lock once for the whole batch.
+ * On success the uprobe of each probe is stored through its item's
+ * ->uprobe; on failure nothing stays registered.
+ *
+ * Return: 0 on success or a negative error code.
+ */
+int uprobe_register_batch(struct inode *inode, unsigned int cnt,
+			  uprobe_batch_fn get, void *ctx)
+{
+	struct uprobe_batch_item item;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < cnt; i++) {
+		get(i, ctx, &item);
+		ret = uprobe_register_check(inode, item.offset,
+					    item.ref_ctr_offset, item.uc);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		struct uprobe *uprobe;
+
+		get(i, ctx, &item);
+		uprobe = alloc_uprobe(inode, item.offset, item.ref_ctr_offset);
+		if (IS_ERR(uprobe)) {
+			ret = PTR_ERR(uprobe);
+			goto unregister;
+		}
+		*item.uprobe = uprobe;
+
+		down_write(&uprobe->register_rwsem);
+		consumer_add(uprobe, item.uc);
+		up_write(&uprobe->register_rwsem);
+	}
+
+	ret = register_for_each_vma_batch(inode, cnt, get, ctx, true);
+	if (!ret)
+		return 0;
+
+unregister:
+	/* As in uprobe_register(), some handlers might already be running. */
+	uprobe_unregister_batch_nosync(inode, i, get, ctx);
+	uprobe_unregister_sync();
+	return ret;
+}
+EXPORT_SYMBOL_GPL(uprobe_register_batch);
+
 /**
  * uprobe_apply - add or remove the breakpoints according to @uc->filter
  * @uprobe: uprobe which "owns" the breakpoint
@@ -1810,6 +2037,18 @@ void __weak arch_uprobe_init_state(struct mm_struct *mm)
 {
 }
 
+void uprobe_init_state(struct mm_struct *mm)
+{
+	mm->uprobes_state.xol_area = NULL;
+#ifdef CONFIG_PER_VMA_LOCK
+	spin_lock_init(&mm->uprobes_state.hit_lock);
+	seqcount_spinlock_init(&mm->uprobes_state.hit_seq,
+			       &mm->uprobes_state.hit_lock);
+	memset(mm->uprobes_state.hit_cache, 0,
+	       sizeof(mm->uprobes_state.hit_cache));
+#endif
+}
+
 /*
  * uprobe_clear_state - Free the area allocated for slots.
  */
@@ -2420,6 +2659,72 @@ static int is_trap_at_addr(struct mm_struct *mm, unsigned long vaddr)
 	return is_trap_insn(&opcode);
 }
 
+#ifdef CONFIG_PER_VMA_LOCK
+static struct uprobe_hit_cache_entry *
+uprobe_hit_cache_slot(struct mm_struct *mm, unsigned long bp_vaddr)
+{
+	return &mm->uprobes_state.hit_cache[hash_long(bp_vaddr,
+						      UPROBE_HIT_CACHE_BITS)];
+}
+
+/*
+ * If neither the address space nor uprobes_tree changed since the entry
+ * was filled, @bp_vaddr still maps to the same inode:offset and the
+ * uprobe found for it is still in the tree (so RCU still protects it).
+ */
+static struct uprobe *uprobe_hit_cache_lookup(struct mm_struct *mm,
+					      unsigned long bp_vaddr,
+					      unsigned int mm_seq)
+{
+	struct uprobe_hit_cache_entry *e = uprobe_hit_cache_slot(mm, bp_vaddr);
+	struct uprobe *uprobe;
+	unsigned int seq;
+
+	do {
+		seq = read_seqcount_begin(&mm->uprobes_state.hit_seq);
+		uprobe = NULL;
+		if (e->vaddr == bp_vaddr && e->mm_seq == mm_seq &&
+		    e->tree_seq == raw_read_seqcount(&uprobes_seqcount))
+			uprobe = e->uprobe;
+	} while (read_seqcount_retry(&mm->uprobes_state.hit_seq, seq));
+
+	return uprobe;
+}
+
+static void uprobe_hit_cache_fill(struct mm_struct *mm, unsigned long bp_vaddr,
+				  struct uprobe *uprobe, unsigned int mm_seq,
+				  unsigned int tree_seq)
+{
+	struct uprobe_hit_cache_entry *e = uprobe_hit_cache_slot(mm, bp_vaddr);
+
+	/* Another thread of this mm is filling; just skip it. */
+	if (!spin_trylock(&mm->uprobes_state.hit_lock))
+		return;
+	write_seqcount_begin(&mm->uprobes_state.hit_seq);
+	e->vaddr = bp_vaddr;
+	e->uprobe = uprobe;
+	e->mm_seq = mm_seq;
+	e->tree_seq = tree_seq;
+	write_seqcount_end(&mm->uprobes_state.hit_seq);
+	spin_unlock(&mm->uprobes_state.hit_lock);
+}
+#else
+static inline struct uprobe *uprobe_hit_cache_lookup(struct mm_struct *mm,
+						     unsigned long bp_vaddr,
+						     unsigned int mm_seq)
+{
+	return NULL;
+}
+
+static inline void uprobe_hit_cache_fill(struct mm_struct *mm,
+					 unsigned long bp_vaddr,
+					 struct uprobe *uprobe,
+					 unsigned int mm_seq,
+					 unsigned int tree_seq)
+{
+}
+#endif
+
 static struct uprobe *find_active_uprobe_speculative(unsigned long bp_vaddr)
 {
 	struct mm_struct *mm = current->mm;
@@ -2427,13 +2732,19 @@ static struct uprobe *find_active_uprobe_speculative(unsigned long bp_vaddr)
 	struct vm_area_struct *vma;
 	struct file *vm_file;
 	loff_t offset;
-	unsigned int seq;
+	unsigned int seq, tree_seq;
 
 	guard(rcu)();
 
 	if (!mmap_lock_speculate_try_begin(mm, &seq))
 		return NULL;
 
+	uprobe = uprobe_hit_cache_lookup(mm, bp_vaddr, seq);
+	if (uprobe)
+		return uprobe;
+
+	tree_seq = raw_read_seqcount(&uprobes_seqcount);
+
 	vma = vma_lookup(mm, bp_vaddr);
 	if (!vma)
 		return NULL;
@@ -2458,6 +2769,9 @@ static struct uprobe *find_active_uprobe_speculative(unsigned long bp_vaddr)
 	if (mmap_lock_speculate_retry(mm, seq))
 		return NULL;
 
+	if (!(tree_seq & 1) && !read_seqcount_retry(&uprobes_seqcount, tree_seq))
+		uprobe_hit_cache_fill(mm, bp_vaddr, uprobe, seq, tree_seq);
+
 	return uprobe;
 }
 
@@ -1012,7 +1012,7 @@ static void mm_init_owner(struct mm_struct *mm, struct task_struct *p)
 static void mm_init_uprobes_state(struct mm_struct *mm)
 {
 #ifdef CONFIG_UPROBES
-	mm->uprobes_state.xol_area = NULL;
+	uprobe_init_state(mm);
 	arch_uprobe_init_state(mm);
 #endif
 }
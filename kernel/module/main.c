@@ -53,6 +53,8 @@
 #include <linux/jump_label.h>
 #include <linux/pfn.h>
 #include <linux/bsearch.h>
+#include <linux/hashtable.h>
+#include <linux/stringhash.h>
 #include <linux/dynamic_debug.h>
 #include <linux/audit.h>
 #include <linux/cfi.h>
@@ -90,6 +92,23 @@ struct symsearch {
 	enum mod_license license;
 };
 
+/*
+ * Symbols exported by modules, hashed by name. Modules are added once they
+ * leave MODULE_STATE_UNFORMED, so resolving a symbol no longer has to
+ * bsearch the export tables of every loaded module in turn. Writers hold
+ * module_mutex, readers RCU or module_mutex, as for the modules list.
+ */
+#define MODULE_KSYM_HASH_BITS	12
+static DEFINE_HASHTABLE(module_ksym_hash, MODULE_KSYM_HASH_BITS);
+
+struct module_ksym {
+	struct hlist_node node;
+	const struct kernel_symbol *sym;
+	const u32 *crc;
+	struct module *owner;
+	enum mod_license license;
+};
+
 /*
  * Bounds of module memory, for speeding up __module_address.
  * Protected by module_mutex.
@@ -381,6 +400,37 @@ static bool find_exported_symbol_in_section(const struct symsearch *syms,
 	return true;
 }
 
+static u32 module_ksym_hashfn(const char *name)
+{
+	return full_name_hash(NULL, name, strlen(name));
+}
+
+static bool find_module_exported_symbol(struct find_symbol_arg *fsa)
+{
+	struct module_ksym *ksym;
+
+	hash_for_each_possible_rcu(module_ksym_hash, ksym, node,
+				   module_ksym_hashfn(fsa->name),
+				   lockdep_is_held(&module_mutex)) {
+		/* Going away, but a new module may export the name again. */
+		if (ksym->owner->state == MODULE_STATE_UNFORMED)
+			continue;
+		if (strcmp(fsa->name, kernel_symbol_name(ksym->sym)))
+			continue;
+		/* Exported names are unique, no need to look any further. */
+		if (!fsa->gplok && ksym->license == GPL_ONLY)
+			return false;
+
+		fsa->owner = ksym->owner;
+		fsa->crc = ksym->crc;
+		fsa->sym = ksym->sym;
+		fsa->license = ksym->license;
+		return true;
+	}
+
+	return false;
+}
+
 /*
  * Find an exported symbol and return it, along with, (optional) crc and
  * (optional) module which owns it. Needs RCU or module_mutex.
@@ -394,33 +444,87 @@ bool find_symbol(struct find_symbol_arg *fsa)
 		  __start___kcrctab_gpl,
 		  GPL_ONLY },
 	};
-	struct module *mod;
 	unsigned int i;
 
 	for (i = 0; i < ARRAY_SIZE(arr); i++)
 		if (find_exported_symbol_in_section(&arr[i], NULL, fsa))
 			return true;
 
-	list_for_each_entry_rcu(mod, &modules, list,
-				lockdep_is_held(&module_mutex)) {
-		struct symsearch arr[] = {
-			{ mod->syms, mod->syms + mod->num_syms, mod->crcs,
-			  NOT_GPL_ONLY },
-			{ mod->gpl_syms, mod->gpl_syms + mod->num_gpl_syms,
-			  mod->gpl_crcs,
-			  GPL_ONLY },
-		};
+	if (find_module_exported_symbol(fsa))
+		return true;
 
-		if (mod->state == MODULE_STATE_UNFORMED)
-			continue;
+	pr_debug("Failed to find symbol %s\n", fsa->name);
+	return false;
+}
 
-		for (i = 0; i < ARRAY_SIZE(arr); i++)
-			if (find_exported_symbol_in_section(&arr[i], mod, fsa))
-				return true;
+static int module_ksyms_alloc(struct module *mod)
+{
+	struct symsearch arr[] = {
+		{ mod->syms, mod->syms + mod->num_syms, mod->crcs,
+		  NOT_GPL_ONLY },
+		{ mod->gpl_syms, mod->gpl_syms + mod->num_gpl_syms,
+		  mod->gpl_crcs,
+		  GPL_ONLY },
+	};
+	const struct kernel_symbol *sym;
+	struct module_ksym *ksym;
+	unsigned int i;
+
+	if (!mod->num_syms && !mod->num_gpl_syms)
+		return 0;
+
+	ksym = kvcalloc(mod->num_syms + mod->num_gpl_syms, sizeof(*ksym),
+			GFP_KERNEL);
+	if (!ksym)
+		return -ENOMEM;
+	mod->ksyms = ksym;
+
+	for (i = 0; i < ARRAY_SIZE(arr); i++) {
+		for (sym = arr[i].start; sym < arr[i].stop; sym++, ksym++) {
+			ksym->sym = sym;
+			ksym->crc = symversion(arr[i].crcs, sym - arr[i].start);
+			ksym->owner = mod;
+			ksym->license = arr[i].license;
+		}
 	}
 
-	pr_debug("Failed to find symbol %s\n", fsa->name);
-	return false;
+	return 0;
+}
+
+static unsigned int module_ksyms_count(struct module *mod)
+{
+	return mod->ksyms ? mod->num_syms + mod->num_gpl_syms : 0;
+}
+
+/* Must be called with module_mutex held. */
+static void module_ksyms_hash_add(struct module *mod)
+{
+	struct module_ksym *ksym = mod->ksyms;
+	unsigned int i;
+
+	for (i = 0; i < module_ksyms_count(mod); i++, ksym++)
+		hash_add_rcu(module_ksym_hash, &ksym->node,
+			     module_ksym_hashfn(kernel_symbol_name(ksym->sym)));
+}
+
+/*
+ * Must be called with module_mutex held, and the nodes must not be freed
+ * before an RCU grace period has elapsed.
+ */
+static void module_ksyms_hash_del(struct module *mod)
+{
+	struct module_ksym *ksym = mod->ksyms;
+	unsigned int i;
+
+	for (i = 0; i < module_ksyms_count(mod); i++, ksym++)
+		if (hash_hashed(&ksym->node))
+			hash_del_rcu(&ksym->node);
+}
+
+static void module_ksyms_free(struct module *mod)
+{
+	kvfree(mod->ksyms);
+	mod->ksyms = NULL;
 }
 
 /*
@@ -1418,10 +1522,12 @@ static void free_module(struct module *mod)
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
 	mod_tree_remove(mod);
+	module_ksyms_hash_del(mod);
 	/* Remove this module from bug list, this uses list_del_rcu */
 	module_bug_cleanup(mod);
 	/* Wait for RCU synchronizing before releasing mod->list and buglist. */
 	synchronize_rcu();
+	module_ksyms_free(mod);
 	if (try_add_tainted_module(mod))
 		pr_err("%s: adding tainted module to the unloaded tainted modules list failed.\n",
 		       mod->name);
@@ -3237,6 +3343,10 @@ static int complete_formation(struct module *mod, struct load_info *info)
 {
 	int err;
 
+	err = module_ksyms_alloc(mod);
+	if (err)
+		return err;
+
 	mutex_lock(&module_mutex);
 
 	/* Find duplicate symbols (must be called under lock). */
@@ -3258,6 +3368,9 @@ static int complete_formation(struct module *mod, struct load_info *info)
 	if (err)
 		goto out_strict_rwx;
 
+	/* Make our exports visible to find_symbol(). */
+	module_ksyms_hash_add(mod);
+
 	/*
 	 * Mark state as coming so strong_try_module_get() ignores us,
 	 * but kallsyms etc. can see us.
@@ -3271,6 +3384,7 @@ static int complete_formation(struct module *mod, struct load_info *info)
 	module_bug_cleanup(mod);
 out:
 	mutex_unlock(&module_mutex);
+	module_ksyms_free(mod);
 	return err;
 }
 
@@ -3355,6 +3469,9 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	bool module_allocated = false;
 	long err = 0;
 	char *after_dashes;
+	u64 start, layout_end, symbols_end, relocs_end, post_end;
+
+	start = ktime_get_ns();
 
 	/*
 	 * Do the signature check (if any) first. All that
@@ -3436,19 +3553,27 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	if (err)
 		goto free_modinfo;
 
+	layout_end = ktime_get_ns();
+
 	/* Fix up syms, so that st_value is a pointer to location. */
 	err = simplify_symbols(mod, info);
 	if (err < 0)
 		goto free_modinfo;
 
+	symbols_end = ktime_get_ns();
+
 	err = apply_relocations(mod, info);
 	if (err < 0)
 		goto free_modinfo;
 
+	relocs_end = ktime_get_ns();
+
 	err = post_relocation(mod, info);
 	if (err < 0)
 		goto free_modinfo;
 
+	post_end = ktime_get_ns();
+
 	flush_module_icache(mod);
 
 	/* Now copy in args */
@@ -3505,6 +3630,11 @@ static int load_module(struct load_info *info, const char __user *uargs,
 
 	/* Done! */
 	trace_module_load(mod);
+	trace_module_load_time(mod, layout_end - start,
+			       symbols_end - layout_end,
+			       relocs_end - symbols_end,
+			       post_end - relocs_end,
+			       ktime_get_ns() - start);
 
 	return do_init_module(mod);
 
@@ -3538,10 +3668,12 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
 	mod_tree_remove(mod);
+	module_ksyms_hash_del(mod);
 	wake_up_all(&module_wq);
 	/* Wait for RCU-sched synchronizing before releasing mod->list. */
 	synchronize_rcu();
 	mutex_unlock(&module_mutex);
+	module_ksyms_free(mod);
  free_module:
 	mod_stat_bump_invalid(info, flags);
 	/* Free lock-classes; relies on the preceding sync_rcu() */
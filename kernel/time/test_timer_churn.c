@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Timer wheel churn benchmark
+ *
+ * Arms @nr_timers timers and then keeps pushing them out with mod_timer()
+ * for @rounds rounds, the way networking re-arms retransmit timers on every
+ * ack. The run is done once with regular timers and once with TIMER_LAZY
+ * timers, and the average cost of a mod_timer() call is reported for both.
+ *
+ * Load with e.g. "modprobe test_timer_churn nr_timers=10000000" to cover
+ * ten million pending timers; that needs about 500MB of memory.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/atomic.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/timer.h>
+#include <linux/vmalloc.h>
+
+static unsigned long nr_timers = 1000000;
+module_param(nr_timers, ulong, 0444);
+MODULE_PARM_DESC(nr_timers, "Number of pending timers (default: 1000000)");
+
+static unsigned int rounds = 8;
+module_param(rounds, uint, 0444);
+MODULE_PARM_DESC(rounds, "Number of times each timer is re-armed (default: 8)");
+
+static unsigned int timeout_ms = 200;
+module_param(timeout_ms, uint, 0444);
+MODULE_PARM_DESC(timeout_ms, "Timeout the timers are re-armed with (default: 200)");
+
+static atomic_long_t timer_churn_fired;
+
+static void timer_churn_fn(struct timer_list *t)
+{
+	atomic_long_inc(&timer_churn_fired);
+}
+
+static void timer_churn_run(struct timer_list *timers, unsigned int flags)
+{
+	unsigned long timeout = msecs_to_jiffies(timeout_ms);
+	unsigned long i, fired;
+	unsigned int r;
+	u64 start, ns;
+
+	atomic_long_set(&timer_churn_fired, 0);
+
+	for (i = 0; i < nr_timers; i++) {
+		timer_setup(&timers[i], timer_churn_fn, flags);
+		mod_timer(&timers[i], jiffies + timeout + (i & 63));
+		if (!(i & 4095))
+			cond_resched();
+	}
+
+	start = ktime_get_ns();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < nr_timers; i++) {
+			mod_timer(&timers[i], jiffies + timeout + (i & 63) + r);
+			if (!(i & 4095))
+				cond_resched();
+		}
+	}
+	ns = ktime_get_ns() - start;
+
+	for (i = 0; i < nr_timers; i++) {
+		timer_shutdown_sync(&timers[i]);
+		if (!(i & 4095))
+			cond_resched();
+	}
+	fired = atomic_long_read(&timer_churn_fired);
+
+	pr_info("%s: %lu timers x %u rounds: %llu ms, %llu ns/mod_timer, %lu fired\n",
+		flags & TIMER_LAZY ? "lazy" : "regular", nr_timers, rounds,
+		div_u64(ns, NSEC_PER_MSEC),
+		div64_u64(ns, (u64)nr_timers * rounds ?: 1), fired);
+}
+
+static int __init timer_churn_init(void)
+{
+	struct timer_list *timers;
+
+	timers = vmalloc_array(nr_timers, sizeof(*timers));
+	if (!timers)
+		return -ENOMEM;
+
+	timer_churn_run(timers, 0);
+	timer_churn_run(timers, TIMER_LAZY);
+
+	vfree(timers);
+	return 0;
+}
+
+static void __exit timer_churn_exit(void)
+{
+}
+
+module_init(timer_churn_init);
+module_exit(timer_churn_exit);
+
+MODULE_DESCRIPTION("Timer wheel churn benchmark");
+MODULE_LICENSE("GPL");
@@ -1042,6 +1042,21 @@ __mod_timer(struct timer_list *timer, unsigned long expires, unsigned int option
 		if (options & MOD_TIMER_REDUCE && diff <= 0)
 			return 1;
 
+		/*
+		 * A lazy timer is left in its bucket when it is pushed out.
+		 * The barrier pairs with the one in timer_requeue_lazy():
+		 * either the expiry code sees the new expiry time and
+		 * requeues the timer, or the timer is not seen pending here
+		 * anymore and is requeued below.
+		 */
+		if ((timer->flags & TIMER_LAZY) && diff < 0 &&
+		    !(options & MOD_TIMER_REDUCE)) {
+			WRITE_ONCE(timer->expires, expires);
+			smp_mb();
+			if (timer_pending(timer))
+				return 1;
+		}
+
 		/*
 		 * We lock timer base and calculate the bucket index right
 		 * here. If the timer ends up in the same bucket, then we
@@ -1762,6 +1777,25 @@ static void call_timer_fn(struct timer_list *timer,
 	}
 }
 
+/*
+ * A lazy timer whose expiry time was moved out while it was queued is put
+ * back into the wheel instead of invoking its callback. This is done with
+ * the base lock held, so pushed out timers of an expiring bucket are
+ * requeued in one go.
+ */
+static bool timer_requeue_lazy(struct timer_base *base,
+			       struct timer_list *timer, unsigned long clk)
+{
+	/* Pairs with the barrier in __mod_timer() */
+	smp_mb();
+	if (!time_after(READ_ONCE(timer->expires), clk))
+		return false;
+
+	debug_timer_activate(timer);
+	internal_add_timer(base, timer);
+	return true;
+}
+
 static void expire_timers(struct timer_base *base, struct hlist_head *head)
 {
 	/*
@@ -1788,6 +1822,12 @@ static void expire_timers(struct timer_base *base, struct hlist_head *head)
 			continue;
 		}
 
+		if ((timer->flags & TIMER_LAZY) &&
+		    timer_requeue_lazy(base, timer, baseclk)) {
+			base->running_timer = NULL;
+			continue;
+		}
+
 		if (timer->flags & TIMER_IRQSAFE) {
 			raw_spin_unlock(&base->lock);
 			call_timer_fn(timer, fn, baseclk);
@@ -2572,6 +2612,8 @@ static void __init init_timer_cpus(void)
 
 void __init timers_init(void)
 {
+	BUILD_BUG_ON(NR_CPUS > TIMER_CPUMASK + 1);
+
 	init_timer_cpus();
 	posix_cputimers_init_work();
 	open_softirq(TIMER_SOFTIRQ, run_timer_softirq);
@@ -2907,15 +2907,26 @@ struct bpf_uprobe_multi_run_ctx {
 	struct bpf_uprobe *uprobe;
 };
 
-static void bpf_uprobe_unregister(struct bpf_uprobe *uprobes, u32 cnt)
+static void bpf_uprobe_batch_item(unsigned int idx, void *ctx,
+				  struct uprobe_batch_item *item)
 {
-	u32 i;
+	struct bpf_uprobe *uprobe = (struct bpf_uprobe *)ctx + idx;
 
-	for (i = 0; i < cnt; i++)
-		uprobe_unregister_nosync(uprobes[i].uprobe, &uprobes[i].consumer);
+	item->offset = uprobe->offset;
+	item->ref_ctr_offset = uprobe->ref_ctr_offset;
+	item->uc = &uprobe->consumer;
+	item->uprobe = &uprobe->uprobe;
+}
+
+static void bpf_uprobe_unregister(struct path *path, struct bpf_uprobe *uprobes,
+				  u32 cnt)
+{
+	if (!cnt)
+		return;
 
-	if (cnt)
-		uprobe_unregister_sync();
+	uprobe_unregister_batch_nosync(d_real_inode(path->dentry), cnt,
+				       bpf_uprobe_batch_item, uprobes);
+	uprobe_unregister_sync();
 }
 
 static void bpf_uprobe_multi_link_release(struct bpf_link *link)
@@ -2923,7 +2934,8 @@ static void bpf_uprobe_multi_link_release(struct bpf_link *link)
 	struct bpf_uprobe_multi_link *umulti_link;
 
 	umulti_link = container_of(link, struct bpf_uprobe_multi_link, link);
-	bpf_uprobe_unregister(umulti_link->uprobes, umulti_link->cnt);
+	bpf_uprobe_unregister(&umulti_link->path, umulti_link->uprobes,
+			      umulti_link->cnt);
 	if (umulti_link->task)
 		put_task_struct(umulti_link->task);
 	path_put(&umulti_link->path);
@@ -3269,17 +3281,10 @@ int bpf_uprobe_multi_link_attach(const union bpf_attr *attr, struct bpf_prog *pr
 	bpf_link_init(&link->link, BPF_LINK_TYPE_UPROBE_MULTI,
 		      &bpf_uprobe_multi_link_lops, prog, attr->link_create.attach_type);
 
-	for (i = 0; i < cnt; i++) {
-		uprobes[i].uprobe = uprobe_register(d_real_inode(link->path.dentry),
-						    uprobes[i].offset,
-						    uprobes[i].ref_ctr_offset,
-						    &uprobes[i].consumer);
-		if (IS_ERR(uprobes[i].uprobe)) {
-			err = PTR_ERR(uprobes[i].uprobe);
-			link->cnt = i;
-			goto error_unregister;
-		}
-	}
+	err = uprobe_register_batch(d_real_inode(link->path.dentry), cnt,
+				    bpf_uprobe_batch_item, uprobes);
+	if (err)
+		goto error_free;
 
 	err = bpf_link_prime(&link->link, &link_primer);
 	if (err)
@@ -3288,7 +3293,7 @@ int bpf_uprobe_multi_link_attach(const union bpf_attr *attr, struct bpf_prog *pr
 	return bpf_link_settle(&link_primer);
 
 error_unregister:
-	bpf_uprobe_unregister(uprobes, link->cnt);
+	bpf_uprobe_unregister(&link->path, uprobes, link->cnt);
 
 error_free:
 	kvfree(uprobes);
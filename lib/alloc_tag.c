@@ -7,6 +7,7 @@
 #include <linux/module.h>
 #include <linux/page_ext.h>
 #include <linux/proc_fs.h>
+#include <linux/sched/clock.h>
 #include <linux/seq_buf.h>
 #include <linux/seq_file.h>
 #include <linux/string_choices.h>
@@ -37,6 +38,18 @@ EXPORT_SYMBOL(mem_alloc_profiling_key);
 
 DEFINE_STATIC_KEY_FALSE(mem_profiling_compressed);
 
+#ifdef CONFIG_MEM_ALLOC_PROFILING_SAMPLING
+DEFINE_STATIC_KEY_FALSE(mem_alloc_sampling_key);
+EXPORT_SYMBOL(mem_alloc_sampling_key);
+
+/* Bytes left to allocate on this cpu before the next allocation is sampled */
+DEFINE_PER_CPU(long, alloc_tag_sample_budget);
+EXPORT_SYMBOL(alloc_tag_sample_budget);
+
+/* Sample one allocation per this many bytes allocated on a cpu, 0 = off */
+static unsigned long alloc_tag_sample_interval;
+#endif
+
 struct alloc_tag_kernel_section kernel_tags = { NULL, 0 };
 unsigned long alloc_tag_ref_mask;
 int alloc_tag_ref_offs;
@@ -85,6 +98,89 @@ static void print_allocinfo_header(struct seq_buf *buf)
 	seq_buf_printf(buf, "#     <size>  <calls> <tag info>\n");
 }
 
+#ifdef CONFIG_MEM_ALLOC_PROFILING_SAMPLING
+bool __alloc_tag_sample_begin(void)
+{
+	this_cpu_write(alloc_tag_sample_budget, READ_ONCE(alloc_tag_sample_interval));
+	current->alloc_sample_start = local_clock();
+	return true;
+}
+EXPORT_SYMBOL(__alloc_tag_sample_begin);
+
+void __alloc_tag_sample_end(void)
+{
+	current->alloc_sample_start = 0;
+}
+EXPORT_SYMBOL(__alloc_tag_sample_end);
+
+static unsigned int alloc_tag_lat_bucket(u64 ns)
+{
+	if (ns < 256)
+		return 0;
+
+	return min_t(unsigned int, (ilog2(ns) - 8) / 2 + 1,
+		     ALLOC_TAG_LAT_BUCKETS - 1);
+}
+
+/*
+ * Only the first allocation accounted after sampling started is recorded.
+ * For slab that may be the page backing a new slab, which is attributed to
+ * the same tag and is what made the allocation slow in the first place.
+ */
+void __alloc_tag_sample(struct alloc_tag *tag, size_t bytes, struct page *page)
+{
+	struct alloc_tag_samples *samples = &tag->samples;
+	u64 start;
+	s64 ns;
+	int nid;
+
+	if (!in_task())
+		return;
+
+	start = current->alloc_sample_start;
+	if (!start || current->alloc_tag != tag)
+		return;
+
+	current->alloc_sample_start = 0;
+	/* local_clock() is not synchronized across cpus if we migrated */
+	ns = local_clock() - start;
+	if (ns < 0)
+		return;
+	nid = page_to_nid(page);
+
+	atomic_long_inc(&samples->nr);
+	atomic_long_add(bytes, &samples->bytes);
+	atomic64_add(ns, &samples->ns);
+	atomic_inc(&samples->lat[alloc_tag_lat_bucket(ns)]);
+	if (nid != numa_node_id())
+		atomic_long_inc(&samples->remote);
+	WRITE_ONCE(samples->nid, nid);
+}
+
+static void alloc_tag_samples_to_text(struct seq_buf *out, struct alloc_tag *tag)
+{
+	struct alloc_tag_samples *samples = &tag->samples;
+	unsigned long nr = atomic_long_read(&samples->nr);
+	int i;
+
+	if (!nr)
+		return;
+
+	seq_buf_printf(out, " samples:%lu sample_bytes:%lu avg_ns:%llu lat:",
+		       nr, atomic_long_read(&samples->bytes),
+		       div64_ul(atomic64_read(&samples->ns), nr));
+	for (i = 0; i < ALLOC_TAG_LAT_BUCKETS; i++)
+		seq_buf_printf(out, "%s%d", i ? "," : "",
+			       atomic_read(&samples->lat[i]));
+	seq_buf_printf(out, " remote:%lu node:%d",
+		       atomic_long_read(&samples->remote),
+		       READ_ONCE(samples->nid));
+}
+#else
+static inline void alloc_tag_samples_to_text(struct seq_buf *out,
+					     struct alloc_tag *tag) {}
+#endif
+
 static void alloc_tag_to_text(struct seq_buf *out, struct codetag *ct)
 {
 	struct alloc_tag *tag = ct_to_alloc_tag(ct);
@@ -95,6 +191,7 @@ static void alloc_tag_to_text(struct seq_buf *out, struct codetag *ct)
 	codetag_to_text(out, ct);
 	if (unlikely(alloc_tag_is_inaccurate(tag)))
 		seq_buf_printf(out, " accurate:no");
+	alloc_tag_samples_to_text(out, tag);
 	seq_buf_putc(out, ' ');
 	seq_buf_putc(out, '\n');
 }
@@ -234,6 +331,10 @@ static void shutdown_mem_profiling(bool remove_file)
 {
 	if (mem_alloc_profiling_enabled())
 		static_branch_disable(&mem_alloc_profiling_key);
+#ifdef CONFIG_MEM_ALLOC_PROFILING_SAMPLING
+	if (static_branch_unlikely(&mem_alloc_sampling_key))
+		static_branch_disable(&mem_alloc_sampling_key);
+#endif
 
 	if (!mem_profiling_support)
 		return;
@@ -782,6 +883,31 @@ static int proc_mem_profiling_handler(const struct ctl_table *table, int write,
 	return proc_do_static_key(table, write, buffer, lenp, ppos);
 }
 
+#ifdef CONFIG_MEM_ALLOC_PROFILING_SAMPLING
+static DEFINE_MUTEX(alloc_tag_sample_mutex);
+
+static int proc_mem_profiling_sample_handler(const struct ctl_table *table,
+					     int write, void *buffer,
+					     size_t *lenp, loff_t *ppos)
+{
+	int ret;
+
+	if (!mem_profiling_support && write)
+		return -EINVAL;
+
+	mutex_lock(&alloc_tag_sample_mutex);
+	ret = proc_doulongvec_minmax(table, write, buffer, lenp, ppos);
+	if (!ret && write) {
+		if (alloc_tag_sample_interval)
+			static_branch_enable(&mem_alloc_sampling_key);
+		else
+			static_branch_disable(&mem_alloc_sampling_key);
+	}
+	mutex_unlock(&alloc_tag_sample_mutex);
+
+	return ret;
+}
+#endif
 
 static struct ctl_table memory_allocation_profiling_sysctls[] = {
 	{
@@ -794,6 +920,15 @@ static struct ctl_table memory_allocation_profiling_sysctls[] = {
 #endif
 		.proc_handler	= proc_mem_profiling_handler,
 	},
+#ifdef CONFIG_MEM_ALLOC_PROFILING_SAMPLING
+	{
+		.procname	= "mem_profiling_sample_interval",
+		.data		= &alloc_tag_sample_interval,
+		.maxlen		= sizeof(alloc_tag_sample_interval),
+		.mode		= 0644,
+		.proc_handler	= proc_mem_profiling_sample_handler,
+	},
+#endif
 };
 
 static void __init sysctl_init(void)
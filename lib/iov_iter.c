@@ -346,6 +346,20 @@ static inline bool page_copy_sane(struct page *page, size_t offset, size_t n)
 	return true;
 }
 
+/*
+ * kmap_local_page() of a page outside highmem returns its direct map
+ * address, which stays contiguous over the rest of the folio.  Copy
+ * across subpage boundaries in one go in that case rather than mapping
+ * and copying a subpage at a time.
+ */
+static inline size_t page_copy_chunk(struct page *page, size_t offset,
+				     size_t bytes)
+{
+	if (!folio_test_partial_kmap(page_folio(page)))
+		return bytes;
+	return min(bytes, (size_t)PAGE_SIZE - offset);
+}
+
 size_t copy_page_to_iter(struct page *page, size_t offset, size_t bytes,
 			 struct iov_iter *i)
 {
@@ -358,7 +372,7 @@ size_t copy_page_to_iter(struct page *page, size_t offset, size_t bytes,
 	offset %= PAGE_SIZE;
 	while (1) {
 		void *kaddr = kmap_local_page(page);
-		size_t n = min(bytes, (size_t)PAGE_SIZE - offset);
+		size_t n = page_copy_chunk(page, offset, bytes);
 		n = _copy_to_iter(kaddr + offset, n, i);
 		kunmap_local(kaddr);
 		res += n;
@@ -366,10 +380,8 @@ size_t copy_page_to_iter(struct page *page, size_t offset, size_t bytes,
 		if (!bytes || !n)
 			break;
 		offset += n;
-		if (offset == PAGE_SIZE) {
-			page++;
-			offset = 0;
-		}
+		page += offset / PAGE_SIZE;
+		offset %= PAGE_SIZE;
 	}
 	return res;
 }
@@ -388,7 +400,7 @@ size_t copy_page_to_iter_nofault(struct page *page, unsigned offset, size_t byte
 	offset %= PAGE_SIZE;
 	while (1) {
 		void *kaddr = kmap_local_page(page);
-		size_t n = min(bytes, (size_t)PAGE_SIZE - offset);
+		size_t n = page_copy_chunk(page, offset, bytes);
 
 		n = iterate_and_advance(i, n, kaddr + offset,
 					copy_to_user_iter_nofault,
@@ -399,10 +411,8 @@ size_t copy_page_to_iter_nofault(struct page *page, unsigned offset, size_t byte
 		if (!bytes || !n)
 			break;
 		offset += n;
-		if (offset == PAGE_SIZE) {
-			page++;
-			offset = 0;
-		}
+		page += offset / PAGE_SIZE;
+		offset %= PAGE_SIZE;
 	}
 	return res;
 }
@@ -418,7 +428,7 @@ size_t copy_page_from_iter(struct page *page, size_t offset, size_t bytes,
 	offset %= PAGE_SIZE;
 	while (1) {
 		void *kaddr = kmap_local_page(page);
-		size_t n = min(bytes, (size_t)PAGE_SIZE - offset);
+		size_t n = page_copy_chunk(page, offset, bytes);
 		n = _copy_from_iter(kaddr + offset, n, i);
 		kunmap_local(kaddr);
 		res += n;
@@ -426,10 +436,8 @@ size_t copy_page_from_iter(struct page *page, size_t offset, size_t bytes,
 		if (!bytes || !n)
 			break;
 		offset += n;
-		if (offset == PAGE_SIZE) {
-			page++;
-			offset = 0;
-		}
+		page += offset / PAGE_SIZE;
+		offset %= PAGE_SIZE;
 	}
 	return res;
 }
@@ -6431,6 +6431,413 @@ int mtree_dup(struct maple_tree *mt, struct maple_tree *new, gfp_t gfp)
 }
 EXPORT_SYMBOL(mtree_dup);
 
+/*
+ * Sorted bulk construction.
+ *
+ * The input ranges are expanded into the sequence of slots the tree would
+ * hold, with a NULL range covering every hole and the space after the last
+ * entry, and packed into leaves from left to right.  Leaves are planned one
+ * slot short of full so that a leaf which would end on a NULL can take the
+ * following entry as well; no leaf other than the last ends on a NULL and no
+ * leaf drops below half full.  Parent levels are then built bottom up, each
+ * node taking an even share of the children below it, until a single root
+ * remains.  Every node is allocated before any of them is written, so a
+ * failed build never leaves anything to unwind.
+ */
+struct mt_bulk_cursor {
+	const struct maple_bulk_entry *ents;
+	unsigned long nr;
+	unsigned long i;
+	unsigned long next;
+	bool done;
+};
+
+struct mt_bulk_child {
+	struct maple_enode *enode;
+	unsigned long max;
+	unsigned long gap;
+};
+
+/*
+ * mt_bulk_next() - Return the next slot of the expanded sequence.
+ * @cur: The bulk cursor
+ * @index: Set to the first index of the slot
+ * @last: Set to the last index of the slot
+ *
+ * Return: The entry for the slot, which is NULL for a hole.
+ */
+static void *mt_bulk_next(struct mt_bulk_cursor *cur, unsigned long *index,
+		unsigned long *last)
+{
+	const struct maple_bulk_entry *e;
+	void *entry = NULL;
+
+	*index = cur->next;
+	if (cur->i == cur->nr) {
+		*last = ULONG_MAX;
+		cur->done = true;
+		return NULL;
+	}
+
+	e = &cur->ents[cur->i];
+	if (cur->next < e->index) {
+		*last = e->index - 1;
+	} else {
+		*last = e->last;
+		entry = e->entry;
+		cur->i++;
+		if (e->last == ULONG_MAX)
+			cur->done = true;
+	}
+
+	cur->next = *last + 1;
+	return entry;
+}
+
+/*
+ * mt_bulk_slots() - Count the slots needed for a sorted array of ranges.
+ * @ents: The ranges
+ * @nr: The number of ranges, must be non-zero
+ *
+ * Return: The number of entries plus the number of NULL ranges between and
+ * after them.
+ */
+static unsigned long mt_bulk_slots(const struct maple_bulk_entry *ents,
+		unsigned long nr)
+{
+	unsigned long i, count = nr, next = 0;
+
+	for (i = 0; i < nr; i++) {
+		if (ents[i].index > next)
+			count++;
+		next = ents[i].last + 1;
+	}
+
+	if (ents[nr - 1].last != ULONG_MAX)
+		count++;
+
+	return count;
+}
+
+/*
+ * mt_bulk_valid() - Check the input of a bulk operation.
+ * @ents: The ranges
+ * @nr: The number of ranges
+ * @min: The lowest index a range may start at
+ * @max: The highest index a range may end at
+ *
+ * Return: true if the ranges are ascending, do not overlap, lie within
+ * [@min, @max] and only hold normal entries.
+ */
+static bool mt_bulk_valid(const struct maple_bulk_entry *ents,
+		unsigned long nr, unsigned long min, unsigned long max)
+{
+	unsigned long i;
+
+	for (i = 0; i < nr; i++) {
+		const struct maple_bulk_entry *e = &ents[i];
+
+		if (!e->entry || WARN_ON_ONCE(xa_is_advanced(e->entry)))
+			return false;
+
+		if (e->index > e->last || e->index < min || e->last > max)
+			return false;
+
+		if (i && e->index <= ents[i - 1].last)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * mt_bulk_build() - Build a detached tree holding @ents.
+ * @mt: The maple tree the nodes are built for
+ * @ents: The ranges, already validated
+ * @nr: The number of ranges, must be non-zero
+ * @height: Set to the height of the new tree
+ * @gfp: The GFP_FLAGS to use for allocations
+ *
+ * Return: The new root node, or ERR_PTR(-ENOMEM).
+ */
+static struct maple_enode *mt_bulk_build(struct maple_tree *mt,
+		const struct maple_bulk_entry *ents, unsigned long nr,
+		unsigned char *height, gfp_t gfp)
+{
+	enum maple_type ptype = mt_is_alloc(mt) ? maple_arange_64 :
+						  maple_range_64;
+	struct mt_bulk_cursor cur = { .ents = ents, .nr = nr };
+	unsigned long total, remaining, leaves, nodes, n, used = 0;
+	struct mt_bulk_child *child;
+	struct maple_enode *root;
+	struct maple_node **pool;
+	unsigned char h = 1;
+	MA_STATE(mas, mt, 0, 0);
+
+	total = mt_bulk_slots(ents, nr);
+	if (total <= mt_slots[maple_leaf_64])
+		leaves = 1;
+	else
+		leaves = DIV_ROUND_UP(total, mt_slots[maple_leaf_64] - 1);
+
+	nodes = leaves;
+	for (n = leaves; n > 1; nodes += n)
+		n = DIV_ROUND_UP(n, mt_slots[ptype]);
+
+	pool = kvmalloc_array(nodes, sizeof(*pool), gfp);
+	child = kvmalloc_array(leaves, sizeof(*child), gfp);
+	if (!pool || !child)
+		goto nomem;
+
+	if (!kmem_cache_alloc_bulk(maple_node_cache, gfp, nodes,
+				   (void **)pool))
+		goto nomem;
+
+	remaining = total;
+	for (n = 0; n < leaves; n++) {
+		struct maple_node *node = pool[used++];
+		unsigned long *pivots = ma_pivots(node, maple_leaf_64);
+		void __rcu **slots = ma_slots(node, maple_leaf_64);
+		unsigned long index, last, gap = 0;
+		unsigned char want, count = 0;
+		void *entry;
+
+		want = DIV_ROUND_UP(remaining, leaves - n);
+		memset(node, 0, sizeof(*node));
+		do {
+			entry = mt_bulk_next(&cur, &index, &last);
+			RCU_INIT_POINTER(slots[count], entry);
+			if (count < mt_pivots[maple_leaf_64])
+				pivots[count] = last;
+			if (!entry && last - index + 1 > gap)
+				gap = last - index + 1;
+			count++;
+		} while (count < want || (!entry && n < leaves - 1));
+
+		mas_leaf_set_meta(node, maple_leaf_64, count - 1);
+		child[n].enode = mt_mk_node(node, maple_leaf_64);
+		child[n].max = last;
+		child[n].gap = gap;
+		remaining -= count;
+	}
+	WARN_ON_ONCE(!cur.done || remaining);
+
+	/* Parents overwrite the front of child[] once their children are read */
+	for (n = leaves; n > 1; h++) {
+		unsigned long parents = DIV_ROUND_UP(n, mt_slots[ptype]);
+		unsigned long p, c = 0;
+
+		for (p = 0; p < parents; p++) {
+			struct maple_node *node = pool[used++];
+			struct maple_enode *enode = mt_mk_node(node, ptype);
+			unsigned long *pivots = ma_pivots(node, ptype);
+			void __rcu **slots = ma_slots(node, ptype);
+			unsigned long *gaps = ma_gaps(node, ptype);
+			unsigned char want = DIV_ROUND_UP(n - c, parents - p);
+			unsigned long max = 0, max_gap = 0;
+			unsigned char offset, gap_offset = 0;
+
+			memset(node, 0, sizeof(*node));
+			for (offset = 0; offset < want; offset++, c++) {
+				RCU_INIT_POINTER(slots[offset], child[c].enode);
+				if (offset < mt_pivots[ptype])
+					pivots[offset] = child[c].max;
+				mas_set_parent(&mas, child[c].enode, enode, offset);
+				max = child[c].max;
+				if (!gaps)
+					continue;
+
+				gaps[offset] = child[c].gap;
+				if (child[c].gap > max_gap) {
+					max_gap = child[c].gap;
+					gap_offset = offset;
+				}
+			}
+
+			if (gaps)
+				ma_set_meta(node, ptype, gap_offset, want - 1);
+			else
+				mas_leaf_set_meta(node, ptype, want - 1);
+
+			child[p].enode = enode;
+			child[p].max = max;
+			child[p].gap = max_gap;
+		}
+		n = parents;
+	}
+
+	root = child[0].enode;
+	mte_to_node(root)->parent = ma_parent_ptr(mas_tree_parent(&mas));
+	*height = h;
+	kvfree(child);
+	kvfree(pool);
+	return root;
+
+nomem:
+	kvfree(child);
+	kvfree(pool);
+	return ERR_PTR(-ENOMEM);
+}
+
+/*
+ * mt_bulk_publish() - Replace the contents of a locked tree.
+ * @mt: The maple tree
+ * @root: The root of a tree built by mt_bulk_build()
+ * @height: The height of the new tree
+ */
+static void mt_bulk_publish(struct maple_tree *mt, struct maple_enode *root,
+		unsigned char height)
+{
+	void *old = mt_root_locked(mt);
+
+	mt_set_height(mt, height);
+	rcu_assign_pointer(mt->ma_root, mte_mk_root(root));
+	if (xa_is_node(old))
+		mte_destroy_walk(old, mt);
+}
+
+/**
+ * __mt_bulk_load() - Populate an empty maple tree from sorted ranges.
+ * @mt: The maple tree
+ * @ents: Ascending, non-overlapping ranges and their entries
+ * @nr: The number of ranges in @ents
+ * @gfp: The GFP_FLAGS to use for allocations
+ *
+ * Builds the whole tree bottom up with densely packed leaves instead of
+ * inserting the ranges one by one, so each node is written exactly once and
+ * no node is ever split.  The new tree is only made visible once it is
+ * complete.  Entries must be non-NULL and must not be advanced entries.
+ *
+ * Note that the user needs to manually lock the tree.
+ *
+ * Return: 0 on success, -ENOMEM if memory could not be allocated, -EINVAL if
+ * the tree is not empty or the ranges are invalid.
+ */
+int __mt_bulk_load(struct maple_tree *mt, const struct maple_bulk_entry *ents,
+		unsigned long nr, gfp_t gfp)
+{
+	struct maple_enode *root;
+	unsigned char height;
+
+	if (!mtree_empty(mt) || !mt_bulk_valid(ents, nr, 0, ULONG_MAX))
+		return -EINVAL;
+
+	if (!nr)
+		return 0;
+
+	root = mt_bulk_build(mt, ents, nr, &height, gfp);
+	if (IS_ERR(root))
+		return PTR_ERR(root);
+
+	mt_bulk_publish(mt, root, height);
+	return 0;
+}
+EXPORT_SYMBOL(__mt_bulk_load);
+
+/**
+ * mtree_bulk_load() - Populate an empty maple tree from sorted ranges.
+ * @mt: The maple tree
+ * @ents: Ascending, non-overlapping ranges and their entries
+ * @nr: The number of ranges in @ents
+ * @gfp: The GFP_FLAGS to use for allocations
+ *
+ * Like __mt_bulk_load(), but the nodes are built without holding the tree
+ * lock, which is only taken to publish the finished tree.
+ *
+ * Return: 0 on success, -ENOMEM if memory could not be allocated, -EINVAL if
+ * the tree is not empty or the ranges are invalid.
+ */
+int mtree_bulk_load(struct maple_tree *mt, const struct maple_bulk_entry *ents,
+		unsigned long nr, gfp_t gfp)
+{
+	struct maple_enode *root;
+	unsigned char height;
+
+	if (!mt_bulk_valid(ents, nr, 0, ULONG_MAX))
+		return -EINVAL;
+
+	if (!nr)
+		return mtree_empty(mt) ? 0 : -EINVAL;
+
+	root = mt_bulk_build(mt, ents, nr, &height, gfp);
+	if (IS_ERR(root))
+		return PTR_ERR(root);
+
+	mtree_lock(mt);
+	if (!mtree_empty(mt)) {
+		mte_destroy_walk(mte_mk_root(root), mt);
+		mtree_unlock(mt);
+		return -EINVAL;
+	}
+
+	mt_bulk_publish(mt, root, height);
+	mtree_unlock(mt);
+	return 0;
+}
+EXPORT_SYMBOL(mtree_bulk_load);
+
+/**
+ * mtree_store_ranges() - Replace a span of a maple tree with sorted ranges.
+ * @mt: The maple tree
+ * @first: The first index of the span
+ * @last: The last index of the span
+ * @ents: Ascending, non-overlapping ranges within [@first, @last]
+ * @nr: The number of ranges in @ents
+ * @gfp: The GFP_FLAGS to use for allocations
+ *
+ * Everything in [@first, @last] is replaced by @ents, leaving the gaps
+ * between the ranges empty.  Replacing the whole index space builds a new
+ * tree with mtree_bulk_load()'s packing and swaps it in.  A partial span is
+ * cleared with a single spanning store and then refilled left to right with
+ * one maple state, so each range after the first is written into the node
+ * the previous store left the state in instead of walking down from the root.
+ * Readers may see the span partially rewritten.
+ *
+ * Return: 0 on success, -ENOMEM if memory could not be allocated, -EINVAL on
+ * invalid request.
+ */
+int mtree_store_ranges(struct maple_tree *mt, unsigned long first,
+		unsigned long last, const struct maple_bulk_entry *ents,
+		unsigned long nr, gfp_t gfp)
+{
+	MA_STATE(mas, mt, first, last);
+	struct maple_enode *root;
+	unsigned char height;
+	unsigned long i;
+	int ret;
+
+	trace_ma_write(TP_FCT, &mas, nr, NULL);
+	if (first > last || !mt_bulk_valid(ents, nr, first, last))
+		return -EINVAL;
+
+	if (!first && last == ULONG_MAX && nr) {
+		root = mt_bulk_build(mt, ents, nr, &height, gfp);
+		if (IS_ERR(root))
+			return PTR_ERR(root);
+
+		mtree_lock(mt);
+		mt_bulk_publish(mt, root, height);
+		mtree_unlock(mt);
+		return 0;
+	}
+
+	mtree_lock(mt);
+	ret = mas_store_gfp(&mas, NULL, gfp);
+	for (i = 0; !ret && i < nr; i++) {
+		/*
+		 * The ranges ascend, so the write setup only needs to walk
+		 * again once a range ends beyond the node the state is in.
+		 */
+		mas.index = ents[i].index;
+		mas.last = ents[i].last;
+		ret = mas_store_gfp(&mas, ents[i].entry, gfp);
+	}
+	mtree_unlock(mt);
+
+	return ret;
+}
+EXPORT_SYMBOL(mtree_store_ranges);
+
 /**
  * __mt_destroy() - Walk and free all nodes of a locked maple tree.
  * @mt: The maple tree
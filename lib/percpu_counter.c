@@ -9,6 +9,7 @@
 #include <linux/cpu.h>
 #include <linux/module.h>
 #include <linux/debugobjects.h>
+#include <linux/slab.h>
 
 #ifdef CONFIG_HOTPLUG_CPU
 static LIST_HEAD(percpu_counters);
@@ -252,6 +253,183 @@ void percpu_counter_destroy_many(struct percpu_counter *fbc, u32 nr_counters)
 }
 EXPORT_SYMBOL(percpu_counter_destroy_many);
 
+#ifdef CONFIG_NUMA
+/*
+ * Per-node layer of a percpu_counter_numa. Lock nesting is fbc->lock, then
+ * node->lock. A cpu's s32 delta is only changed by the cpu itself, with
+ * interrupts disabled and under its node's lock, or by the hotplug code
+ * under fbc->lock once the cpu is dead.
+ */
+struct percpu_counter_node {
+	raw_spinlock_t lock;
+	s64 count;
+	s64 nr_cpus;		/* spill to fbc->count at batch * nr_cpus */
+};
+
+static struct lock_class_key percpu_counter_node_key;
+
+static void percpu_counter_free_nodes(struct percpu_counter_node **nodes)
+{
+	int nid;
+
+	if (!nodes)
+		return;
+
+	for_each_node(nid)
+		kfree(nodes[nid]);
+	kfree(nodes);
+}
+
+int __percpu_counter_numa_init(struct percpu_counter_numa *pcn, s64 amount,
+			       gfp_t gfp, struct lock_class_key *key)
+{
+	struct percpu_counter_node **nodes;
+	int nid, ret;
+
+	pcn->nodes = NULL;
+	ret = __percpu_counter_init_many(&pcn->fbc, amount, gfp, 1, key);
+	if (ret)
+		return ret;
+
+	/* Nothing to gain from an extra layer with a single node */
+	if (num_possible_nodes() <= 1)
+		return 0;
+
+	nodes = kcalloc(nr_node_ids, sizeof(*nodes), gfp);
+	if (!nodes)
+		goto err;
+
+	for_each_node(nid) {
+		struct percpu_counter_node *node;
+
+		node = kzalloc_node(sizeof(*node), gfp, nid);
+		if (!node)
+			goto err;
+
+		raw_spin_lock_init(&node->lock);
+		lockdep_set_class(&node->lock, &percpu_counter_node_key);
+		node->nr_cpus = max(1U, nr_cpus_node(nid));
+		nodes[nid] = node;
+	}
+
+	pcn->nodes = nodes;
+	return 0;
+err:
+	percpu_counter_free_nodes(nodes);
+	percpu_counter_destroy(&pcn->fbc);
+	return -ENOMEM;
+}
+EXPORT_SYMBOL(__percpu_counter_numa_init);
+
+void percpu_counter_numa_destroy(struct percpu_counter_numa *pcn)
+{
+	percpu_counter_destroy(&pcn->fbc);
+	percpu_counter_free_nodes(pcn->nodes);
+	pcn->nodes = NULL;
+}
+EXPORT_SYMBOL(percpu_counter_numa_destroy);
+
+/*
+ * Move this cpu's delta plus @amount into its node, and the node's count
+ * into fbc->count if that has grown past what all of its cpus could hold.
+ * Only the second step takes fbc->lock. Called with interrupts disabled.
+ */
+static void percpu_counter_numa_fold(struct percpu_counter_numa *pcn,
+				     s64 amount, s32 batch)
+{
+	struct percpu_counter_node *node = pcn->nodes[numa_node_id()];
+	struct percpu_counter *fbc = &pcn->fbc;
+	bool spill;
+	s64 count;
+
+	raw_spin_lock(&node->lock);
+	count = __this_cpu_read(*fbc->counters);
+	node->count += count + amount;
+	__this_cpu_sub(*fbc->counters, count);
+	spill = abs(node->count) >= (s64)batch * node->nr_cpus;
+	raw_spin_unlock(&node->lock);
+
+	if (spill) {
+		raw_spin_lock(&fbc->lock);
+		raw_spin_lock(&node->lock);
+		fbc->count += node->count;
+		node->count = 0;
+		raw_spin_unlock(&node->lock);
+		raw_spin_unlock(&fbc->lock);
+	}
+}
+
+void percpu_counter_numa_add_batch(struct percpu_counter_numa *pcn,
+				   s64 amount, s32 batch)
+{
+	unsigned long flags;
+	s64 count;
+
+	if (!pcn->nodes) {
+		percpu_counter_add_batch(&pcn->fbc, amount, batch);
+		return;
+	}
+
+	local_irq_save(flags);
+	count = __this_cpu_read(*pcn->fbc.counters) + amount;
+	if (abs(count) >= batch)
+		percpu_counter_numa_fold(pcn, amount, batch);
+	else
+		this_cpu_add(*pcn->fbc.counters, amount);
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(percpu_counter_numa_add_batch);
+
+/*
+ * The nodes are read locklessly, so a concurrent spill can be seen twice
+ * or not at all; like the per-cpu deltas, that is within the usual error
+ * of percpu_counter_read().
+ */
+s64 __percpu_counter_numa_read(struct percpu_counter_numa *pcn)
+{
+	s64 ret = READ_ONCE(pcn->fbc.count);
+	int nid;
+
+	for_each_node(nid)
+		ret += READ_ONCE(pcn->nodes[nid]->count);
+	return ret;
+}
+EXPORT_SYMBOL(__percpu_counter_numa_read);
+
+s64 percpu_counter_numa_sum(struct percpu_counter_numa *pcn)
+{
+	struct percpu_counter *fbc = &pcn->fbc;
+	unsigned long flags;
+	int nid, cpu;
+	s64 ret;
+
+	if (!pcn->nodes)
+		return percpu_counter_sum(fbc);
+
+	raw_spin_lock_irqsave(&fbc->lock, flags);
+	ret = fbc->count;
+	/*
+	 * Each node's count and the deltas of its cpus have to be read under
+	 * one hold of the node lock, or a fold in between would be counted
+	 * twice or missed.
+	 */
+	for_each_node(nid) {
+		struct percpu_counter_node *node = pcn->nodes[nid];
+
+		raw_spin_lock(&node->lock);
+		ret += node->count;
+		for_each_cpu_or(cpu, cpu_online_mask, cpu_dying_mask) {
+			if (cpu_to_node(cpu) == nid)
+				ret += *per_cpu_ptr(fbc->counters, cpu);
+		}
+		raw_spin_unlock(&node->lock);
+	}
+	raw_spin_unlock_irqrestore(&fbc->lock, flags);
+	return ret;
+}
+EXPORT_SYMBOL(percpu_counter_numa_sum);
+#endif	/* CONFIG_NUMA */
+
 int percpu_counter_batch __read_mostly = 32;
 EXPORT_SYMBOL(percpu_counter_batch);
 
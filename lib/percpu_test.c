@@ -1,6 +1,12 @@
 // SPDX-License-Identifier: GPL-2.0-only
+#include <linux/completion.h>
+#include <linux/cpu.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
 #include <linux/limits.h>
 #include <linux/module.h>
+#include <linux/percpu_counter.h>
+#include <linux/slab.h>
 
 /* validate @native and @pcp counter values match @expected */
 #define CHECK(native, pcp, expected)                                    \
@@ -18,6 +24,134 @@
 static DEFINE_PER_CPU(long, long_counter);
 static DEFINE_PER_CPU(unsigned long, ulong_counter);
 
+#define COUNTER_BENCH_ITERS	(1 << 20)
+
+/*
+ * Without @numa, only @pcn->fbc is set up and used as a plain
+ * percpu_counter.
+ */
+struct counter_bench {
+	struct percpu_counter_numa *pcn;
+	bool numa;
+	atomic_t running;
+	struct completion start, done;
+};
+
+static s64 counter_bench_read(struct counter_bench *bench)
+{
+	if (bench->numa)
+		return percpu_counter_numa_read(bench->pcn);
+	return percpu_counter_read(&bench->pcn->fbc);
+}
+
+static s64 counter_bench_sum(struct counter_bench *bench)
+{
+	if (bench->numa)
+		return percpu_counter_numa_sum(bench->pcn);
+	return percpu_counter_sum(&bench->pcn->fbc);
+}
+
+static int counter_bench_thread(void *arg)
+{
+	struct counter_bench *bench = arg;
+	s64 amount;
+	int i;
+
+	wait_for_completion(&bench->start);
+	for (i = 0; i < COUNTER_BENCH_ITERS; i++) {
+		amount = (i & 1) ? 3 : -1;
+		if (bench->numa)
+			percpu_counter_numa_add(bench->pcn, amount);
+		else
+			percpu_counter_add(&bench->pcn->fbc, amount);
+	}
+
+	if (atomic_dec_and_test(&bench->running))
+		complete(&bench->done);
+	return 0;
+}
+
+/*
+ * Hammer @pcn from every online cpu and check that no update was lost.
+ * Returns the time taken, or 0 if the threads couldn't be started.
+ */
+static u64 __init counter_bench_run(struct percpu_counter_numa *pcn, bool numa)
+{
+	struct counter_bench bench = { .pcn = pcn, .numa = numa };
+	struct task_struct *tsk;
+	unsigned int cpu, nr = 0;
+	s64 expected;
+	ktime_t t0;
+
+	init_completion(&bench.start);
+	init_completion(&bench.done);
+	atomic_set(&bench.running, 1);
+
+	cpus_read_lock();
+	for_each_online_cpu(cpu) {
+		tsk = kthread_run_on_cpu(counter_bench_thread, &bench, cpu,
+					 "percpu_bench/%u");
+		if (IS_ERR(tsk))
+			continue;
+		atomic_inc(&bench.running);
+		nr++;
+	}
+	cpus_read_unlock();
+
+	t0 = ktime_get();
+	complete_all(&bench.start);
+	if (!atomic_dec_and_test(&bench.running))
+		wait_for_completion(&bench.done);
+	t0 = ktime_sub(ktime_get(), t0);
+
+	/* Every pair of iterations adds 2 */
+	expected = (s64)nr * COUNTER_BENCH_ITERS;
+	WARN(counter_bench_sum(&bench) != expected,
+	     "percpu_counter sum %lld != expected %lld\n",
+	     counter_bench_sum(&bench), expected);
+	WARN(abs(counter_bench_read(&bench) - expected) >
+	     (s64)percpu_counter_batch * num_online_cpus(),
+	     "percpu_counter read %lld too far from %lld\n",
+	     counter_bench_read(&bench), expected);
+
+	return nr ? ktime_to_us(t0) : 0;
+}
+
+/* Compare a flat percpu_counter against a percpu_counter_numa */
+static void __init percpu_counter_bench(void)
+{
+	struct percpu_counter_numa pcn;
+	ktime_t t0, read, sum;
+	u64 flat, numa;
+	int i;
+
+	if (percpu_counter_init(&pcn.fbc, 0, GFP_KERNEL))
+		return;
+	flat = counter_bench_run(&pcn, false);
+	percpu_counter_destroy(&pcn.fbc);
+
+	if (percpu_counter_numa_init(&pcn, 0, GFP_KERNEL))
+		return;
+	numa = counter_bench_run(&pcn, true);
+
+	/* The approximate read walks the nodes, not the cpus */
+	t0 = ktime_get();
+	for (i = 0; i < 1000; i++)
+		percpu_counter_numa_read(&pcn);
+	read = ktime_sub(ktime_get(), t0);
+
+	t0 = ktime_get();
+	for (i = 0; i < 1000; i++)
+		percpu_counter_numa_sum(&pcn);
+	sum = ktime_sub(ktime_get(), t0);
+	percpu_counter_numa_destroy(&pcn);
+
+	pr_info("percpu_counter: %u cpus, %u nodes, %u adds each: flat %lluus, numa %lluus; numa read %lluns, sum %lluns\n",
+		num_online_cpus(), num_online_nodes(), COUNTER_BENCH_ITERS,
+		flat, numa, div_u64(ktime_to_ns(read), 1000),
+		div_u64(ktime_to_ns(sum), 1000));
+}
+
 static int __init percpu_test_init(void)
 {
 	/*
@@ -132,6 +266,8 @@ static int __init percpu_test_init(void)
 
 	preempt_enable();
 
+	percpu_counter_bench();
+
 	pr_info("percpu test done\n");
 	return -EAGAIN;  /* Fail will directly unload the module */
 }
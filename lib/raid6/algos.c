@@ -25,6 +25,8 @@ EXPORT_SYMBOL_GPL(raid6_call);
 
 const struct raid6_calls * const raid6_algos[] = {
 #if defined(__i386__) && !defined(__arch_um__)
+	&raid6_gfnix2,
+	&raid6_gfnix1,
 	&raid6_avx512x2,
 	&raid6_avx512x1,
 	&raid6_avx2x2,
@@ -37,6 +39,9 @@ const struct raid6_calls * const raid6_algos[] = {
 	&raid6_mmxx1,
 #endif
 #if defined(__x86_64__) && !defined(__arch_um__)
+	&raid6_gfnix4,
+	&raid6_gfnix2,
+	&raid6_gfnix1,
 	&raid6_avx512x4,
 	&raid6_avx512x2,
 	&raid6_avx512x1,
@@ -95,6 +100,7 @@ EXPORT_SYMBOL_GPL(raid6_datap_recov);
 
 const struct raid6_recov_calls *const raid6_recov_algos[] = {
 #ifdef CONFIG_X86
+	&raid6_recov_gfni,
 	&raid6_recov_avx512,
 	&raid6_recov_avx2,
 	&raid6_recov_ssse3,
@@ -50,6 +50,24 @@ static uint8_t gfpow(uint8_t a, int b)
 	return v;
 }
 
+/*
+ * Bit matrix for GF2P8AFFINEQB multiplying a byte by the constant c.
+ * Byte 7 - i of the matrix selects the input bits that make up bit i
+ * of the product.
+ */
+static uint64_t gfaffine(uint8_t c)
+{
+	uint64_t m = 0;
+	int i, j;
+
+	for (i = 0; i < 8; i++)
+		for (j = 0; j < 8; j++)
+			if (gfmul(c, 1 << j) & (1 << i))
+				m |= (uint64_t)1 << ((7 - i) * 8 + j);
+
+	return m;
+}
+
 int main(int argc, char *argv[])
 {
 	int i, j, k;
@@ -173,5 +191,19 @@ int main(int argc, char *argv[])
 	printf("EXPORT_SYMBOL(raid6_gfexi);\n");
 	printf("#endif\n");
 
+	/* Compute affine transform matrices for GFNI multiplication */
+	printf("\nconst u64 __attribute__((aligned(256)))\n"
+	       "raid6_gfaffine[256] =\n" "{\n");
+	for (i = 0; i < 256; i += 4) {
+		printf("\t");
+		for (j = 0; j < 4; j++)
+			printf("0x%016" PRIx64 "ULL,%c", gfaffine(i + j),
+			       (j == 3) ? '\n' : ' ');
+	}
+	printf("};\n");
+	printf("#ifdef __KERNEL__\n");
+	printf("EXPORT_SYMBOL(raid6_gfaffine);\n");
+	printf("#endif\n");
+
 	return 0;
 }
@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * RAID-6 data recovery using GFNI affine transforms
+ *
+ * Based on recov_avx512.c: Copyright (C) 2016 Intel Corporation
+ *
+ * Each constant multiply in the recovery equations is a single
+ * GF2P8AFFINEQB with the matrix for that constant, instead of the
+ * split-nibble table lookups of the SSSE3/AVX2/AVX512 versions.
+ */
+
+#include <linux/raid/pq.h>
+#include "x86.h"
+
+static int raid6_has_gfni(void)
+{
+	return boot_cpu_has(X86_FEATURE_GFNI) &&
+		boot_cpu_has(X86_FEATURE_AVX512F) &&
+		boot_cpu_has(X86_FEATURE_AVX512BW);
+}
+
+static void raid6_2data_recov_gfni(int disks, size_t bytes, int faila,
+				   int failb, void **ptrs)
+{
+	u8 *p, *q, *dp, *dq;
+	const u64 *pbmul;	/* P multiplier matrix for B data */
+	const u64 *qmul;	/* Q multiplier matrix (for both) */
+
+	p = (u8 *)ptrs[disks-2];
+	q = (u8 *)ptrs[disks-1];
+
+	/*
+	 * Compute syndrome with zero for the missing data pages
+	 * Use the dead data pages as temporary storage for
+	 * delta p and delta q
+	 */
+
+	dp = (u8 *)ptrs[faila];
+	ptrs[faila] = raid6_get_zero_page();
+	ptrs[disks-2] = dp;
+	dq = (u8 *)ptrs[failb];
+	ptrs[failb] = raid6_get_zero_page();
+	ptrs[disks-1] = dq;
+
+	raid6_call.gen_syndrome(disks, bytes, ptrs);
+
+	/* Restore pointer table */
+	ptrs[faila]   = dp;
+	ptrs[failb]   = dq;
+	ptrs[disks-2] = p;
+	ptrs[disks-1] = q;
+
+	/* Now, pick the proper matrices */
+	pbmul = &raid6_gfaffine[raid6_gfexi[failb-faila]];
+	qmul  = &raid6_gfaffine[raid6_gfinv[raid6_gfexp[faila] ^
+		raid6_gfexp[failb]]];
+
+	kernel_fpu_begin();
+
+	/* zmm6 = qmul, zmm7 = pbmul */
+	asm volatile("vpbroadcastq %0, %%zmm6\n\t"
+		     "vpbroadcastq %1, %%zmm7"
+		     :
+		     : "m" (*qmul), "m" (*pbmul));
+
+	while (bytes) {
+		asm volatile("vmovdqa64 %0, %%zmm2\n\t"
+			     "vmovdqa64 %1, %%zmm3\n\t"
+			     "vmovdqa64 %2, %%zmm0\n\t"
+			     "vmovdqa64 %3, %%zmm1\n\t"
+			     "vpxorq %4, %%zmm2, %%zmm2\n\t"
+			     "vpxorq %5, %%zmm3, %%zmm3\n\t"
+			     "vpxorq %6, %%zmm0, %%zmm0\n\t"
+			     "vpxorq %7, %%zmm1, %%zmm1"
+			     :
+			     : "m" (q[0]), "m" (q[64]), "m" (p[0]),
+			       "m" (p[64]), "m" (dq[0]), "m" (dq[64]),
+			       "m" (dp[0]), "m" (dp[64]));
+
+		/*
+		 * 2 = dq[0]  ^ q[0]
+		 * 3 = dq[64] ^ q[64]
+		 * 0 = dp[0]  ^ p[0]
+		 * 1 = dp[64] ^ p[64]
+		 */
+
+		asm volatile("vgf2p8affineqb $0, %%zmm6, %%zmm2, %%zmm2\n\t"
+			     "vgf2p8affineqb $0, %%zmm6, %%zmm3, %%zmm3\n\t"
+			     "vgf2p8affineqb $0, %%zmm7, %%zmm0, %%zmm4\n\t"
+			     "vgf2p8affineqb $0, %%zmm7, %%zmm1, %%zmm5\n\t"
+			     "vpxorq %%zmm4, %%zmm2, %%zmm2\n\t"
+			     "vpxorq %%zmm5, %%zmm3, %%zmm3"
+			     :
+			     : );
+
+		/*
+		 * 2 = db[0]  = qmul[dq[0]  ^ q[0]]  ^ pbmul[px[0]]
+		 * 3 = db[64] = qmul[dq[64] ^ q[64]] ^ pbmul[px[64]]
+		 */
+		asm volatile("vmovdqa64 %%zmm2, %0\n\t"
+			     "vmovdqa64 %%zmm3, %1\n\t"
+			     "vpxorq %%zmm2, %%zmm0, %%zmm0\n\t"
+			     "vpxorq %%zmm3, %%zmm1, %%zmm1\n\t"
+			     "vmovdqa64 %%zmm0, %2\n\t"
+			     "vmovdqa64 %%zmm1, %3"
+			     :
+			     : "m" (dq[0]), "m" (dq[64]), "m" (dp[0]),
+			       "m" (dp[64]));
+
+		bytes -= 128;
+		p += 128;
+		q += 128;
+		dp += 128;
+		dq += 128;
+	}
+
+	kernel_fpu_end();
+}
+
+static void raid6_datap_recov_gfni(int disks, size_t bytes, int faila,
+				   void **ptrs)
+{
+	u8 *p, *q, *dq;
+	const u64 *qmul;	/* Q multiplier matrix */
+
+	p = (u8 *)ptrs[disks-2];
+	q = (u8 *)ptrs[disks-1];
+
+	/*
+	 * Compute syndrome with zero for the missing data page
+	 * Use the dead data page as temporary storage for delta q
+	 */
+
+	dq = (u8 *)ptrs[faila];
+	ptrs[faila] = raid6_get_zero_page();
+	ptrs[disks-1] = dq;
+
+	raid6_call.gen_syndrome(disks, bytes, ptrs);
+
+	/* Restore pointer table */
+	ptrs[faila]   = dq;
+	ptrs[disks-1] = q;
+
+	/* Now, pick the proper matrix */
+	qmul  = &raid6_gfaffine[raid6_gfinv[raid6_gfexp[faila]]];
+
+	kernel_fpu_begin();
+
+	asm volatile("vpbroadcastq %0, %%zmm7" : : "m" (*qmul));
+
+	while (bytes) {
+		asm volatile("vmovdqa64 %0, %%zmm0\n\t"
+			     "vmovdqa64 %1, %%zmm1\n\t"
+			     "vpxorq %2, %%zmm0, %%zmm0\n\t"
+			     "vpxorq %3, %%zmm1, %%zmm1\n\t"
+			     "vgf2p8affineqb $0, %%zmm7, %%zmm0, %%zmm0\n\t"
+			     "vgf2p8affineqb $0, %%zmm7, %%zmm1, %%zmm1"
+			     :
+			     : "m" (dq[0]), "m" (dq[64]), "m" (q[0]),
+			       "m" (q[64]));
+
+		/*
+		 * 0 = qmul[q[0]  ^ dq[0]]
+		 * 1 = qmul[q[64] ^ dq[64]]
+		 */
+		asm volatile("vmovdqa64 %0, %%zmm2\n\t"
+			     "vmovdqa64 %1, %%zmm3\n\t"
+			     "vpxorq %%zmm0, %%zmm2, %%zmm2\n\t"
+			     "vpxorq %%zmm1, %%zmm3, %%zmm3"
+			     :
+			     : "m" (p[0]), "m" (p[64]));
+
+		/*
+		 * 2 = p[0]  ^ qmul[q[0]  ^ dq[0]]
+		 * 3 = p[64] ^ qmul[q[64] ^ dq[64]]
+		 */
+		asm volatile("vmovdqa64 %%zmm0, %0\n\t"
+			     "vmovdqa64 %%zmm1, %1\n\t"
+			     "vmovdqa64 %%zmm2, %2\n\t"
+			     "vmovdqa64 %%zmm3, %3"
+			     :
+			     : "m" (dq[0]), "m" (dq[64]), "m" (p[0]),
+			       "m" (p[64]));
+
+		bytes -= 128;
+		p += 128;
+		q += 128;
+		dq += 128;
+	}
+
+	kernel_fpu_end();
+}
+
+const struct raid6_recov_calls raid6_recov_gfni = {
+	.data2 = raid6_2data_recov_gfni,
+	.datap = raid6_datap_recov_gfni,
+	.valid = raid6_has_gfni,
+	.name = "gfnix2",
+	.priority = 4,
+};
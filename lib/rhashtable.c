@@ -25,10 +25,26 @@
 #include <linux/rhashtable.h>
 #include <linux/err.h>
 #include <linux/export.h>
+#include <linux/ktime.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/rhashtable.h>
 
 #define HASH_DEFAULT_SIZE	64UL
 #define HASH_MIN_SIZE		4U
 
+/*
+ * Rehashing is split into ranges of buckets claimed from the old table.
+ * Tables with at least RHT_REHASH_PER_WORKER buckets per online cpu are
+ * rehashed by that many workers, and inserters that run into a resize
+ * move RHT_REHASH_HELP_CHUNK buckets before they go on.
+ */
+#define RHT_REHASH_CHUNK	256U
+#define RHT_REHASH_HELP_CHUNK	16U
+#define RHT_REHASH_PER_WORKER	16384U
+
+EXPORT_TRACEPOINT_SYMBOL_GPL(rhashtable_rehash);
+
 union nested_table {
 	union nested_table __rcu *table;
 	struct rhash_lock_head __rcu *bucket;
@@ -226,10 +242,10 @@ static struct bucket_table *rhashtable_last_table(struct rhashtable *ht,
 }
 
 static int rhashtable_rehash_one(struct rhashtable *ht,
+				 struct bucket_table *old_tbl,
 				 struct rhash_lock_head __rcu **bkt,
 				 unsigned int old_hash)
 {
-	struct bucket_table *old_tbl = rht_dereference(ht->tbl, ht);
 	struct bucket_table *new_tbl = rhashtable_last_table(ht, old_tbl);
 	int err = -EAGAIN;
 	struct rhash_head *head, *next, *entry;
@@ -278,9 +294,9 @@ static int rhashtable_rehash_one(struct rhashtable *ht,
 }
 
 static int rhashtable_rehash_chain(struct rhashtable *ht,
-				    unsigned int old_hash)
+				   struct bucket_table *old_tbl,
+				   unsigned int old_hash)
 {
-	struct bucket_table *old_tbl = rht_dereference(ht->tbl, ht);
 	struct rhash_lock_head __rcu **bkt = rht_bucket_var(old_tbl, old_hash);
 	unsigned long flags;
 	int err;
@@ -289,7 +305,7 @@ static int rhashtable_rehash_chain(struct rhashtable *ht,
 		return 0;
 	flags = rht_lock(old_tbl, bkt);
 
-	while (!(err = rhashtable_rehash_one(ht, bkt, old_hash)))
+	while (!(err = rhashtable_rehash_one(ht, old_tbl, bkt, old_hash)))
 		;
 
 	if (err == -ENOENT)
@@ -313,31 +329,149 @@ static int rhashtable_rehash_attach(struct rhashtable *ht,
 		    new_tbl) != NULL)
 		return -EEXIST;
 
+	old_tbl->rehash_start = ktime_get_ns();
+
 	return 0;
 }
 
+/*
+ * Claim the next @chunk buckets of @old_tbl and move their entries to the
+ * newest table.  Any bucket that cannot be moved marks the table for a
+ * serial pass by the deferred worker.  Returns the number of buckets
+ * claimed, zero once all of them have been handed out.
+ */
+static unsigned int rhashtable_rehash_claim(struct rhashtable *ht,
+					    struct bucket_table *old_tbl,
+					    unsigned int chunk)
+{
+	unsigned int start, end, hash;
+
+	if ((unsigned int)atomic_read(&old_tbl->rehash_next) >= old_tbl->size)
+		return 0;
+
+	start = atomic_fetch_add(chunk, &old_tbl->rehash_next);
+	if (start >= old_tbl->size)
+		return 0;
+	end = min(start + chunk, old_tbl->size);
+
+	rcu_read_lock();
+	for (hash = start; hash < end; hash++) {
+		if (rhashtable_rehash_chain(ht, old_tbl, hash))
+			WRITE_ONCE(old_tbl->rehash_failed, true);
+	}
+	rcu_read_unlock();
+
+	atomic_add(end - start, &old_tbl->rehash_done);
+
+	return end - start;
+}
+
+/*
+ * Inserters that find a resize in progress move a small range of buckets
+ * themselves, so the window in which every miss has to search two tables
+ * closes sooner.
+ */
+static void rhashtable_rehash_help(struct rhashtable *ht,
+				   struct bucket_table *tbl)
+{
+	unsigned int moved;
+
+	/* Moving into a nested table fails, leave it to the worker. */
+	if (rhashtable_last_table(ht, tbl)->nest)
+		return;
+
+	moved = rhashtable_rehash_claim(ht, tbl, RHT_REHASH_HELP_CHUNK);
+	if (moved)
+		atomic_add(moved, &tbl->rehash_helped);
+}
+
+struct rht_rehash_worker {
+	struct work_struct work;
+	struct rhashtable *ht;
+	struct bucket_table *old_tbl;
+};
+
+static void rht_rehash_workfn(struct work_struct *work)
+{
+	struct rht_rehash_worker *w =
+		container_of(work, struct rht_rehash_worker, work);
+
+	while (rhashtable_rehash_claim(w->ht, w->old_tbl, RHT_REHASH_CHUNK))
+		cond_resched();
+}
+
+/*
+ * Move all buckets of @old_tbl, spreading large tables over unbound
+ * workers.  Returns the number of threads that took part, including the
+ * caller.
+ */
+static unsigned int rhashtable_rehash_parallel(struct rhashtable *ht,
+					       struct bucket_table *old_tbl)
+{
+	struct rht_rehash_worker *workers = NULL;
+	unsigned int i, nr;
+
+	nr = min(num_online_cpus(), old_tbl->size / RHT_REHASH_PER_WORKER);
+	if (nr > 1)
+		workers = kcalloc(nr - 1, sizeof(*workers),
+				  GFP_KERNEL | __GFP_NOWARN);
+	if (!workers)
+		nr = 1;
+
+	for (i = 0; i < nr - 1; i++) {
+		workers[i].ht = ht;
+		workers[i].old_tbl = old_tbl;
+		INIT_WORK(&workers[i].work, rht_rehash_workfn);
+		queue_work(system_unbound_wq, &workers[i].work);
+	}
+
+	while (rhashtable_rehash_claim(ht, old_tbl, RHT_REHASH_CHUNK))
+		cond_resched();
+
+	for (i = 0; i < nr - 1; i++)
+		flush_work(&workers[i].work);
+	kfree(workers);
+
+	return nr;
+}
+
 static int rhashtable_rehash_table(struct rhashtable *ht)
 {
 	struct bucket_table *old_tbl = rht_dereference(ht->tbl, ht);
 	struct bucket_table *new_tbl;
 	struct rhashtable_walker *walker;
-	unsigned int old_hash;
+	unsigned int old_hash, workers;
 	int err;
 
 	new_tbl = rht_dereference(old_tbl->future_tbl, ht);
 	if (!new_tbl)
 		return 0;
 
-	for (old_hash = 0; old_hash < old_tbl->size; old_hash++) {
-		err = rhashtable_rehash_chain(ht, old_hash);
-		if (err)
-			return err;
+	workers = rhashtable_rehash_parallel(ht, old_tbl);
+
+	/* Ranges claimed by inserters may still be in flight. */
+	while ((unsigned int)atomic_read(&old_tbl->rehash_done) <
+	       old_tbl->size)
 		cond_resched();
+
+	if (READ_ONCE(old_tbl->rehash_failed)) {
+		for (old_hash = 0; old_hash < old_tbl->size; old_hash++) {
+			err = rhashtable_rehash_chain(ht, old_tbl, old_hash);
+			if (err)
+				return err;
+			cond_resched();
+		}
 	}
 
 	/* Publish the new table pointer. */
 	rcu_assign_pointer(ht->tbl, new_tbl);
 
+	trace_rhashtable_rehash(ht, old_tbl->size, new_tbl->size,
+				atomic_read(&ht->nelems),
+				ktime_get_ns() - old_tbl->rehash_start,
+				workers, atomic_read(&old_tbl->rehash_helped),
+				atomic_long_read(&old_tbl->double_probes));
+
 	spin_lock(&ht->lock);
 	list_for_each_entry(walker, &old_tbl->walkers, list)
 		walker->tbl = NULL;
@@ -598,6 +732,8 @@ static void *rhashtable_try_insert(struct rhashtable *ht, const void *key,
 	void *data;
 
 	new_tbl = rcu_dereference(ht->tbl);
+	if (unlikely(rcu_access_pointer(new_tbl->future_tbl)))
+		rhashtable_rehash_help(ht, new_tbl);
 
 	do {
 		tbl = new_tbl;
@@ -26,6 +26,56 @@ static int init_alloc_hint(struct sbitmap *sb, gfp_t flags)
 	return 0;
 }
 
+/*
+ * For a NUMA-aware map, return the range of words [*lo, *hi) owned by the
+ * node of @cpu.  Returns false, with the range set to the whole map, for a
+ * flat map or if the map was resized below the node's words.
+ */
+static inline bool sbitmap_node_range(const struct sbitmap *sb, int cpu,
+				      unsigned int *lo, unsigned int *hi)
+{
+	struct sbitmap_numa *numa = __sbitmap_numa(sb);
+	unsigned int slot;
+
+	*lo = 0;
+	*hi = sb->map_nr;
+	if (likely(!numa))
+		return false;
+
+	slot = numa->node_slot[cpu_to_node(cpu)];
+	if ((slot << numa->node_shift) >= sb->map_nr)
+		return false;
+
+	*lo = slot << numa->node_shift;
+	*hi = min(sb->map_nr, *lo + (1U << numa->node_shift));
+	return true;
+}
+
+/*
+ * A fallback allocation may leave a CPU's hint pointing at another node's
+ * words.  Start from the hint of its own node instead, so the search begins
+ * on local cachelines.
+ */
+static unsigned int sbitmap_local_hint(struct sbitmap *sb, unsigned int hint,
+				       unsigned int depth)
+{
+	unsigned int lo, hi, index = SB_NR_TO_INDEX(sb, hint);
+	struct sbitmap_numa *numa;
+
+	if (!sbitmap_node_range(sb, raw_smp_processor_id(), &lo, &hi) ||
+	    (index >= lo && index < hi))
+		return hint;
+
+	numa = __sbitmap_numa(sb);
+	hint = READ_ONCE(numa->nodes[lo >> numa->node_shift]->hint);
+	index = SB_NR_TO_INDEX(sb, hint);
+	if (hint >= depth || index < lo || index >= hi)
+		hint = lo << sb->shift;
+	this_cpu_write(*sb->alloc_hint, hint);
+
+	return hint;
+}
+
 static inline unsigned update_alloc_hint_before_get(struct sbitmap *sb,
 						    unsigned int depth)
 {
@@ -37,6 +87,9 @@ static inline unsigned update_alloc_hint_before_get(struct sbitmap *sb,
 		this_cpu_write(*sb->alloc_hint, hint);
 	}
 
+	if (unlikely(__sbitmap_numa(sb)))
+		hint = sbitmap_local_hint(sb, hint, depth);
+
 	return hint;
 }
 
@@ -98,12 +151,10 @@ static inline bool sbitmap_deferred_clear(struct sbitmap_word *map,
 	return true;
 }
 
-int sbitmap_init_node(struct sbitmap *sb, unsigned int depth, int shift,
-		      gfp_t flags, int node, bool round_robin,
-		      bool alloc_hint)
+static int __sbitmap_init(struct sbitmap *sb, unsigned int depth, int shift,
+			  gfp_t flags, bool round_robin, bool alloc_hint)
 {
 	unsigned int bits_per_word;
-	int i;
 
 	if (shift < 0)
 		shift = sbitmap_calculate_shift(depth);
@@ -116,11 +167,13 @@ int sbitmap_init_node(struct sbitmap *sb, unsigned int depth, int shift,
 	sb->depth = depth;
 	sb->map_nr = DIV_ROUND_UP(sb->depth, bits_per_word);
 	sb->round_robin = round_robin;
+	sb->map = NULL;
+#ifdef CONFIG_NUMA
+	sb->numa = NULL;
+#endif
 
-	if (depth == 0) {
-		sb->map = NULL;
+	if (depth == 0)
 		return 0;
-	}
 
 	if (alloc_hint) {
 		if (init_alloc_hint(sb, flags))
@@ -129,6 +182,19 @@ int sbitmap_init_node(struct sbitmap *sb, unsigned int depth, int shift,
 		sb->alloc_hint = NULL;
 	}
 
+	return 0;
+}
+
+int sbitmap_init_node(struct sbitmap *sb, unsigned int depth, int shift,
+		      gfp_t flags, int node, bool round_robin,
+		      bool alloc_hint)
+{
+	int i, ret;
+
+	ret = __sbitmap_init(sb, depth, shift, flags, round_robin, alloc_hint);
+	if (ret || !depth)
+		return ret;
+
 	sb->map = kvzalloc_node(sb->map_nr * sizeof(*sb->map), flags, node);
 	if (!sb->map) {
 		free_percpu(sb->alloc_hint);
@@ -142,13 +208,113 @@ int sbitmap_init_node(struct sbitmap *sb, unsigned int depth, int shift,
 }
 EXPORT_SYMBOL_GPL(sbitmap_init_node);
 
+#ifdef CONFIG_NUMA
+DEFINE_STATIC_KEY_FALSE(sbitmap_numa_key);
+EXPORT_SYMBOL_GPL(sbitmap_numa_key);
+
+void __sbitmap_free_numa(struct sbitmap *sb)
+{
+	struct sbitmap_numa *numa = sb->numa;
+	unsigned int i;
+
+	if (!numa)
+		return;
+
+	for (i = 0; i < numa->nr_nodes; i++)
+		kvfree(numa->nodes[i]);
+	kfree(numa->node_slot);
+	kfree(numa);
+	sb->numa = NULL;
+}
+EXPORT_SYMBOL_GPL(__sbitmap_free_numa);
+
+static int sbitmap_init_nodes(struct sbitmap *sb, unsigned int depth,
+			      int shift, gfp_t flags, bool round_robin,
+			      bool alloc_hint)
+{
+	unsigned int nr_cpu_nodes = num_node_state(N_CPU);
+	unsigned int node_shift, nr_nodes, slot = 0;
+	struct sbitmap_numa *numa;
+	int node, ret;
+
+	ret = __sbitmap_init(sb, depth, shift, flags, round_robin, alloc_hint);
+	if (ret || !depth)
+		return ret;
+
+	/*
+	 * Each node owns a power-of-two number of words so that finding a
+	 * word stays a shift and a mask.  If rounding up leaves fewer ranges
+	 * than nodes, the nodes without one share the ranges of the others.
+	 */
+	node_shift = order_base_2(DIV_ROUND_UP(sb->map_nr, nr_cpu_nodes));
+	nr_nodes = DIV_ROUND_UP(sb->map_nr, 1U << node_shift);
+	numa = kzalloc(struct_size(numa, nodes, nr_nodes), flags);
+	if (!numa)
+		goto fail;
+
+	numa->node_shift = node_shift;
+	numa->nr_nodes = nr_nodes;
+	sb->numa = numa;
+	numa->node_slot = kcalloc(nr_node_ids, sizeof(*numa->node_slot), flags);
+	if (!numa->node_slot)
+		goto fail;
+
+	for_each_node_state(node, N_CPU) {
+		unsigned int first = slot << node_shift;
+		struct sbitmap_node *n;
+		unsigned int i, words;
+
+		numa->node_slot[node] = slot % nr_nodes;
+		if (slot++ >= nr_nodes)
+			continue;
+
+		words = min(1U << node_shift, sb->map_nr - first);
+		n = kvzalloc_node(struct_size(n, map, words), flags, node);
+		if (!n)
+			goto fail;
+
+		n->hint = first << sb->shift;
+		for (i = 0; i < words; i++)
+			raw_spin_lock_init(&n->map[i].swap_lock);
+		numa->nodes[numa->node_slot[node]] = n;
+	}
+
+	/* Never disabled again, the lookups of other maps just check @numa */
+	static_branch_enable(&sbitmap_numa_key);
+	return 0;
+fail:
+	__sbitmap_free_numa(sb);
+	free_percpu(sb->alloc_hint);
+	return -ENOMEM;
+}
+#else
+static int sbitmap_init_nodes(struct sbitmap *sb, unsigned int depth,
+			      int shift, gfp_t flags, bool round_robin,
+			      bool alloc_hint)
+{
+	return -EINVAL;
+}
+#endif
+
+int sbitmap_init_numa(struct sbitmap *sb, unsigned int depth, int shift,
+		      gfp_t flags, bool round_robin, bool alloc_hint)
+{
+	if (!IS_ENABLED(CONFIG_NUMA) || num_node_state(N_CPU) <= 1)
+		return sbitmap_init_node(sb, depth, shift, flags, NUMA_NO_NODE,
+					 round_robin, alloc_hint);
+
+	return sbitmap_init_nodes(sb, depth, shift, flags, round_robin,
+				  alloc_hint);
+}
+EXPORT_SYMBOL_GPL(sbitmap_init_numa);
+
 void sbitmap_resize(struct sbitmap *sb, unsigned int depth)
 {
 	unsigned int bits_per_word = 1U << sb->shift;
 	unsigned int i;
 
 	for (i = 0; i < sb->map_nr; i++)
-		sbitmap_deferred_clear(&sb->map[i], 0, 0, 0);
+		sbitmap_deferred_clear(__sbitmap_map(sb, i), 0, 0, 0);
 
 	sb->depth = depth;
 	sb->map_nr = DIV_ROUND_UP(sb->depth, bits_per_word);
@@ -228,22 +394,24 @@ static unsigned int __map_depth_with_shallow(const struct sbitmap *sb,
 	return (unsigned int)shallow_word_depth;
 }
 
-static int sbitmap_find_bit(struct sbitmap *sb,
-			    unsigned int shallow_depth,
-			    unsigned int index,
-			    unsigned int alloc_hint,
-			    bool wrap)
+/* Search the words [@lo, @hi), starting at @index and wrapping around */
+static int sbitmap_find_bit_range(struct sbitmap *sb,
+				  unsigned int shallow_depth,
+				  unsigned int lo, unsigned int hi,
+				  unsigned int index,
+				  unsigned int alloc_hint,
+				  bool wrap)
 {
 	unsigned int i;
 	int nr = -1;
 
-	for (i = 0; i < sb->map_nr; i++) {
+	for (i = lo; i < hi; i++) {
 		unsigned int depth = __map_depth_with_shallow(sb, index,
 							      shallow_depth);
 
 		if (depth)
-			nr = sbitmap_find_bit_in_word(&sb->map[index], depth,
-						      alloc_hint, wrap);
+			nr = sbitmap_find_bit_in_word(__sbitmap_map(sb, index),
+						      depth, alloc_hint, wrap);
 		if (nr != -1) {
 			nr += index << sb->shift;
 			break;
@@ -251,13 +419,46 @@ static int sbitmap_find_bit(struct sbitmap *sb,
 
 		/* Jump to next index. */
 		alloc_hint = 0;
-		if (++index >= sb->map_nr)
-			index = 0;
+		if (++index >= hi)
+			index = lo;
 	}
 
 	return nr;
 }
 
+static int sbitmap_find_bit(struct sbitmap *sb,
+			    unsigned int shallow_depth,
+			    unsigned int index,
+			    unsigned int alloc_hint,
+			    bool wrap)
+{
+	unsigned int lo, hi;
+	int nr;
+
+	if (!sbitmap_node_range(sb, raw_smp_processor_id(), &lo, &hi))
+		return sbitmap_find_bit_range(sb, shallow_depth, 0, sb->map_nr,
+					      index, alloc_hint, wrap);
+
+	if (index < lo || index >= hi) {
+		index = lo;
+		alloc_hint = 0;
+	}
+
+	nr = sbitmap_find_bit_range(sb, shallow_depth, lo, hi, index,
+				    alloc_hint, wrap);
+	if (nr != -1)
+		return nr;
+
+	/* This node's words are exhausted, fall back to the other nodes */
+	if (hi < sb->map_nr)
+		nr = sbitmap_find_bit_range(sb, shallow_depth, hi, sb->map_nr,
+					    hi, 0, wrap);
+	if (nr == -1 && lo)
+		nr = sbitmap_find_bit_range(sb, shallow_depth, 0, lo, 0, 0,
+					    wrap);
+	return nr;
+}
+
 static int __sbitmap_get(struct sbitmap *sb, unsigned int alloc_hint)
 {
 	unsigned int index;
@@ -343,7 +544,9 @@ bool sbitmap_any_bit_set(const struct sbitmap *sb)
 	unsigned int i;
 
 	for (i = 0; i < sb->map_nr; i++) {
-		if (sb->map[i].word & ~sb->map[i].cleared)
+		const struct sbitmap_word *map = __sbitmap_map(sb, i);
+
+		if (map->word & ~map->cleared)
 			return true;
 	}
 	return false;
@@ -355,7 +558,7 @@ static unsigned int __sbitmap_weight(const struct sbitmap *sb, bool set)
 	unsigned int i, weight = 0;
 
 	for (i = 0; i < sb->map_nr; i++) {
-		const struct sbitmap_word *word = &sb->map[i];
+		const struct sbitmap_word *word = __sbitmap_map(sb, i);
 		unsigned int word_depth = __map_depth(sb, i);
 
 		if (set)
@@ -384,6 +587,9 @@ void sbitmap_show(struct sbitmap *sb, struct seq_file *m)
 	seq_printf(m, "cleared=%u\n", sbitmap_cleared(sb));
 	seq_printf(m, "bits_per_word=%u\n", 1U << sb->shift);
 	seq_printf(m, "map_nr=%u\n", sb->map_nr);
+	if (__sbitmap_numa(sb))
+		seq_printf(m, "words_per_node=%u\n",
+			   1U << __sbitmap_numa(sb)->node_shift);
 }
 EXPORT_SYMBOL_GPL(sbitmap_show);
 
@@ -407,8 +613,9 @@ void sbitmap_bitmap_show(struct sbitmap *sb, struct seq_file *m)
 	int i;
 
 	for (i = 0; i < sb->map_nr; i++) {
-		unsigned long word = READ_ONCE(sb->map[i].word);
-		unsigned long cleared = READ_ONCE(sb->map[i].cleared);
+		const struct sbitmap_word *map = __sbitmap_map(sb, i);
+		unsigned long word = READ_ONCE(map->word);
+		unsigned long cleared = READ_ONCE(map->cleared);
 		unsigned int word_bits = __map_depth(sb, i);
 
 		word &= ~cleared;
@@ -445,17 +652,11 @@ static unsigned int sbq_calc_wake_batch(struct sbitmap_queue *sbq,
 		       1, SBQ_WAKE_BATCH);
 }
 
-int sbitmap_queue_init_node(struct sbitmap_queue *sbq, unsigned int depth,
-			    int shift, bool round_robin, gfp_t flags, int node)
+static int __sbitmap_queue_init(struct sbitmap_queue *sbq, unsigned int depth,
+				gfp_t flags, int node)
 {
-	int ret;
 	int i;
 
-	ret = sbitmap_init_node(&sbq->sb, depth, shift, flags, node,
-				round_robin, true);
-	if (ret)
-		return ret;
-
 	sbq->min_shallow_depth = UINT_MAX;
 	sbq->wake_batch = sbq_calc_wake_batch(sbq, depth);
 	atomic_set(&sbq->wake_index, 0);
@@ -474,8 +675,35 @@ int sbitmap_queue_init_node(struct sbitmap_queue *sbq, unsigned int depth,
 
 	return 0;
 }
+
+int sbitmap_queue_init_node(struct sbitmap_queue *sbq, unsigned int depth,
+			    int shift, bool round_robin, gfp_t flags, int node)
+{
+	int ret;
+
+	ret = sbitmap_init_node(&sbq->sb, depth, shift, flags, node,
+				round_robin, true);
+	if (ret)
+		return ret;
+
+	return __sbitmap_queue_init(sbq, depth, flags, node);
+}
 EXPORT_SYMBOL_GPL(sbitmap_queue_init_node);
 
+int sbitmap_queue_init_numa(struct sbitmap_queue *sbq, unsigned int depth,
+			    int shift, bool round_robin, gfp_t flags)
+{
+	int ret;
+
+	ret = sbitmap_init_numa(&sbq->sb, depth, shift, flags, round_robin,
+				true);
+	if (ret)
+		return ret;
+
+	return __sbitmap_queue_init(sbq, depth, flags, NUMA_NO_NODE);
+}
+EXPORT_SYMBOL_GPL(sbitmap_queue_init_numa);
+
 static void sbitmap_queue_update_wake_batch(struct sbitmap_queue *sbq,
 					    unsigned int depth)
 {
@@ -529,7 +757,7 @@ unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq, int nr_tags,
 	index = SB_NR_TO_INDEX(sb, hint);
 
 	for (i = 0; i < sb->map_nr; i++) {
-		struct sbitmap_word *map = &sb->map[index];
+		struct sbitmap_word *map = __sbitmap_map(sb, index);
 		unsigned long get_mask;
 		unsigned int map_depth = __map_depth(sb, index);
 		unsigned long val;
@@ -633,10 +861,39 @@ void sbitmap_queue_wake_up(struct sbitmap_queue *sbq, int nr)
 }
 EXPORT_SYMBOL_GPL(sbitmap_queue_wake_up);
 
+/*
+ * In a NUMA-aware map, a bit freed on another node's words must not become
+ * this CPU's hint, or its next allocation would start on remote cachelines.
+ * Local frees also refresh the node's hint, but only when they move it to
+ * another word so that CPUs of a node don't keep dirtying its cacheline.
+ */
+static void sbitmap_update_node_hint(struct sbitmap *sb, int cpu, int tag)
+{
+	unsigned int lo, hi, index = SB_NR_TO_INDEX(sb, tag);
+	struct sbitmap_numa *numa;
+	struct sbitmap_node *n;
+
+	if (!sbitmap_node_range(sb, cpu, &lo, &hi))
+		goto update;
+	if (index < lo || index >= hi)
+		return;
+
+	numa = __sbitmap_numa(sb);
+	n = numa->nodes[lo >> numa->node_shift];
+	if (SB_NR_TO_INDEX(sb, data_race(n->hint)) != index)
+		data_race(n->hint = tag);
+update:
+	data_race(*per_cpu_ptr(sb->alloc_hint, cpu) = tag);
+}
+
 static inline void sbitmap_update_cpu_hint(struct sbitmap *sb, int cpu, int tag)
 {
-	if (likely(!sb->round_robin && tag < sb->depth))
-		data_race(*per_cpu_ptr(sb->alloc_hint, cpu) = tag);
+	if (likely(!sb->round_robin && tag < sb->depth)) {
+		if (unlikely(__sbitmap_numa(sb)))
+			sbitmap_update_node_hint(sb, cpu, tag);
+		else
+			data_race(*per_cpu_ptr(sb->alloc_hint, cpu) = tag);
+	}
 }
 
 void sbitmap_queue_clear_batch(struct sbitmap_queue *sbq, int offset,
@@ -653,7 +910,7 @@ void sbitmap_queue_clear_batch(struct sbitmap_queue *sbq, int offset,
 		unsigned long *this_addr;
 
 		/* since we're clearing a batch, skip the deferred map */
-		this_addr = &sb->map[SB_NR_TO_INDEX(sb, tag)].word;
+		this_addr = __sbitmap_word(sb, tag);
 		if (!addr) {
 			addr = this_addr;
 		} else if (addr != this_addr) {
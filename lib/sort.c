@@ -7,12 +7,17 @@
  *
  * Quicksort manages n*log2(n) - 1.26*n for random inputs (1.63*n
  * better) at the expense of stack usage and much larger code to avoid
- * quicksort's O(n^2) worst case.
+ * quicksort's O(n^2) worst case.  sort_intro() is that larger code, for
+ * callers with big arrays, and radix_sort_u32/u64() skip comparisons
+ * altogether for plain integer keys.
  */
 
 #include <linux/types.h>
 #include <linux/export.h>
+#include <linux/limits.h>
+#include <linux/log2.h>
 #include <linux/sort.h>
+#include <linux/string.h>
 
 /**
  * is_aligned - is this pointer & size okay for word-wide copying?
@@ -186,6 +191,26 @@ static size_t parent(size_t i, unsigned int lsbit, size_t size)
 	return i / 2;
 }
 
+/* Pick the built-in swap if the caller didn't supply one */
+static swap_r_func_t select_swap(void *base, size_t size,
+				 swap_r_func_t swap_func, const void *priv)
+{
+	/* called from 'sort' without swap function, let's pick the default */
+	if (swap_func == SWAP_WRAPPER && !((struct wrapper *)priv)->swap)
+		swap_func = NULL;
+
+	if (!swap_func) {
+		if (is_aligned(base, size, 8))
+			swap_func = SWAP_WORDS_64;
+		else if (is_aligned(base, size, 4))
+			swap_func = SWAP_WORDS_32;
+		else
+			swap_func = SWAP_BYTES;
+	}
+
+	return swap_func;
+}
+
 #include <linux/sched.h>
 
 static void __sort_r(void *base, size_t num, size_t size,
@@ -202,18 +227,7 @@ static void __sort_r(void *base, size_t num, size_t size,
 	if (!a)		/* num < 2 || size == 0 */
 		return;
 
-	/* called from 'sort' without swap function, let's pick the default */
-	if (swap_func == SWAP_WRAPPER && !((struct wrapper *)priv)->swap)
-		swap_func = NULL;
-
-	if (!swap_func) {
-		if (is_aligned(base, size, 8))
-			swap_func = SWAP_WORDS_64;
-		else if (is_aligned(base, size, 4))
-			swap_func = SWAP_WORDS_32;
-		else
-			swap_func = SWAP_BYTES;
-	}
+	swap_func = select_swap(base, size, swap_func, priv);
 
 	/*
 	 * Loop invariants:
@@ -355,3 +369,314 @@ void sort_nonatomic(void *base, size_t num, size_t size,
 	return __sort_r(base, num, size, _CMP_WRAPPER, SWAP_WRAPPER, &w, true);
 }
 EXPORT_SYMBOL(sort_nonatomic);
+
+/* Partitions at most this many elements are finished by insertion sort */
+#define INTROSORT_INSERTION	16
+/*
+ * Pending partitions. The larger half is always pushed and the smaller one
+ * sorted next, so each entry is at most half the size of the one below it
+ * and the stack only fills for arrays of more than 2^32 elements. Should it
+ * ever fill, the partition is heapsorted instead of pushed.
+ */
+#define INTROSORT_STACK		32
+
+static void insertion_sort(void *base, size_t n, size_t size,
+			   cmp_r_func_t cmp_func, swap_r_func_t swap_func,
+			   const void *priv)
+{
+	size_t i, j;
+
+	for (i = size; i < n; i += size)
+		for (j = i; j && do_cmp(base + j - size, base + j, cmp_func, priv) > 0; j -= size)
+			do_swap(base + j - size, base + j, size, swap_func, priv);
+}
+
+/*
+ * Partition [lo, hi) around the median of its first, middle and last
+ * elements and return the offset the pivot ends up at. Everything before
+ * it compares less than or equal, everything after greater than or equal.
+ */
+static size_t introsort_partition(void *base, size_t lo, size_t hi, size_t size,
+				  cmp_r_func_t cmp_func, swap_r_func_t swap_func,
+				  const void *priv)
+{
+	size_t mid = lo + ((hi - lo) / size / 2) * size;
+	size_t last = hi - size;
+	size_t i = lo, j = hi;
+
+	if (do_cmp(base + mid, base + lo, cmp_func, priv) < 0)
+		do_swap(base + mid, base + lo, size, swap_func, priv);
+	if (do_cmp(base + last, base + mid, cmp_func, priv) < 0) {
+		do_swap(base + last, base + mid, size, swap_func, priv);
+		if (do_cmp(base + mid, base + lo, cmp_func, priv) < 0)
+			do_swap(base + mid, base + lo, size, swap_func, priv);
+	}
+
+	/*
+	 * Move the median to the front. The last element is now at least as
+	 * large and stops the upwards scan, and the pivot itself stops the
+	 * downwards one, so neither needs a bounds check.
+	 */
+	do_swap(base + lo, base + mid, size, swap_func, priv);
+
+	for (;;) {
+		do
+			i += size;
+		while (do_cmp(base + i, base + lo, cmp_func, priv) < 0);
+		do
+			j -= size;
+		while (do_cmp(base + j, base + lo, cmp_func, priv) > 0);
+		if (i >= j)
+			break;
+		do_swap(base + i, base + j, size, swap_func, priv);
+	}
+
+	do_swap(base + lo, base + j, size, swap_func, priv);
+	return j;
+}
+
+static void __sort_intro_r(void *base, size_t num, size_t size,
+			   cmp_r_func_t cmp_func,
+			   swap_r_func_t swap_func,
+			   const void *priv,
+			   bool may_schedule)
+{
+	struct {
+		size_t lo, hi;
+	} stack[INTROSORT_STACK];
+	u8 depth_stack[INTROSORT_STACK];
+	unsigned int sp = 0, depth;
+	size_t lo = 0, hi = num * size;
+
+	if (num < 2 || !size)
+		return;
+
+	swap_func = select_swap(base, size, swap_func, priv);
+
+	/* Quicksort gets 2*log2(n) levels before it is deemed to be failing */
+	depth = 2 * ilog2(num);
+
+	for (;;) {
+		size_t n = (hi - lo) / size;
+
+		if (n <= INTROSORT_INSERTION) {
+			insertion_sort(base + lo, hi - lo, size, cmp_func,
+				       swap_func, priv);
+		} else if (!depth) {
+			__sort_r(base + lo, n, size, cmp_func, swap_func, priv,
+				 may_schedule);
+		} else {
+			size_t p = introsort_partition(base, lo, hi, size,
+						       cmp_func, swap_func,
+						       priv);
+			size_t plo = lo, phi = p, slo = p + size, shi = hi;
+
+			depth--;
+			/* Continue with the smaller half, push the larger */
+			if (phi - plo < shi - slo) {
+				plo = slo;
+				phi = shi;
+				slo = lo;
+				shi = p;
+			}
+			if (sp < INTROSORT_STACK) {
+				stack[sp].lo = plo;
+				stack[sp].hi = phi;
+				depth_stack[sp++] = depth;
+			} else {
+				__sort_r(base + plo, (phi - plo) / size, size,
+					 cmp_func, swap_func, priv,
+					 may_schedule);
+			}
+			lo = slo;
+			hi = shi;
+			if (may_schedule)
+				cond_resched();
+			continue;
+		}
+
+		if (!sp)
+			break;
+		sp--;
+		lo = stack[sp].lo;
+		hi = stack[sp].hi;
+		depth = depth_stack[sp];
+	}
+}
+
+/**
+ * sort_intro_r - sort an array of elements with introsort
+ * @base: pointer to data to sort
+ * @num: number of elements
+ * @size: size of each element
+ * @cmp_func: pointer to comparison function
+ * @swap_func: pointer to swap function or NULL
+ * @priv: third argument passed to comparison function
+ *
+ * Same interface as sort_r(), but does a median-of-three quicksort that
+ * switches to heapsort for partitions which recurse too deeply and to
+ * insertion sort for small ones. This makes fewer comparisons and has much
+ * better locality than heapsort on large arrays, while the worst case stays
+ * O(n log n). Stack usage is bounded, around 600 bytes on 64-bit.
+ *
+ * Like sort_r(), the sort is not stable.
+ */
+void sort_intro_r(void *base, size_t num, size_t size,
+		  cmp_r_func_t cmp_func,
+		  swap_r_func_t swap_func,
+		  const void *priv)
+{
+	__sort_intro_r(base, num, size, cmp_func, swap_func, priv, false);
+}
+EXPORT_SYMBOL(sort_intro_r);
+
+/**
+ * sort_intro_r_nonatomic - sort an array of elements with introsort, with cond_resched
+ * @base: pointer to data to sort
+ * @num: number of elements
+ * @size: size of each element
+ * @cmp_func: pointer to comparison function
+ * @swap_func: pointer to swap function or NULL
+ * @priv: third argument passed to comparison function
+ *
+ * Same as sort_intro_r, but does a periodic cond_resched().
+ */
+void sort_intro_r_nonatomic(void *base, size_t num, size_t size,
+			    cmp_r_func_t cmp_func,
+			    swap_r_func_t swap_func,
+			    const void *priv)
+{
+	__sort_intro_r(base, num, size, cmp_func, swap_func, priv, true);
+}
+EXPORT_SYMBOL(sort_intro_r_nonatomic);
+
+void sort_intro(void *base, size_t num, size_t size,
+		cmp_func_t cmp_func,
+		swap_func_t swap_func)
+{
+	struct wrapper w = {
+		.cmp  = cmp_func,
+		.swap = swap_func,
+	};
+
+	return __sort_intro_r(base, num, size, _CMP_WRAPPER, SWAP_WRAPPER, &w, false);
+}
+EXPORT_SYMBOL(sort_intro);
+
+static int radix_cmp_u32(const void *a, const void *b)
+{
+	return cmp_int(*(const u32 *)a, *(const u32 *)b);
+}
+
+static int radix_cmp_u64(const void *a, const void *b)
+{
+	return cmp_int(*(const u64 *)a, *(const u64 *)b);
+}
+
+static __always_inline u64 radix_key(const void *keys, size_t i, size_t size)
+{
+	return size == sizeof(u64) ? ((const u64 *)keys)[i] : ((const u32 *)keys)[i];
+}
+
+static __always_inline void radix_put(void *keys, size_t i, u64 key, size_t size)
+{
+	if (size == sizeof(u64))
+		((u64 *)keys)[i] = key;
+	else
+		((u32 *)keys)[i] = key;
+}
+
+/*
+ * One counting pass per byte of the key, least significant first, moving
+ * the keys back and forth between @base and @tmp. A pass is skipped when
+ * every key has the same value in that byte, which is common for the high
+ * bytes of small keys. The counters live in @tmp behind the keys, so the
+ * stack frame stays small.
+ */
+static __always_inline void __radix_sort(void *base, void *tmp, size_t num,
+					 size_t size)
+{
+	u32 *count = tmp + num * size;
+	void *src = base, *dst = tmp, *swap_buf;
+	unsigned int shift, d, sum;
+	size_t i;
+
+	for (shift = 0; shift < size * 8; shift += 8) {
+		memset(count, 0, RADIX_SORT_DIGITS * sizeof(*count));
+		for (i = 0; i < num; i++)
+			count[(radix_key(src, i, size) >> shift) & 0xff]++;
+
+		if (count[(radix_key(src, 0, size) >> shift) & 0xff] == num)
+			continue;
+
+		for (d = 0, sum = 0; d < RADIX_SORT_DIGITS; d++) {
+			unsigned int c = count[d];
+
+			count[d] = sum;
+			sum += c;
+		}
+
+		for (i = 0; i < num; i++) {
+			u64 key = radix_key(src, i, size);
+
+			radix_put(dst, count[(key >> shift) & 0xff]++, key, size);
+		}
+
+		swap_buf = src;
+		src = dst;
+		dst = swap_buf;
+	}
+
+	if (src != base)
+		memcpy(base, src, num * size);
+}
+
+/**
+ * radix_sort_u32 - sort an array of u32 keys in ascending order
+ * @base: keys to sort
+ * @tmp: radix_sort_tmp_size(@num, sizeof(u32)) bytes of scratch space,
+ *	must not overlap @base
+ * @num: number of keys
+ *
+ * LSD radix sort with 8-bit digits: at most four linear passes over the
+ * keys and no comparisons, so the cost is O(n) regardless of the input
+ * order. The sorted keys end up in @base. This is the fastest option for
+ * large arrays of plain integers when the caller can provide @tmp.
+ */
+void radix_sort_u32(u32 *base, u32 *tmp, size_t num)
+{
+	if (num < 2)
+		return;
+
+	/* The per-digit counters are 32 bits to keep @tmp small */
+	if (unlikely(num > UINT_MAX)) {
+		sort_intro(base, num, sizeof(*base), radix_cmp_u32, NULL);
+		return;
+	}
+
+	__radix_sort(base, tmp, num, sizeof(*base));
+}
+EXPORT_SYMBOL(radix_sort_u32);
+
+/**
+ * radix_sort_u64 - sort an array of u64 keys in ascending order
+ * @base: keys to sort
+ * @tmp: radix_sort_tmp_size(@num, sizeof(u64)) bytes of scratch space,
+ *	must not overlap @base
+ * @num: number of keys
+ *
+ * Same as radix_sort_u32(), with at most eight passes.
+ */
+void radix_sort_u64(u64 *base, u64 *tmp, size_t num)
+{
+	if (num < 2)
+		return;
+
+	if (unlikely(num > UINT_MAX)) {
+		sort_intro(base, num, sizeof(*base), radix_cmp_u64, NULL);
+		return;
+	}
+
+	__radix_sort(base, tmp, num, sizeof(*base));
+}
+EXPORT_SYMBOL(radix_sort_u64);
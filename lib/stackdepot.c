@@ -22,6 +22,7 @@
 #include <linux/list.h>
 #include <linux/mm.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
 #include <linux/poison.h>
 #include <linux/printk.h>
 #include <linux/rculist.h>
@@ -74,6 +75,37 @@ static LIST_HEAD(free_stacks);
 /* The lock must be held when performing pool or freelist modifications. */
 static DEFINE_RAW_SPINLOCK(pool_lock);
 
+/*
+ * Hash buckets are modified under one of a fixed set of striped locks, so that
+ * saving new stacks on different CPUs does not serialize on a single lock.
+ * Lookups remain lockless under RCU. Lock ordering: bucket lock -> pool_lock.
+ */
+#define STACK_BUCKET_LOCKS_ORDER 8
+#define STACK_BUCKET_LOCKS (1 << STACK_BUCKET_LOCKS_ORDER)
+static raw_spinlock_t stack_bucket_locks[STACK_BUCKET_LOCKS];
+
+/*
+ * Persistent stack records are carved out of a per-CPU chunk of the current
+ * pool, with the bucket lock held and interrupts disabled. pool_lock is only
+ * taken to refill the chunk.
+ */
+#define DEPOT_CHUNK_SIZE (DEPOT_POOL_SIZE / 8)
+struct depot_chunk {
+	u32 pool_index;
+	u32 offset;
+	u32 end;
+};
+static DEFINE_PER_CPU(struct depot_chunk, depot_chunks);
+
+/*
+ * Per-CPU direct-mapped cache of recently saved persistent stack handles,
+ * indexed by stack hash. Only handles of records that can never be freed are
+ * cached, so a cached handle always refers to a valid record.
+ */
+#define DEPOT_CACHE_ORDER 6
+#define DEPOT_CACHE_SIZE (1 << DEPOT_CACHE_ORDER)
+static DEFINE_PER_CPU(depot_stack_handle_t, depot_cache[DEPOT_CACHE_SIZE]);
+
 /* Statistics counters for debugfs. */
 enum depot_counter_id {
 	DEPOT_COUNTER_REFD_ALLOCS,
@@ -82,9 +114,12 @@ enum depot_counter_id {
 	DEPOT_COUNTER_FREELIST_SIZE,
 	DEPOT_COUNTER_PERSIST_COUNT,
 	DEPOT_COUNTER_PERSIST_BYTES,
+	DEPOT_COUNTER_CACHE_HITS,
+	DEPOT_COUNTER_TABLE_HITS,
+	DEPOT_COUNTER_MISSES,
 	DEPOT_COUNTER_COUNT,
 };
-static long counters[DEPOT_COUNTER_COUNT];
+static DEFINE_PER_CPU(long, counters[DEPOT_COUNTER_COUNT]);
 static const char *const counter_names[] = {
 	[DEPOT_COUNTER_REFD_ALLOCS]	= "refcounted_allocations",
 	[DEPOT_COUNTER_REFD_FREES]	= "refcounted_frees",
@@ -92,9 +127,21 @@ static const char *const counter_names[] = {
 	[DEPOT_COUNTER_FREELIST_SIZE]	= "freelist_size",
 	[DEPOT_COUNTER_PERSIST_COUNT]	= "persistent_count",
 	[DEPOT_COUNTER_PERSIST_BYTES]	= "persistent_bytes",
+	[DEPOT_COUNTER_CACHE_HITS]	= "lookup_cache_hits",
+	[DEPOT_COUNTER_TABLE_HITS]	= "lookup_table_hits",
+	[DEPOT_COUNTER_MISSES]		= "lookup_misses",
 };
 static_assert(ARRAY_SIZE(counter_names) == DEPOT_COUNTER_COUNT);
 
+/*
+ * Counters are per-CPU, as they are updated outside of pool_lock. They are
+ * approximate statistics only.
+ */
+static inline void depot_count(enum depot_counter_id id, long delta)
+{
+	this_cpu_add(counters[id], delta);
+}
+
 static int __init disable_stack_depot(char *str)
 {
 	return kstrtobool(str, &stack_depot_disabled);
@@ -137,13 +184,15 @@ void __init stack_depot_request_early_init(void)
 	__stack_depot_early_init_requested = true;
 }
 
-/* Initialize list_head's within the hash table. */
+/* Initialize list_head's within the hash table, and the bucket locks. */
 static void init_stack_table(unsigned long entries)
 {
 	unsigned long i;
 
 	for (i = 0; i < entries; i++)
 		INIT_LIST_HEAD(&stack_table[i]);
+	for (i = 0; i < STACK_BUCKET_LOCKS; i++)
+		raw_spin_lock_init(&stack_bucket_locks[i]);
 }
 
 /* Allocates a hash table via memblock. Can only be used during early boot. */
@@ -312,7 +361,7 @@ static bool depot_init_pool(void **prealloc)
 		return false; /* new_pool and *prealloc are NULL */
 
 	/* Save reference to the pool to be used by depot_fetch_stack(). */
-	stack_pools[pools_num] = new_pool;
+	WRITE_ONCE(stack_pools[pools_num], new_pool);
 
 	/*
 	 * Stack depot tries to keep an extra pool allocated even before it runs
@@ -327,8 +376,11 @@ static bool depot_init_pool(void **prealloc)
 	else
 		WRITE_ONCE(new_pool, STACK_DEPOT_POISON);
 
-	/* Pairs with concurrent READ_ONCE() in depot_fetch_stack(). */
-	WRITE_ONCE(pools_num, pools_num + 1);
+	/*
+	 * Pairs with smp_load_acquire() in depot_fetch_stack(): a reader that
+	 * sees the new pools_num also sees the pool pointer stored above.
+	 */
+	smp_store_release(&pools_num, pools_num + 1);
 	ASSERT_EXCLUSIVE_WRITER(pools_num);
 
 	pool_offset = 0;
@@ -353,42 +405,103 @@ static void depot_keep_new_pool(void **prealloc)
 }
 
 /*
- * Try to initialize a new stack record from the current pool, a cached pool, or
- * the current pre-allocation.
+ * Reserve @size bytes from the current pool, a cached pool, or the current
+ * pre-allocation. Returns the offset of the reserved space in the pool with
+ * index *@pool_index, or a negative value on failure.
  */
-static struct stack_record *depot_pop_free_pool(void **prealloc, size_t size)
+static long depot_reserve_pool(void **prealloc, size_t size, u32 *pool_index)
 {
-	struct stack_record *stack;
-	void *current_pool;
-	u32 pool_index;
+	long offset;
 
 	lockdep_assert_held(&pool_lock);
 
 	if (pool_offset + size > DEPOT_POOL_SIZE) {
 		if (!depot_init_pool(prealloc))
-			return NULL;
+			return -1;
 	}
 
 	if (WARN_ON_ONCE(pools_num < 1))
-		return NULL;
-	pool_index = pools_num - 1;
-	current_pool = stack_pools[pool_index];
-	if (WARN_ON_ONCE(!current_pool))
-		return NULL;
+		return -1;
+	*pool_index = pools_num - 1;
+	if (WARN_ON_ONCE(!stack_pools[*pool_index]))
+		return -1;
+
+	offset = pool_offset;
+	pool_offset += size;
+
+	return offset;
+}
 
-	stack = current_pool + pool_offset;
+/* Pre-initializes a stack record at @offset in pool @pool_index. */
+static struct stack_record *depot_init_record(u32 pool_index, size_t offset)
+{
+	struct stack_record *stack = stack_pools[pool_index] + offset;
 
 	/* Pre-initialize handle once. */
 	stack->handle.pool_index_plus_1 = pool_index + 1;
-	stack->handle.offset = pool_offset >> DEPOT_STACK_ALIGN;
+	stack->handle.offset = offset >> DEPOT_STACK_ALIGN;
 	stack->handle.extra = 0;
 	INIT_LIST_HEAD(&stack->hash_list);
 
-	pool_offset += size;
-
 	return stack;
 }
 
+/*
+ * Try to initialize a new stack record from the current pool, a cached pool, or
+ * the current pre-allocation.
+ */
+static struct stack_record *depot_pop_free_pool(void **prealloc, size_t size)
+{
+	u32 pool_index;
+	long offset;
+
+	lockdep_assert_held(&pool_lock);
+
+	offset = depot_reserve_pool(prealloc, size, &pool_index);
+	if (offset < 0)
+		return NULL;
+
+	return depot_init_record(pool_index, offset);
+}
+
+/*
+ * Initialize a new stack record from this CPU's chunk of pool space, refilling
+ * the chunk under pool_lock if it is exhausted. Must be called with interrupts
+ * disabled, and not from NMI context.
+ */
+static struct stack_record *depot_pop_chunk(void **prealloc, size_t size)
+{
+	struct depot_chunk *chunk = this_cpu_ptr(&depot_chunks);
+	size_t offset;
+
+	lockdep_assert_irqs_disabled();
+
+	if (chunk->offset + size > chunk->end) {
+		size_t reserve = max_t(size_t, size, DEPOT_CHUNK_SIZE);
+		u32 pool_index;
+		long start;
+
+		raw_spin_lock(&pool_lock);
+		/* Don't strand a partial chunk at the end of a pool. */
+		if (pool_offset + reserve > DEPOT_POOL_SIZE &&
+		    pool_offset + size <= DEPOT_POOL_SIZE)
+			reserve = DEPOT_POOL_SIZE - pool_offset;
+		start = depot_reserve_pool(prealloc, reserve, &pool_index);
+		raw_spin_unlock(&pool_lock);
+		if (start < 0)
+			return NULL;
+
+		chunk->pool_index = pool_index;
+		chunk->offset = start;
+		chunk->end = start + reserve;
+	}
+
+	offset = chunk->offset;
+	chunk->offset += size;
+
+	return depot_init_record(chunk->pool_index, offset);
+}
+
 /* Try to find next free usable entry from the freelist. */
 static struct stack_record *depot_pop_free(void)
 {
@@ -410,7 +523,7 @@ static struct stack_record *depot_pop_free(void)
 		return NULL;
 
 	list_del(&stack->free_list);
-	counters[DEPOT_COUNTER_FREELIST_SIZE]--;
+	depot_count(DEPOT_COUNTER_FREELIST_SIZE, -1);
 
 	return stack;
 }
@@ -425,15 +538,29 @@ static inline size_t depot_stack_record_size(struct stack_record *s, unsigned in
 	return ALIGN(sizeof(struct stack_record) - unused, 1 << DEPOT_STACK_ALIGN);
 }
 
-/* Allocates a new stack in a stack depot pool. */
+/*
+ * Takes pool_lock with interrupts already disabled. Only tries once if
+ * spinning is not allowed.
+ */
+static bool depot_lock_pool(bool can_spin)
+{
+	if (!can_spin)
+		return raw_spin_trylock(&pool_lock);
+	raw_spin_lock(&pool_lock);
+	return true;
+}
+
+/*
+ * Allocates a new stack in a stack depot pool. Called with the bucket lock
+ * for @hash held.
+ */
 static struct stack_record *
-depot_alloc_stack(unsigned long *entries, unsigned int nr_entries, u32 hash, depot_flags_t flags, void **prealloc)
+depot_alloc_stack(unsigned long *entries, unsigned int nr_entries, u32 hash,
+		  depot_flags_t flags, void **prealloc, bool can_spin)
 {
 	struct stack_record *stack = NULL;
 	size_t record_size;
 
-	lockdep_assert_held(&pool_lock);
-
 	/* This should already be checked by public API entry points. */
 	if (WARN_ON_ONCE(!nr_entries))
 		return NULL;
@@ -448,16 +575,24 @@ depot_alloc_stack(unsigned long *entries, unsigned int nr_entries, u32 hash, dep
 		 * safely be re-used by differently sized allocations.
 		 */
 		record_size = depot_stack_record_size(stack, CONFIG_STACKDEPOT_MAX_FRAMES);
+		if (!depot_lock_pool(can_spin))
+			return NULL;
 		stack = depot_pop_free();
+		if (!stack)
+			stack = depot_pop_free_pool(prealloc, record_size);
+		raw_spin_unlock(&pool_lock);
 	} else {
 		record_size = depot_stack_record_size(stack, nr_entries);
+		if (can_spin) {
+			stack = depot_pop_chunk(prealloc, record_size);
+		} else if (depot_lock_pool(false)) {
+			stack = depot_pop_free_pool(prealloc, record_size);
+			raw_spin_unlock(&pool_lock);
+		}
 	}
 
-	if (!stack) {
-		stack = depot_pop_free_pool(prealloc, record_size);
-		if (!stack)
-			return NULL;
-	}
+	if (!stack)
+		return NULL;
 
 	/* Save the stack trace. */
 	stack->hash = hash;
@@ -467,13 +602,13 @@ depot_alloc_stack(unsigned long *entries, unsigned int nr_entries, u32 hash, dep
 
 	if (flags & STACK_DEPOT_FLAG_GET) {
 		refcount_set(&stack->count, 1);
-		counters[DEPOT_COUNTER_REFD_ALLOCS]++;
-		counters[DEPOT_COUNTER_REFD_INUSE]++;
+		depot_count(DEPOT_COUNTER_REFD_ALLOCS, 1);
+		depot_count(DEPOT_COUNTER_REFD_INUSE, 1);
 	} else {
 		/* Warn on attempts to switch to refcounting this entry. */
 		refcount_set(&stack->count, REFCOUNT_SATURATED);
-		counters[DEPOT_COUNTER_PERSIST_COUNT]++;
-		counters[DEPOT_COUNTER_PERSIST_BYTES] += record_size;
+		depot_count(DEPOT_COUNTER_PERSIST_COUNT, 1);
+		depot_count(DEPOT_COUNTER_PERSIST_BYTES, record_size);
 	}
 
 	/*
@@ -487,7 +622,7 @@ depot_alloc_stack(unsigned long *entries, unsigned int nr_entries, u32 hash, dep
 
 static struct stack_record *depot_fetch_stack(depot_stack_handle_t handle)
 {
-	const int pools_num_cached = READ_ONCE(pools_num);
+	const int pools_num_cached = smp_load_acquire(&pools_num);
 	union handle_parts parts = { .handle = handle };
 	void *pool;
 	u32 pool_index = parts.pool_index_plus_1 - 1;
@@ -502,7 +637,7 @@ static struct stack_record *depot_fetch_stack(depot_stack_handle_t handle)
 		return NULL;
 	}
 
-	pool = stack_pools[pool_index];
+	pool = READ_ONCE(stack_pools[pool_index]);
 	if (WARN_ON(!pool))
 		return NULL;
 
@@ -513,14 +648,20 @@ static struct stack_record *depot_fetch_stack(depot_stack_handle_t handle)
 	return stack;
 }
 
+static inline raw_spinlock_t *depot_bucket_lock(u32 hash)
+{
+	return &stack_bucket_locks[hash & (STACK_BUCKET_LOCKS - 1)];
+}
+
 /* Links stack into the freelist. */
 static void depot_free_stack(struct stack_record *stack)
 {
+	raw_spinlock_t *bucket_lock = depot_bucket_lock(stack->hash);
 	unsigned long flags;
 
 	lockdep_assert_not_held(&pool_lock);
 
-	raw_spin_lock_irqsave(&pool_lock, flags);
+	raw_spin_lock_irqsave(bucket_lock, flags);
 	printk_deferred_enter();
 
 	/*
@@ -530,6 +671,8 @@ static void depot_free_stack(struct stack_record *stack)
 	 */
 	list_del_rcu(&stack->hash_list);
 
+	raw_spin_lock(&pool_lock);
+
 	/*
 	 * Due to being used from constrained contexts such as the allocators,
 	 * NMI, or even RCU itself, stack depot cannot rely on primitives that
@@ -548,13 +691,14 @@ static void depot_free_stack(struct stack_record *stack)
 	 * associated with the current grace period.
 	 */
 	list_add_tail(&stack->free_list, &free_stacks);
+	raw_spin_unlock(&pool_lock);
 
-	counters[DEPOT_COUNTER_FREELIST_SIZE]++;
-	counters[DEPOT_COUNTER_REFD_FREES]++;
-	counters[DEPOT_COUNTER_REFD_INUSE]--;
+	depot_count(DEPOT_COUNTER_FREELIST_SIZE, 1);
+	depot_count(DEPOT_COUNTER_REFD_FREES, 1);
+	depot_count(DEPOT_COUNTER_REFD_INUSE, -1);
 
 	printk_deferred_exit();
-	raw_spin_unlock_irqrestore(&pool_lock, flags);
+	raw_spin_unlock_irqrestore(bucket_lock, flags);
 }
 
 /* Calculates the hash for a stack. */
@@ -630,18 +774,52 @@ static inline struct stack_record *find_stack(struct list_head *bucket,
 	return ret;
 }
 
+/* Looks a stack up in this CPU's cache of recently saved persistent stacks. */
+static inline struct stack_record *depot_cache_lookup(unsigned long *entries,
+						      int size, u32 hash)
+{
+	depot_stack_handle_t handle;
+	struct stack_record *stack;
+
+	handle = raw_cpu_read(depot_cache[hash & (DEPOT_CACHE_SIZE - 1)]);
+	if (!handle)
+		return NULL;
+
+	stack = depot_fetch_stack(handle);
+	if (!stack || stack->hash != hash || stack->size != size ||
+	    stackdepot_memcmp(entries, stack->entries, size))
+		return NULL;
+
+	return stack;
+}
+
+static inline void depot_cache_insert(struct stack_record *stack)
+{
+	/*
+	 * Refcounted records may be freed and reused at any time, so only
+	 * remember those that are never freed.
+	 */
+	if (refcount_read(&stack->count) != REFCOUNT_SATURATED)
+		return;
+
+	raw_cpu_write(depot_cache[stack->hash & (DEPOT_CACHE_SIZE - 1)],
+		      stack->handle.handle);
+}
+
 depot_stack_handle_t stack_depot_save_flags(unsigned long *entries,
 					    unsigned int nr_entries,
 					    gfp_t alloc_flags,
 					    depot_flags_t depot_flags)
 {
 	struct list_head *bucket;
+	raw_spinlock_t *bucket_lock;
 	struct stack_record *found = NULL;
 	depot_stack_handle_t handle = 0;
 	struct page *page = NULL;
 	void *prealloc = NULL;
 	bool allow_spin = gfpflags_allow_spinning(alloc_flags);
 	bool can_alloc = (depot_flags & STACK_DEPOT_FLAG_CAN_ALLOC) && allow_spin;
+	bool can_spin;
 	unsigned long flags;
 	u32 hash;
 
@@ -664,10 +842,23 @@ depot_stack_handle_t stack_depot_save_flags(unsigned long *entries,
 	hash = hash_stack(entries, nr_entries);
 	bucket = &stack_table[hash & stack_hash_mask];
 
+	/* Fastest path: a stack this CPU has recently saved. */
+	if (!(depot_flags & STACK_DEPOT_FLAG_GET)) {
+		found = depot_cache_lookup(entries, nr_entries, hash);
+		if (found) {
+			depot_count(DEPOT_COUNTER_CACHE_HITS, 1);
+			goto exit;
+		}
+	}
+
 	/* Fast path: look the stack trace up without locking. */
 	found = find_stack(bucket, entries, nr_entries, hash, depot_flags);
-	if (found)
+	if (found) {
+		depot_count(DEPOT_COUNTER_TABLE_HITS, 1);
+		depot_cache_insert(found);
 		goto exit;
+	}
+	depot_count(DEPOT_COUNTER_MISSES, 1);
 
 	/*
 	 * Allocate memory for a new pool if required now:
@@ -680,14 +871,16 @@ depot_stack_handle_t stack_depot_save_flags(unsigned long *entries,
 			prealloc = page_address(page);
 	}
 
-	if (in_nmi() || !allow_spin) {
+	bucket_lock = depot_bucket_lock(hash);
+	can_spin = !in_nmi() && allow_spin;
+	if (!can_spin) {
 		/* We can never allocate in NMI context. */
 		WARN_ON_ONCE(can_alloc);
 		/* Best effort; bail if we fail to take the lock. */
-		if (!raw_spin_trylock_irqsave(&pool_lock, flags))
+		if (!raw_spin_trylock_irqsave(bucket_lock, flags))
 			goto exit;
 	} else {
-		raw_spin_lock_irqsave(&pool_lock, flags);
+		raw_spin_lock_irqsave(bucket_lock, flags);
 	}
 	printk_deferred_enter();
 
@@ -695,7 +888,8 @@ depot_stack_handle_t stack_depot_save_flags(unsigned long *entries,
 	found = find_stack(bucket, entries, nr_entries, hash, depot_flags);
 	if (!found) {
 		struct stack_record *new =
-			depot_alloc_stack(entries, nr_entries, hash, depot_flags, &prealloc);
+			depot_alloc_stack(entries, nr_entries, hash, depot_flags,
+					  &prealloc, can_spin);
 
 		if (new) {
 			/*
@@ -707,17 +901,21 @@ depot_stack_handle_t stack_depot_save_flags(unsigned long *entries,
 		}
 	}
 
-	if (prealloc) {
+	if (prealloc && depot_lock_pool(can_spin)) {
 		/*
 		 * Either stack depot already contains this stack trace, or
 		 * depot_alloc_stack() did not consume the preallocated memory.
 		 * Try to keep the preallocated memory for future.
 		 */
 		depot_keep_new_pool(&prealloc);
+		raw_spin_unlock(&pool_lock);
 	}
 
 	printk_deferred_exit();
-	raw_spin_unlock_irqrestore(&pool_lock, flags);
+	raw_spin_unlock_irqrestore(bucket_lock, flags);
+
+	if (found)
+		depot_cache_insert(found);
 exit:
 	if (prealloc) {
 		/* Stack depot didn't use this memory, free it. */
@@ -849,8 +1047,14 @@ static int stats_show(struct seq_file *seq, void *v)
 	 * statistics are ok for debugging.
 	 */
 	seq_printf(seq, "pools: %d\n", data_race(pools_num));
-	for (int i = 0; i < DEPOT_COUNTER_COUNT; i++)
-		seq_printf(seq, "%s: %ld\n", counter_names[i], data_race(counters[i]));
+	for (int i = 0; i < DEPOT_COUNTER_COUNT; i++) {
+		long sum = 0;
+		int cpu;
+
+		for_each_possible_cpu(cpu)
+			sum += data_race(per_cpu(counters[i], cpu));
+		seq_printf(seq, "%s: %ld\n", counter_names[i], sum);
+	}
 
 	return 0;
 }
@@ -10,6 +10,7 @@
 #include <linux/maple_tree.h>
 #include <linux/module.h>
 #include <linux/rwsem.h>
+#include <linux/slab.h>
 
 #define MTREE_ALLOC_MAX 0x2000000000000Ul
 #define CONFIG_MAPLE_SEARCH
@@ -48,6 +49,8 @@ atomic_t maple_tree_tests_passed;
 /* #define BENCH_FORK */
 /* #define BENCH_MAS_FOR_EACH */
 /* #define BENCH_MAS_PREV */
+/* #define BENCH_BULK_LOAD */
+/* #define BENCH_STORE_RANGES */
 
 #ifdef __KERNEL__
 #define mt_set_non_kernel(x)		do {} while (0)
@@ -2106,6 +2109,197 @@ static noinline void __init check_mas_store_gfp(struct maple_tree *mt)
 	mtree_destroy(&newmt);
 }
 
+/*
+ * Fill @ents with @nr ranges of @size indices, @stride apart, starting at
+ * @base.  A stride equal to the size leaves no holes between the ranges.
+ */
+static void __init bulk_fill(struct maple_bulk_entry *ents, unsigned long nr,
+		unsigned long base, unsigned long size, unsigned long stride,
+		unsigned long val)
+{
+	unsigned long i;
+
+	for (i = 0; i < nr; i++) {
+		ents[i].index = base + i * stride;
+		ents[i].last = ents[i].index + size - 1;
+		ents[i].entry = xa_mk_value(val + i);
+	}
+}
+
+static noinline void __init check_bulk_contents(struct maple_tree *mt,
+		struct maple_bulk_entry *ents, unsigned long nr)
+{
+	unsigned long i, count = 0;
+	void *entry;
+	MA_STATE(mas, mt, 0, 0);
+
+	mt_validate(mt);
+	for (i = 0; i < nr; i++) {
+		MT_BUG_ON(mt, mtree_load(mt, ents[i].index) != ents[i].entry);
+		MT_BUG_ON(mt, mtree_load(mt, ents[i].last) != ents[i].entry);
+	}
+
+	rcu_read_lock();
+	mas_for_each(&mas, entry, ULONG_MAX) {
+		MT_BUG_ON(mt, count >= nr);
+		MT_BUG_ON(mt, entry != ents[count].entry);
+		MT_BUG_ON(mt, mas.index != ents[count].index);
+		MT_BUG_ON(mt, mas.last != ents[count].last);
+		count++;
+	}
+	rcu_read_unlock();
+	MT_BUG_ON(mt, count != nr);
+}
+
+static noinline void __init check_bulk_load(struct maple_tree *mt)
+{
+	static const unsigned long sizes[] __initconst = {
+		1, 2, 7, 8, 15, 16, 17, 31, 32, 33, 100, 241, 1000, 4097, 10000
+	};
+	unsigned long i, max = 10000;
+	struct maple_bulk_entry *ents;
+	MA_STATE(mas, mt, 0, 0);
+
+	ents = kmalloc_array(max, sizeof(*ents), GFP_KERNEL);
+	MT_BUG_ON(mt, !ents);
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		unsigned long nr = sizes[i];
+
+		/* Contiguous ranges from 0, so only a trailing hole */
+		bulk_fill(ents, nr, 0, 10, 10, 1);
+		MT_BUG_ON(mt, mtree_bulk_load(mt, ents, nr, GFP_KERNEL));
+		check_bulk_contents(mt, ents, nr);
+		MT_BUG_ON(mt, mtree_load(mt, nr * 10) != NULL);
+		mtree_destroy(mt);
+
+		/* Holes everywhere, including before the first range */
+		bulk_fill(ents, nr, 1, 5, 10, 1);
+		MT_BUG_ON(mt, mtree_bulk_load(mt, ents, nr, GFP_KERNEL));
+		check_bulk_contents(mt, ents, nr);
+		MT_BUG_ON(mt, mtree_load(mt, 0) != NULL);
+		MT_BUG_ON(mt, mtree_load(mt, 6) != NULL);
+		if (mt->ma_flags & MT_FLAGS_ALLOC_RANGE) {
+			rcu_read_lock();
+			mas_reset(&mas);
+			MT_BUG_ON(mt, mas_empty_area(&mas, 0, ULONG_MAX, 5));
+			MT_BUG_ON(mt, mas.index != 6);
+			rcu_read_unlock();
+		}
+
+		/* Loading a populated tree is refused */
+		MT_BUG_ON(mt, mtree_bulk_load(mt, ents, nr, GFP_KERNEL) !=
+			  -EINVAL);
+		mtree_destroy(mt);
+	}
+
+	/* A range running to the end of the index space */
+	bulk_fill(ents, 100, 0, 5, 10, 1);
+	ents[99].last = ULONG_MAX;
+	MT_BUG_ON(mt, mtree_bulk_load(mt, ents, 100, GFP_KERNEL));
+	check_bulk_contents(mt, ents, 100);
+	mtree_destroy(mt);
+
+	/* Overlapping, unsorted and NULL input is rejected */
+	bulk_fill(ents, 100, 0, 10, 5, 1);
+	MT_BUG_ON(mt, mtree_bulk_load(mt, ents, 100, GFP_KERNEL) != -EINVAL);
+	bulk_fill(ents, 100, 0, 5, 10, 1);
+	swap(ents[10], ents[11]);
+	MT_BUG_ON(mt, mtree_bulk_load(mt, ents, 100, GFP_KERNEL) != -EINVAL);
+	bulk_fill(ents, 100, 0, 5, 10, 1);
+	ents[50].entry = NULL;
+	MT_BUG_ON(mt, mtree_bulk_load(mt, ents, 100, GFP_KERNEL) != -EINVAL);
+	MT_BUG_ON(mt, !mtree_empty(mt));
+
+	kfree(ents);
+}
+
+static noinline void __init check_store_ranges(struct maple_tree *mt)
+{
+	unsigned long i, nr = 1000, first, last;
+	struct maple_bulk_entry *ents, *repl;
+
+	ents = kmalloc_array(nr, sizeof(*ents), GFP_KERNEL);
+	repl = kmalloc_array(nr, sizeof(*repl), GFP_KERNEL);
+	MT_BUG_ON(mt, !ents || !repl);
+
+	bulk_fill(ents, nr, 0, 5, 10, 1);
+	MT_BUG_ON(mt, mtree_bulk_load(mt, ents, nr, GFP_KERNEL));
+
+	/* Replace ranges 100 - 399 with 150 wider ones */
+	first = ents[100].index;
+	last = ents[399].last;
+	bulk_fill(repl, 150, first + 2, 15, 19, 5000);
+	MT_BUG_ON(mt, mtree_store_ranges(mt, first, last, repl, 150,
+					 GFP_KERNEL));
+	mt_validate(mt);
+	for (i = 0; i < 100; i++)
+		MT_BUG_ON(mt, mtree_load(mt, ents[i].index) != ents[i].entry);
+	for (i = 0; i < 150; i++) {
+		MT_BUG_ON(mt, mtree_load(mt, repl[i].index) != repl[i].entry);
+		MT_BUG_ON(mt, mtree_load(mt, repl[i].last) != repl[i].entry);
+		MT_BUG_ON(mt, mtree_load(mt, repl[i].index - 1) != NULL);
+	}
+	for (i = 400; i < nr; i++)
+		MT_BUG_ON(mt, mtree_load(mt, ents[i].index) != ents[i].entry);
+
+	/* Ranges outside the span are rejected */
+	MT_BUG_ON(mt, mtree_store_ranges(mt, first + 3, last, repl, 150,
+					 GFP_KERNEL) != -EINVAL);
+
+	/* An empty replacement clears the span */
+	MT_BUG_ON(mt, mtree_store_ranges(mt, first, last, NULL, 0,
+					 GFP_KERNEL));
+	mt_validate(mt);
+	for (i = 0; i < 150; i++)
+		MT_BUG_ON(mt, mtree_load(mt, repl[i].index) != NULL);
+
+	/* Replacing everything swaps in a freshly built tree */
+	bulk_fill(ents, nr, 3, 7, 9, 10000);
+	MT_BUG_ON(mt, mtree_store_ranges(mt, 0, ULONG_MAX, ents, nr,
+					 GFP_KERNEL));
+	check_bulk_contents(mt, ents, nr);
+
+	kfree(repl);
+	kfree(ents);
+}
+
+#if defined(BENCH_BULK_LOAD)
+static noinline void __init bench_bulk_load(struct maple_tree *mt)
+{
+	unsigned long i, nr = 100000, count = 500;
+	struct maple_bulk_entry *ents;
+
+	ents = kvmalloc_array(nr, sizeof(*ents), GFP_KERNEL);
+	bulk_fill(ents, nr, 0, 5, 10, 0);
+	for (i = 0; i < count; i++) {
+		mtree_bulk_load(mt, ents, nr, GFP_KERNEL);
+		mtree_destroy(mt);
+	}
+	kvfree(ents);
+}
+#endif
+
+#if defined(BENCH_STORE_RANGES)
+static noinline void __init bench_store_ranges(struct maple_tree *mt)
+{
+	unsigned long i, nr = 10000, span = 256, count = 100000;
+	struct maple_bulk_entry *ents;
+
+	ents = kvmalloc_array(nr, sizeof(*ents), GFP_KERNEL);
+	bulk_fill(ents, nr, 0, 5, 10, 0);
+	mtree_bulk_load(mt, ents, nr, GFP_KERNEL);
+	for (i = 0; i < count; i++) {
+		unsigned long start = (i * span) % (nr - span);
+
+		mtree_store_ranges(mt, ents[start].index,
+				   ents[start + span - 1].last, &ents[start],
+				   span, GFP_KERNEL);
+	}
+	kvfree(ents);
+}
+#endif
+
 #if defined(BENCH_FORK)
 static noinline void __init bench_forking(void)
 {
@@ -3746,6 +3940,20 @@ static int __init maple_tree_seed(void)
 	mtree_destroy(&tree);
 	goto skip;
 #endif
+#if defined(BENCH_BULK_LOAD)
+#define BENCH
+	mt_init_flags(&tree, MT_FLAGS_ALLOC_RANGE);
+	bench_bulk_load(&tree);
+	mtree_destroy(&tree);
+	goto skip;
+#endif
+#if defined(BENCH_STORE_RANGES)
+#define BENCH
+	mt_init_flags(&tree, MT_FLAGS_ALLOC_RANGE);
+	bench_store_ranges(&tree);
+	mtree_destroy(&tree);
+	goto skip;
+#endif
 
 	mt_init_flags(&tree, MT_FLAGS_ALLOC_RANGE);
 	check_deficient_node(&tree);
@@ -3769,6 +3977,18 @@ static int __init maple_tree_seed(void)
 	check_mas_store_gfp(&tree);
 	mtree_destroy(&tree);
 
+	mt_init_flags(&tree, MT_FLAGS_ALLOC_RANGE);
+	check_bulk_load(&tree);
+	mtree_destroy(&tree);
+
+	mt_init_flags(&tree, 0);
+	check_bulk_load(&tree);
+	mtree_destroy(&tree);
+
+	mt_init_flags(&tree, MT_FLAGS_ALLOC_RANGE);
+	check_store_ranges(&tree);
+	mtree_destroy(&tree);
+
 	/* Test ranges (store and insert) */
 	mt_init_flags(&tree, 0);
 	check_ranges(&tree);
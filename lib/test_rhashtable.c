@@ -14,6 +14,7 @@
 #include <linux/jhash.h>
 #include <linux/kernel.h>
 #include <linux/kthread.h>
+#include <linux/math64.h>
 #include <linux/module.h>
 #include <linux/rcupdate.h>
 #include <linux/rcupdate_wait.h>
@@ -679,6 +680,92 @@ static int threadfunc(void *data)
 	return err;
 }
 
+struct resize_lookup_data {
+	atomic_t inserted;
+	unsigned long lookups;
+	unsigned long misses;
+};
+
+/* Look up keys that are known to be present while the table grows. */
+static int resize_lookup_thread(void *data)
+{
+	struct resize_lookup_data *rd = data;
+	unsigned int i = 0;
+
+	while (!kthread_should_stop()) {
+		unsigned int n = atomic_read_acquire(&rd->inserted);
+		struct test_obj_val key = { };
+
+		if (!n) {
+			cond_resched();
+			continue;
+		}
+
+		key.id = (i++ % n) * 2;
+		if (!rhashtable_lookup_fast(&ht, &key, test_rht_params))
+			rd->misses++;
+		rd->lookups++;
+
+		if (!(i % 1024))
+			cond_resched();
+	}
+
+	return 0;
+}
+
+/*
+ * Grow a table from its initial size to @entries keys while another thread
+ * keeps looking up keys already inserted, which exercises the window in
+ * which lookups have to search both the old and the new table.
+ */
+static int __init test_rhashtable_resize_lookup(struct test_obj *objs,
+						unsigned int entries)
+{
+	struct resize_lookup_data rd = { };
+	struct task_struct *task;
+	unsigned int i, size;
+	s64 start, end;
+	int err;
+
+	err = rhashtable_init(&ht, &test_rht_params);
+	if (err)
+		return err;
+
+	task = kthread_run(resize_lookup_thread, &rd, "rhashtable_resize");
+	if (IS_ERR(task)) {
+		rhashtable_destroy(&ht);
+		return PTR_ERR(task);
+	}
+
+	start = ktime_get_ns();
+	for (i = 0; i < entries; i++) {
+		objs[i].value.id = i * 2;
+		err = insert_retry(&ht, &objs[i], test_rht_params);
+		if (err < 0)
+			break;
+		atomic_set_release(&rd.inserted, i + 1);
+	}
+	end = ktime_get_ns();
+
+	kthread_stop(task);
+
+	rcu_read_lock();
+	size = rht_dereference_rcu(ht.tbl, &ht)->size;
+	rcu_read_unlock();
+
+	rhashtable_destroy(&ht);
+
+	if (err < 0)
+		return err;
+
+	pr_info("  %u inserts growing to %u buckets in %lld ns, %lu lookups (%llu/s), %lu misses\n",
+		entries, size, end - start, rd.lookups,
+		div64_u64((u64)rd.lookups * NSEC_PER_SEC, max(end - start, 1LL)),
+		rd.misses);
+
+	return rd.misses ? -EINVAL : 0;
+}
+
 static int __init test_rht_init(void)
 {
 	unsigned int entries;
@@ -731,6 +818,13 @@ static int __init test_rht_init(void)
 	pr_info("test if its possible to exceed max_size %d: %s\n",
 			test_rht_params.max_size, test_rhashtable_max(objs, entries) == 0 ?
 			"no, ok" : "YES, failed");
+
+	pr_info("Testing lookups during resize:\n");
+	test_rht_params.max_size = max_size ? : roundup_pow_of_two(entries);
+	memset(objs, 0, entries * sizeof(struct test_obj));
+	err = test_rhashtable_resize_lookup(objs, entries);
+	if (err)
+		pr_warn("Test failed: lookups during resize returned %d\n", err);
 	vfree(objs);
 
 	do_div(total_time, runs);
@@ -2193,6 +2193,155 @@ static noinline void check_xas_conflict_get_order(struct xarray *xa)
 }
 
 
+static noinline void check_batch_order(struct xarray *xa, unsigned long index,
+		unsigned int order, unsigned int nr)
+{
+	unsigned long i, size = (unsigned long)nr << order;
+	void **entries, **loaded;
+
+	entries = kmalloc_array(nr, sizeof(*entries), GFP_KERNEL);
+	loaded = kmalloc_array(size + 2, sizeof(*loaded), GFP_KERNEL);
+	XA_BUG_ON(xa, !entries || !loaded);
+
+	for (i = 0; i < nr; i++)
+		entries[i] = xa_mk_index(index + (i << order));
+	XA_BUG_ON(xa, xa_store_batch(xa, index, entries, nr, order,
+				     GFP_KERNEL) != 0);
+	for (i = 0; i < size; i++)
+		XA_BUG_ON(xa, xa_load(xa, index + i) !=
+			  entries[i >> order]);
+
+	/* Include an empty index either side of the batch */
+	XA_BUG_ON(xa, xa_load_range(xa, index - 1, index + size, loaded) !=
+		  nr);
+	XA_BUG_ON(xa, loaded[0] != NULL);
+	XA_BUG_ON(xa, loaded[size + 1] != NULL);
+	for (i = 0; i < size; i++)
+		XA_BUG_ON(xa, loaded[i + 1] != entries[i >> order]);
+
+	/* Starting part way through a multi-index entry */
+	if (order) {
+		XA_BUG_ON(xa, xa_load_range(xa, index + 1, index + 1,
+					    loaded) != 1);
+		XA_BUG_ON(xa, loaded[0] != entries[0]);
+	}
+
+	/* Overwriting in place */
+	for (i = 0; i < nr; i++)
+		entries[i] = xa_mk_index(i);
+	XA_BUG_ON(xa, xa_store_batch(xa, index, entries, nr, order,
+				     GFP_KERNEL) != 0);
+	XA_BUG_ON(xa, xa_load(xa, index + size - 1) != entries[nr - 1]);
+
+	XA_BUG_ON(xa, xa_erase_range(xa, index, index + size - 1) != nr);
+	XA_BUG_ON(xa, !xa_empty(xa));
+
+	kfree(loaded);
+	kfree(entries);
+}
+
+static noinline void check_batch(struct xarray *xa)
+{
+	void *entries[4] = { xa, NULL, xa, xa };
+	unsigned int order;
+
+	check_batch_order(xa, 1, 0, 1);
+	check_batch_order(xa, 1, 0, 1000);
+	check_batch_order(xa, 4095, 0, 200);
+
+	for (order = 1; order < min(order_limit, 10U); order++) {
+		check_batch_order(xa, 1UL << order, order, 1);
+		check_batch_order(xa, 1UL << order, order, 130);
+		check_batch_order(xa, 1UL << (order + 6), order, 64);
+	}
+
+	/* NULL entries erase and may free the node being walked */
+	XA_BUG_ON(xa, xa_store_batch(xa, 64, entries, 4, 0, GFP_KERNEL) != 0);
+	XA_BUG_ON(xa, xa_load(xa, 65) != NULL);
+	XA_BUG_ON(xa, xa_load(xa, 67) != xa);
+	XA_BUG_ON(xa, xa_erase_range(xa, 0, ULONG_MAX) != 3);
+	XA_BUG_ON(xa, !xa_empty(xa));
+
+	/* Misaligned, overflowing and unsupported batches */
+	if (order_limit > 2)
+		XA_BUG_ON(xa, xa_store_batch(xa, 2, entries, 1, 2,
+					     GFP_KERNEL) != -EINVAL);
+	XA_BUG_ON(xa, xa_store_batch(xa, ULONG_MAX, entries, 2, 0,
+				     GFP_KERNEL) != -EINVAL);
+	if (order_limit == 1)
+		XA_BUG_ON(xa, xa_store_batch(xa, 0, entries, 1, 1,
+					     GFP_KERNEL) != -EINVAL);
+	XA_BUG_ON(xa, !xa_empty(xa));
+
+#ifdef CONFIG_XARRAY_MULTI
+	/* Erasing part of a multi-index entry erases all of it */
+	xa_store_order(xa, 64, 6, xa, GFP_KERNEL);
+	xa_store_index(xa, 128, GFP_KERNEL);
+	XA_BUG_ON(xa, xa_erase_range(xa, 100, 128) != 2);
+	XA_BUG_ON(xa, xa_load(xa, 64) != NULL);
+	XA_BUG_ON(xa, !xa_empty(xa));
+#endif
+}
+
+#ifdef __KERNEL__
+#include <linux/ktime.h>
+
+/*
+ * Compare batched stores and loads of 16kB folios in 8MB of page cache
+ * with doing one walk per folio or per index.
+ */
+static noinline void check_batch_speed(struct xarray *xa)
+{
+	unsigned int i, order = min(order_limit - 1, 2U), nr = 512;
+	unsigned long size = (unsigned long)nr << order;
+	void **entries, **loaded;
+	u64 start, single, batch;
+
+	entries = kmalloc_array(nr, sizeof(*entries), GFP_KERNEL);
+	loaded = kmalloc_array(size, sizeof(*loaded), GFP_KERNEL);
+	XA_BUG_ON(xa, !entries || !loaded);
+	for (i = 0; i < nr; i++)
+		entries[i] = xa_mk_index(i);
+
+	start = ktime_get_ns();
+	for (i = 0; i < nr; i++)
+		xa_store_order(xa, (unsigned long)i << order, order,
+			       entries[i], GFP_KERNEL);
+	single = ktime_get_ns() - start;
+	xa_destroy(xa);
+
+	start = ktime_get_ns();
+	XA_BUG_ON(xa, xa_store_batch(xa, 0, entries, nr, order,
+				     GFP_KERNEL) != 0);
+	batch = ktime_get_ns() - start;
+	pr_info("XArray: store %u order-%u entries: %llu ns single, %llu ns batched\n",
+		nr, order, single, batch);
+
+	start = ktime_get_ns();
+	for (i = 0; i < size; i++)
+		loaded[i] = xa_load(xa, i);
+	single = ktime_get_ns() - start;
+
+	start = ktime_get_ns();
+	XA_BUG_ON(xa, xa_load_range(xa, 0, size - 1, loaded) != nr);
+	batch = ktime_get_ns() - start;
+	pr_info("XArray: load %lu indices: %llu ns single, %llu ns batched\n",
+		size, single, batch);
+
+	start = ktime_get_ns();
+	XA_BUG_ON(xa, xa_erase_range(xa, 0, size - 1) != nr);
+	batch = ktime_get_ns() - start;
+	pr_info("XArray: erase %u order-%u entries: %llu ns batched\n",
+		nr, order, batch);
+	XA_BUG_ON(xa, !xa_empty(xa));
+
+	kfree(loaded);
+	kfree(entries);
+}
+#else
+static void check_batch_speed(struct xarray *xa) { }
+#endif
+
 static noinline void check_destroy(struct xarray *xa)
 {
 	unsigned long index;
@@ -2255,6 +2404,8 @@ static int xarray_checks(void)
 	check_move(&array);
 	check_create_range(&array);
 	check_store_range(&array);
+	check_batch(&array);
+	check_batch_speed(&array);
 	check_store_iter(&array);
 	check_align(&xa0);
 	check_split(&array);
@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0-only
-/* I/O iterator tests.  This can only test kernel-backed iterator types.
+/* I/O iterator tests.  Mostly kernel-backed iterator types, plus ITER_UBUF
+ * against a KUnit-allocated user mapping.
  *
  * Copyright (C) 2023 Red Hat, Inc. All Rights Reserved.
  * Written by David Howells (dhowells@redhat.com)
@@ -10,7 +11,10 @@
 #include <linux/module.h>
 #include <linux/vmalloc.h>
 #include <linux/mm.h>
+#include <linux/mman.h>
 #include <linux/uio.h>
+#include <linux/uaccess.h>
+#include <linux/ktime.h>
 #include <linux/bvec.h>
 #include <linux/folio_queue.h>
 #include <kunit/test.h>
@@ -1009,6 +1013,155 @@ static void __init iov_kunit_extract_pages_xarray(struct kunit *test)
 	KUNIT_SUCCEED(test);
 }
 
+#define IOV_KUNIT_FOLIO_ORDER	4
+#define IOV_KUNIT_FOLIO_SIZE	(PAGE_SIZE << IOV_KUNIT_FOLIO_ORDER)
+
+static void iov_kunit_folio_put(void *data)
+{
+	folio_put(data);
+}
+
+static struct folio *__init iov_kunit_create_large_folio(struct kunit *test)
+{
+	struct folio *folio;
+
+	folio = folio_alloc(GFP_KERNEL, IOV_KUNIT_FOLIO_ORDER);
+	KUNIT_ASSERT_NOT_NULL(test, folio);
+	kunit_add_action_or_reset(test, iov_kunit_folio_put, folio);
+	return folio;
+}
+
+static void __user *__init iov_kunit_create_ubuf(struct kunit *test,
+						 size_t size)
+{
+	unsigned long uaddr;
+
+	if (!IS_ENABLED(CONFIG_MMU))
+		kunit_skip(test, "Userspace allocation testing not available on non-MMU systems");
+
+	uaddr = kunit_vm_mmap(test, NULL, 0, size, PROT_READ | PROT_WRITE,
+			      MAP_ANONYMOUS | MAP_PRIVATE, 0);
+	KUNIT_ASSERT_NE_MSG(test, uaddr, 0, "Could not create userspace mm");
+	KUNIT_ASSERT_LT_MSG(test, uaddr, (unsigned long)TASK_SIZE,
+			    "Failed to allocate user memory");
+	return (void __user *)uaddr;
+}
+
+static const struct kvec_test_range folio_test_ranges[] = {
+	{ 0, IOV_KUNIT_FOLIO_SIZE },
+	{ 0x7ff, 0x7ff + 3 * PAGE_SIZE + 2 },
+	{ PAGE_SIZE - 1, PAGE_SIZE + 1 },
+	{ 5 * PAGE_SIZE, 6 * PAGE_SIZE },
+	{ IOV_KUNIT_FOLIO_SIZE - 3, IOV_KUNIT_FOLIO_SIZE },
+	{ -1 }
+};
+
+/*
+ * Test copying between a large folio and an ITER_UBUF-type iterator,
+ * with ranges that cross subpage boundaries.
+ */
+static void __init iov_kunit_copy_folio_ubuf(struct kunit *test)
+{
+	const struct kvec_test_range *pr;
+	struct iov_iter iter;
+	struct folio *folio;
+	void __user *ubuf;
+	u8 *fbuf, *kbuf;
+	size_t size = IOV_KUNIT_FOLIO_SIZE, len, copied, i;
+
+	folio = iov_kunit_create_large_folio(test);
+	fbuf = folio_address(folio);
+	ubuf = iov_kunit_create_ubuf(test, size);
+	kbuf = kunit_kmalloc(test, size, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, kbuf);
+
+	for (i = 0; i < size; i++)
+		fbuf[i] = pattern(i);
+
+	for (pr = folio_test_ranges; pr->from >= 0; pr++) {
+		len = pr->to - pr->from;
+		iov_iter_ubuf(&iter, ITER_DEST, ubuf, len);
+		copied = copy_folio_to_iter(folio, pr->from, len, &iter);
+		KUNIT_EXPECT_EQ(test, copied, len);
+		KUNIT_EXPECT_EQ(test, iter.count, 0);
+		KUNIT_ASSERT_EQ(test, copy_from_user(kbuf, ubuf, len), 0);
+		KUNIT_EXPECT_EQ(test, memcmp(kbuf, fbuf + pr->from, len), 0);
+	}
+
+	for (pr = folio_test_ranges; pr->from >= 0; pr++) {
+		len = pr->to - pr->from;
+		for (i = 0; i < len; i++)
+			kbuf[i] = ~pattern(i);
+		KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, kbuf, len), 0);
+		memset(fbuf, 0, size);
+
+		iov_iter_ubuf(&iter, ITER_SOURCE, ubuf, len);
+		copied = copy_page_from_iter(folio_page(folio, 0), pr->from,
+					     len, &iter);
+		KUNIT_EXPECT_EQ(test, copied, len);
+		KUNIT_EXPECT_EQ(test, iter.count, 0);
+		KUNIT_EXPECT_EQ(test, memcmp(fbuf + pr->from, kbuf, len), 0);
+		if (pr->from > 0)
+			KUNIT_EXPECT_EQ(test, fbuf[pr->from - 1], 0);
+		if (pr->to < size)
+			KUNIT_EXPECT_EQ(test, fbuf[pr->to], 0);
+	}
+
+	KUNIT_SUCCEED(test);
+}
+
+/*
+ * Measure copy_folio_to_iter() and copy_page_from_iter() between a large
+ * folio and an ITER_UBUF-type iterator, as done by read() and write() on
+ * the page cache.
+ */
+static void __init iov_kunit_benchmark_folio_ubuf(struct kunit *test)
+{
+	static const size_t sizes[] = {
+		PAGE_SIZE, 4 * PAGE_SIZE, IOV_KUNIT_FOLIO_SIZE
+	};
+	const unsigned int loops = 20000;
+	struct iov_iter iter;
+	struct folio *folio;
+	void __user *ubuf;
+	ktime_t a, b, c;
+	size_t len;
+	int i, j;
+
+	folio = iov_kunit_create_large_folio(test);
+	ubuf = iov_kunit_create_ubuf(test, IOV_KUNIT_FOLIO_SIZE);
+	memset(folio_address(folio), 0x5a, IOV_KUNIT_FOLIO_SIZE);
+	/* Fault the user buffer in before timing anything */
+	KUNIT_ASSERT_EQ(test, clear_user(ubuf, IOV_KUNIT_FOLIO_SIZE), 0);
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		len = sizes[i];
+
+		a = ktime_get();
+		for (j = 0; j < loops; j++) {
+			iov_iter_ubuf(&iter, ITER_DEST, ubuf, len);
+			copy_folio_to_iter(folio, 0, len, &iter);
+			cond_resched();
+		}
+		b = ktime_get();
+		for (j = 0; j < loops; j++) {
+			iov_iter_ubuf(&iter, ITER_SOURCE, ubuf, len);
+			copy_page_from_iter(folio_page(folio, 0), 0, len, &iter);
+			cond_resched();
+		}
+		c = ktime_get();
+
+		kunit_info(test, "%zu bytes: to_iter %llu MB/s, from_iter %llu MB/s\n",
+			   len,
+			   div64_u64((u64)len * loops * 1000,
+				     max_t(u64, ktime_to_ns(ktime_sub(b, a)), 1)),
+			   div64_u64((u64)len * loops * 1000,
+				     max_t(u64, ktime_to_ns(ktime_sub(c, b)), 1)));
+	}
+
+	KUNIT_SUCCEED(test);
+}
+
 static struct kunit_case __refdata iov_kunit_cases[] = {
 	KUNIT_CASE(iov_kunit_copy_to_kvec),
 	KUNIT_CASE(iov_kunit_copy_from_kvec),
@@ -1022,6 +1175,8 @@ static struct kunit_case __refdata iov_kunit_cases[] = {
 	KUNIT_CASE(iov_kunit_extract_pages_bvec),
 	KUNIT_CASE(iov_kunit_extract_pages_folioq),
 	KUNIT_CASE(iov_kunit_extract_pages_xarray),
+	KUNIT_CASE(iov_kunit_copy_folio_ubuf),
+	KUNIT_CASE_SLOW(iov_kunit_benchmark_folio_ubuf),
 	{}
 };
 
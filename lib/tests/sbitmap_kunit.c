@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests and microbenchmark for sbitmap.
+ */
+
+#include <kunit/test.h>
+#include <linux/bitmap.h>
+#include <linux/completion.h>
+#include <linux/cpu.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/sbitmap.h>
+#include <linux/slab.h>
+
+#define SBITMAP_TEST_DEPTH	1024
+#define SBITMAP_BENCH_ITERS	200000
+#define SBITMAP_BENCH_HELD	8
+
+/* Allocate every bit, check each is handed out once, then free them all */
+static void sbitmap_test_exhaust(struct kunit *test, struct sbitmap *sb)
+{
+	unsigned long *seen;
+	unsigned int i;
+	int nr;
+
+	seen = kunit_kzalloc(test, BITS_TO_LONGS(sb->depth) * sizeof(long),
+			     GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, seen);
+
+	for (i = 0; i < sb->depth; i++) {
+		nr = sbitmap_get(sb);
+		KUNIT_ASSERT_GE(test, nr, 0);
+		KUNIT_ASSERT_LT(test, nr, sb->depth);
+		KUNIT_EXPECT_FALSE(test, __test_and_set_bit(nr, seen));
+	}
+	KUNIT_EXPECT_EQ(test, sbitmap_get(sb), -1);
+	KUNIT_EXPECT_EQ(test, sbitmap_weight(sb), sb->depth);
+
+	for (i = 0; i < sb->depth; i++)
+		sbitmap_put(sb, i);
+	KUNIT_EXPECT_EQ(test, sbitmap_weight(sb), 0);
+	KUNIT_EXPECT_FALSE(test, sbitmap_any_bit_set(sb));
+}
+
+static void sbitmap_test_flat(struct kunit *test)
+{
+	struct sbitmap sb;
+
+	KUNIT_ASSERT_EQ(test, sbitmap_init_node(&sb, SBITMAP_TEST_DEPTH, -1,
+						GFP_KERNEL, NUMA_NO_NODE,
+						false, true), 0);
+	sbitmap_test_exhaust(test, &sb);
+	sbitmap_free(&sb);
+}
+
+static void sbitmap_test_numa(struct kunit *test)
+{
+	unsigned int depth;
+	struct sbitmap sb;
+
+	/* Odd sizes leave the last node with a partial range */
+	for (depth = 1; depth <= SBITMAP_TEST_DEPTH; depth = depth * 3 + 1) {
+		KUNIT_ASSERT_EQ(test, sbitmap_init_numa(&sb, depth, -1,
+							GFP_KERNEL, false,
+							true), 0);
+		sbitmap_test_exhaust(test, &sb);
+		sbitmap_free(&sb);
+	}
+
+	/* Shrinking below some nodes' words must not break allocation */
+	KUNIT_ASSERT_EQ(test, sbitmap_init_numa(&sb, SBITMAP_TEST_DEPTH, -1,
+						GFP_KERNEL, false, true), 0);
+	sbitmap_resize(&sb, SBITMAP_TEST_DEPTH / 8);
+	sbitmap_test_exhaust(test, &sb);
+	sbitmap_free(&sb);
+}
+
+static void sbitmap_test_numa_local(struct kunit *test)
+{
+	unsigned int lo, hi, index, bad = 0;
+	struct sbitmap_numa *numa;
+	struct sbitmap sb;
+	int nr = 0, cpu;
+
+	KUNIT_ASSERT_EQ(test, sbitmap_init_numa(&sb, SBITMAP_TEST_DEPTH, -1,
+						GFP_KERNEL, false, true), 0);
+	numa = __sbitmap_numa(&sb);
+	if (!numa) {
+		sbitmap_free(&sb);
+		kunit_skip(test, "needs more than one node with CPUs");
+	}
+
+	/* Stay on one CPU, and so one node, for the whole check */
+	cpu = get_cpu();
+	lo = numa->node_slot[cpu_to_node(cpu)] << numa->node_shift;
+	hi = min(sb.map_nr, lo + (1U << numa->node_shift));
+
+	/* Every bit of the local words is used before any remote one */
+	for (index = lo; index < hi && nr >= 0; index++) {
+		unsigned int bits = __map_depth(&sb, index);
+
+		while (bits-- && nr >= 0) {
+			nr = sbitmap_get(&sb);
+			if (nr < 0 || SB_NR_TO_INDEX(&sb, nr) < lo ||
+			    SB_NR_TO_INDEX(&sb, nr) >= hi)
+				bad++;
+		}
+	}
+	if (nr >= 0)
+		nr = sbitmap_get(&sb);
+	put_cpu();
+
+	KUNIT_EXPECT_EQ(test, bad, 0);
+	KUNIT_EXPECT_GE(test, nr, 0);
+	KUNIT_EXPECT_TRUE(test, SB_NR_TO_INDEX(&sb, nr) < lo ||
+				SB_NR_TO_INDEX(&sb, nr) >= hi);
+	sbitmap_free(&sb);
+}
+
+struct sbitmap_bench {
+	struct sbitmap_queue *sbq;
+	atomic_t running;
+	atomic64_t ns;
+	atomic64_t failed;
+	struct completion done;
+};
+
+/* Mimic a queue keeping a few requests in flight, like blk-mq tags */
+static int sbitmap_bench_thread(void *data)
+{
+	struct sbitmap_bench *b = data;
+	int held[SBITMAP_BENCH_HELD];
+	unsigned int i, slot = 0;
+	u64 start;
+
+	memset(held, -1, sizeof(held));
+	start = ktime_get_ns();
+	for (i = 0; i < SBITMAP_BENCH_ITERS; i++) {
+		unsigned int cpu;
+
+		if (held[slot] >= 0)
+			sbitmap_queue_clear(b->sbq, held[slot],
+					    raw_smp_processor_id());
+		held[slot] = sbitmap_queue_get(b->sbq, &cpu);
+		if (held[slot] < 0)
+			atomic64_inc(&b->failed);
+		slot = (slot + 1) % SBITMAP_BENCH_HELD;
+	}
+	for (i = 0; i < SBITMAP_BENCH_HELD; i++)
+		if (held[i] >= 0)
+			sbitmap_queue_clear(b->sbq, held[i],
+					    raw_smp_processor_id());
+	atomic64_add(ktime_get_ns() - start, &b->ns);
+
+	if (atomic_dec_and_test(&b->running))
+		complete(&b->done);
+	return 0;
+}
+
+static void sbitmap_bench_run(struct kunit *test, const char *name,
+			      bool numa)
+{
+	unsigned int depth, nr_threads = 0;
+	struct sbitmap_queue sbq;
+	struct sbitmap_bench b;
+	int cpu, ret;
+
+	/*
+	 * Not under cpus_read_lock(), the first NUMA init enables a static
+	 * key, which takes it itself.
+	 */
+	depth = min(num_online_cpus() * SBITMAP_BENCH_HELD * 2, 8192U);
+	if (numa)
+		ret = sbitmap_queue_init_numa(&sbq, depth, -1, false,
+					      GFP_KERNEL);
+	else
+		ret = sbitmap_queue_init_node(&sbq, depth, -1, false,
+					      GFP_KERNEL, NUMA_NO_NODE);
+	if (ret) {
+		KUNIT_FAIL(test, "sbitmap_queue init failed: %d", ret);
+		return;
+	}
+
+	b.sbq = &sbq;
+	atomic_set(&b.running, 1);
+	atomic64_set(&b.ns, 0);
+	atomic64_set(&b.failed, 0);
+	init_completion(&b.done);
+
+	cpus_read_lock();
+	for_each_online_cpu(cpu) {
+		struct task_struct *t;
+
+		atomic_inc(&b.running);
+		t = kthread_run_on_cpu(sbitmap_bench_thread, &b, cpu,
+				       "sbitmap_bench/%u");
+		if (IS_ERR(t)) {
+			atomic_dec(&b.running);
+			continue;
+		}
+		nr_threads++;
+	}
+	cpus_read_unlock();
+
+	if (!atomic_dec_and_test(&b.running))
+		wait_for_completion(&b.done);
+
+	KUNIT_EXPECT_EQ(test, sbitmap_weight(&sbq.sb), 0);
+	if (nr_threads)
+		kunit_info(test, "%s: depth %u, %u threads, %llu ns per get/clear, %lld failed\n",
+			   name, depth, nr_threads,
+			   div_u64(atomic64_read(&b.ns),
+				   (u64)nr_threads * SBITMAP_BENCH_ITERS),
+			   atomic64_read(&b.failed));
+	sbitmap_queue_free(&sbq);
+}
+
+static void sbitmap_bench(struct kunit *test)
+{
+	sbitmap_bench_run(test, "flat", false);
+	sbitmap_bench_run(test, "numa", true);
+}
+
+static struct kunit_case sbitmap_test_cases[] = {
+	KUNIT_CASE(sbitmap_test_flat),
+	KUNIT_CASE(sbitmap_test_numa),
+	KUNIT_CASE(sbitmap_test_numa_local),
+	KUNIT_CASE_SLOW(sbitmap_bench),
+	{}
+};
+
+static struct kunit_suite sbitmap_test_suite = {
+	.name = "sbitmap",
+	.test_cases = sbitmap_test_cases,
+};
+kunit_test_suite(sbitmap_test_suite);
+
+MODULE_DESCRIPTION("KUnit tests and microbenchmark for sbitmap");
+MODULE_LICENSE("GPL");
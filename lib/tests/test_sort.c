@@ -2,9 +2,12 @@
 
 #include <kunit/test.h>
 
+#include <linux/ktime.h>
 #include <linux/sort.h>
 #include <linux/slab.h>
 #include <linux/module.h>
+#include <linux/log2.h>
+#include <linux/prandom.h>
 
 /* a simple boot-time regression test */
 
@@ -45,8 +48,247 @@ static void test_sort(struct kunit *test)
 		KUNIT_ASSERT_LE(test, a[i], a[i + 1]);
 }
 
+static int cmp_u32(const void *a, const void *b)
+{
+	return cmp_int(*(u32 *)a, *(u32 *)b);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	return cmp_int(*(u64 *)a, *(u64 *)b);
+}
+
+enum sort_pattern {
+	SORT_RANDOM,
+	SORT_ASCENDING,
+	SORT_DESCENDING,
+	SORT_EQUAL,
+	SORT_ORGAN_PIPE,
+	SORT_FEW_VALUES,
+	SORT_PATTERNS
+};
+
+static u64 pattern_key(struct rnd_state *rnd, enum sort_pattern pattern,
+		       unsigned int i, unsigned int n)
+{
+	switch (pattern) {
+	case SORT_RANDOM:
+		return prandom_u32_state(rnd) | (u64)prandom_u32_state(rnd) << 32;
+	case SORT_ASCENDING:
+		return i;
+	case SORT_DESCENDING:
+		return n - i;
+	case SORT_EQUAL:
+		return 42;
+	case SORT_ORGAN_PIPE:
+		return i < n / 2 ? i : n - i;
+	default:
+		return prandom_u32_state(rnd) % 4;
+	}
+}
+
+/* Lengths around the insertion sort cutoff and a few larger ones */
+static const unsigned int sort_lens[] = { 0, 1, 2, 3, 15, 16, 17, 100, 1000, 12345 };
+
+static void test_sort_intro(struct kunit *test)
+{
+	struct rnd_state rnd;
+	unsigned int i, j, p;
+	u32 *a;
+
+	prandom_seed_state(&rnd, 3141592653589793238ULL);
+	a = kunit_kmalloc_array(test, 12345, sizeof(*a), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, a);
+
+	for (p = 0; p < SORT_PATTERNS; p++) {
+		for (j = 0; j < ARRAY_SIZE(sort_lens); j++) {
+			unsigned int n = sort_lens[j];
+
+			for (i = 0; i < n; i++)
+				a[i] = pattern_key(&rnd, p, i, n);
+
+			sort_intro(a, n, sizeof(*a), cmp_u32, NULL);
+
+			for (i = 1; i < n; i++)
+				KUNIT_ASSERT_LE_MSG(test, a[i - 1], a[i],
+						    "pattern %u len %u", p, n);
+		}
+	}
+}
+
+/*
+ * McIlroy's quicksort adversary: values are fixed only as the comparisons
+ * need them, always so that the pivot turns out to be as small as possible.
+ * This drives any median-of-three quicksort quadratic, so sort_intro() only
+ * finishes in O(n log n) comparisons if its heapsort fallback takes over.
+ */
+struct antiqsort {
+	unsigned int *val;
+	unsigned int gas, nsolid, candidate;
+	unsigned long ncmp;
+};
+
+static int cmp_antiqsort(const void *a, const void *b, const void *priv)
+{
+	struct antiqsort *aq = (struct antiqsort *)priv;
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	aq->ncmp++;
+	if (aq->val[x] == aq->gas && aq->val[y] == aq->gas) {
+		if (x == aq->candidate)
+			aq->val[x] = aq->nsolid++;
+		else
+			aq->val[y] = aq->nsolid++;
+	}
+	if (aq->val[x] == aq->gas)
+		aq->candidate = x;
+	else if (aq->val[y] == aq->gas)
+		aq->candidate = y;
+
+	return cmp_int(aq->val[x], aq->val[y]);
+}
+
+#define ANTIQSORT_LEN	4096
+
+static void test_sort_intro_adversary(struct kunit *test)
+{
+	struct antiqsort aq = { .gas = ANTIQSORT_LEN };
+	unsigned int i;
+	u32 *a;
+
+	a = kunit_kmalloc_array(test, ANTIQSORT_LEN, sizeof(*a), GFP_KERNEL);
+	aq.val = kunit_kmalloc_array(test, ANTIQSORT_LEN, sizeof(*aq.val),
+				     GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, a);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, aq.val);
+
+	for (i = 0; i < ANTIQSORT_LEN; i++) {
+		a[i] = i;
+		aq.val[i] = aq.gas;
+	}
+
+	sort_intro_r(a, ANTIQSORT_LEN, sizeof(*a), cmp_antiqsort, NULL, &aq);
+
+	for (i = 1; i < ANTIQSORT_LEN; i++)
+		KUNIT_ASSERT_LE(test, aq.val[a[i - 1]], aq.val[a[i]]);
+
+	/* A quadratic run would take about ANTIQSORT_LEN^2 / 2 comparisons */
+	KUNIT_EXPECT_LT(test, aq.ncmp,
+			8UL * ANTIQSORT_LEN * ilog2(ANTIQSORT_LEN));
+}
+
+static void test_radix_sort(struct kunit *test)
+{
+	struct rnd_state rnd;
+	unsigned int i, j, p;
+	u32 *a32, *b32, *t32;
+	u64 *a64, *b64, *t64;
+
+	prandom_seed_state(&rnd, 2718281828459045235ULL);
+	a32 = kunit_kmalloc_array(test, 2 * 12345, sizeof(*a32), GFP_KERNEL);
+	a64 = kunit_kmalloc_array(test, 2 * 12345, sizeof(*a64), GFP_KERNEL);
+	t32 = kunit_kmalloc(test, radix_sort_tmp_size(12345, sizeof(u32)),
+			    GFP_KERNEL);
+	t64 = kunit_kmalloc(test, radix_sort_tmp_size(12345, sizeof(u64)),
+			    GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, a32);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, a64);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, t32);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, t64);
+	b32 = a32 + 12345;
+	b64 = a64 + 12345;
+
+	for (p = 0; p < SORT_PATTERNS; p++) {
+		for (j = 0; j < ARRAY_SIZE(sort_lens); j++) {
+			unsigned int n = sort_lens[j];
+
+			for (i = 0; i < n; i++) {
+				a64[i] = b64[i] = pattern_key(&rnd, p, i, n);
+				a32[i] = b32[i] = a64[i];
+			}
+
+			/* Check against the heapsort, which is known good */
+			radix_sort_u32(a32, t32, n);
+			sort(b32, n, sizeof(*b32), cmp_u32, NULL);
+			KUNIT_ASSERT_MEMEQ_MSG(test, a32, b32, n * sizeof(*a32),
+					       "pattern %u len %u", p, n);
+
+			radix_sort_u64(a64, t64, n);
+			sort(b64, n, sizeof(*b64), cmp_u64, NULL);
+			KUNIT_ASSERT_MEMEQ_MSG(test, a64, b64, n * sizeof(*a64),
+					       "pattern %u len %u", p, n);
+		}
+	}
+}
+
+#define SORT_BENCH_LEN	(1 << 18)
+
+KUNIT_DEFINE_ACTION_WRAPPER(kvfree_wrapper, kvfree, const void *);
+
+/* The benchmark arrays are several MB, too big to ask kmalloc for */
+static void *sort_bench_alloc(struct kunit *test, size_t size)
+{
+	void *p = kvmalloc(size, GFP_KERNEL);
+
+	if (!p || kunit_add_action_or_reset(test, kvfree_wrapper, p))
+		return NULL;
+	return p;
+}
+
+/* Compare the three sorts on a large array of random keys */
+static void test_sort_benchmark(struct kunit *test)
+{
+	struct rnd_state rnd;
+	u64 *keys, *a, *tmp;
+	ktime_t t0, heap, intro, radix32, radix64;
+	unsigned int i;
+
+	keys = sort_bench_alloc(test, SORT_BENCH_LEN * sizeof(*keys));
+	a = sort_bench_alloc(test, SORT_BENCH_LEN * sizeof(*a));
+	tmp = sort_bench_alloc(test, radix_sort_tmp_size(SORT_BENCH_LEN,
+							 sizeof(*tmp)));
+	KUNIT_ASSERT_NOT_NULL(test, keys);
+	KUNIT_ASSERT_NOT_NULL(test, a);
+	KUNIT_ASSERT_NOT_NULL(test, tmp);
+
+	prandom_seed_state(&rnd, 1618033988749894848ULL);
+	for (i = 0; i < SORT_BENCH_LEN; i++)
+		keys[i] = pattern_key(&rnd, SORT_RANDOM, i, SORT_BENCH_LEN);
+
+	memcpy(a, keys, SORT_BENCH_LEN * sizeof(*a));
+	t0 = ktime_get();
+	sort(a, SORT_BENCH_LEN, sizeof(*a), cmp_u64, NULL);
+	heap = ktime_sub(ktime_get(), t0);
+
+	memcpy(a, keys, SORT_BENCH_LEN * sizeof(*a));
+	t0 = ktime_get();
+	sort_intro(a, SORT_BENCH_LEN, sizeof(*a), cmp_u64, NULL);
+	intro = ktime_sub(ktime_get(), t0);
+
+	memcpy(a, keys, SORT_BENCH_LEN * sizeof(*a));
+	t0 = ktime_get();
+	radix_sort_u64(a, tmp, SORT_BENCH_LEN);
+	radix64 = ktime_sub(ktime_get(), t0);
+
+	for (i = 1; i < SORT_BENCH_LEN; i++)
+		KUNIT_ASSERT_LE(test, a[i - 1], a[i]);
+
+	memcpy(a, keys, SORT_BENCH_LEN * sizeof(*a));
+	t0 = ktime_get();
+	radix_sort_u32((u32 *)a, (u32 *)tmp, SORT_BENCH_LEN);
+	radix32 = ktime_sub(ktime_get(), t0);
+
+	kunit_info(test, "%u keys: heapsort u64 %lluus, introsort u64 %lluus, radix u64 %lluus, radix u32 %lluus\n",
+		   SORT_BENCH_LEN, ktime_to_us(heap), ktime_to_us(intro),
+		   ktime_to_us(radix64), ktime_to_us(radix32));
+}
+
 static struct kunit_case sort_test_cases[] = {
 	KUNIT_CASE(test_sort),
+	KUNIT_CASE(test_sort_intro),
+	KUNIT_CASE(test_sort_intro_adversary),
+	KUNIT_CASE(test_radix_sort),
+	KUNIT_CASE_SLOW(test_sort_benchmark),
 	{}
 };
 
@@ -57,5 +299,5 @@ static struct kunit_suite sort_test_suite = {
 
 kunit_test_suites(&sort_test_suite);
 
-MODULE_DESCRIPTION("sort() KUnit test suite");
+MODULE_DESCRIPTION("sort(), sort_intro() and radix sort KUnit test suite");
 MODULE_LICENSE("GPL");
@@ -351,6 +351,76 @@ static bool __xas_nomem(struct xa_state *xas, gfp_t gfp)
 	return true;
 }
 
+/* Most nodes xas_nomem_range() will preallocate in one go */
+#define XA_BATCH_NODES	128
+
+/*
+ * xas_range_nodes() - Upper bound on the nodes needed to fill a range.
+ * @xas: XArray operation state.
+ * @last: Last index of the range.
+ *
+ * Counts the nodes needed to hold entries of the order in @xas from
+ * @xas->xa_index to @last, and their ancestors, if none of them existed.
+ */
+static unsigned long xas_range_nodes(const struct xa_state *xas,
+		unsigned long last)
+{
+	unsigned int shift = xas->xa_shift + XA_CHUNK_SHIFT;
+	unsigned long nr = 0;
+
+	for (;;) {
+		if (shift >= BITS_PER_LONG)
+			return nr + 1;
+		nr += (last >> shift) - (xas->xa_index >> shift) + 1;
+		if (!(last >> shift))
+			return nr;
+		shift += XA_CHUNK_SHIFT;
+	}
+}
+
+/*
+ * xas_nomem_range() - Allocate memory for the rest of a range if needed.
+ * @xas: XArray operation state.
+ * @last: Last index the operation will store to.
+ * @gfp: Memory allocation flags.
+ *
+ * Like xas_nomem(), but instead of one node, preallocates enough nodes to
+ * store the remainder of [@xas->xa_index, @last] (up to %XA_BATCH_NODES),
+ * so that a batch which runs out of memory drops the lock once rather than
+ * once per node.  Nodes left over are freed by the final call.
+ *
+ * Return: true if memory was needed, and was successfully allocated.
+ */
+static bool xas_nomem_range(struct xa_state *xas, unsigned long last,
+		gfp_t gfp)
+{
+	unsigned long nr;
+
+	if (xas->xa_node != XA_ERROR(-ENOMEM)) {
+		xas_destroy(xas);
+		return false;
+	}
+	if (xas->xa->xa_flags & XA_FLAGS_ACCOUNT)
+		gfp |= __GFP_ACCOUNT;
+
+	nr = min(xas_range_nodes(xas, last), (unsigned long)XA_BATCH_NODES);
+	while (nr--) {
+		struct xa_node *node;
+
+		node = kmem_cache_alloc_lru(radix_tree_node_cachep, xas->xa_lru,
+					    gfp);
+		if (!node)
+			break;
+		XA_NODE_BUG_ON(node, !list_empty(&node->private_list));
+		RCU_INIT_POINTER(node->parent, xas->xa_alloc);
+		xas->xa_alloc = node;
+	}
+	if (!xas->xa_alloc)
+		return false;
+	xas->xa_node = XAS_RESTART;
+	return true;
+}
+
 static void xas_update(struct xa_state *xas, struct xa_node *node)
 {
 	if (xas->xa_update)
@@ -2347,6 +2417,189 @@ unsigned int xa_extract(struct xarray *xa, void **dst, unsigned long start,
 }
 EXPORT_SYMBOL(xa_extract);
 
+/*
+ * xas_next_order() - Move to the next entry of the same order.
+ * @xas: XArray operation state.
+ * @index: Index of the next entry.
+ * @prev: The entry just stored.
+ *
+ * If the next entry lives in the same node as the one just stored, stay in
+ * that node so the store does not walk down from the root again.
+ */
+static void xas_next_order(struct xa_state *xas, unsigned long index,
+		void *prev)
+{
+	unsigned int offset = xas->xa_offset + xas->xa_sibs + 1;
+
+	xas->xa_index = index;
+	/* Storing NULL may have freed the node */
+	if (prev && xas_is_node(xas) &&
+	    xas->xa_node->shift == xas->xa_shift && offset < XA_CHUNK_SIZE)
+		xas->xa_offset = offset;
+	else
+		xas->xa_node = XAS_RESTART;
+}
+
+/**
+ * xa_store_batch() - Store consecutive entries of the same order.
+ * @xa: XArray.
+ * @index: Index of the first entry, aligned to @order.
+ * @entries: The entries to store.
+ * @nr: Number of entries in @entries.
+ * @order: Each entry occupies 2^@order indices.
+ * @gfp: Memory allocation flags.
+ *
+ * Stores @entries[i] at @index + (i << @order), as a series of xa_store()
+ * calls (or xa_store_order() calls) would.  Consecutive entries that share
+ * a node are stored without walking down from the root again, and if memory
+ * runs out the nodes for the rest of the batch are allocated together.
+ *
+ * If this function fails, the entries before the one which could not be
+ * stored have been stored and the rest have not.
+ *
+ * Context: Process context.  Takes and releases the xa_lock.  May sleep
+ * if the @gfp flags permit.
+ * Return: 0 on success, -EINVAL if the range or an entry cannot be stored
+ * in an XArray, or -ENOMEM if memory allocation failed.
+ */
+int xa_store_batch(struct xarray *xa, unsigned long index, void **entries,
+		unsigned int nr, unsigned int order, gfp_t gfp)
+{
+	XA_STATE(xas, xa, 0);
+	unsigned long last;
+	unsigned int i;
+
+	if (!nr)
+		return 0;
+	if (order >= BITS_PER_LONG || (order && !IS_ENABLED(CONFIG_XARRAY_MULTI)))
+		return -EINVAL;
+	if (index & ((1UL << order) - 1))
+		return -EINVAL;
+	if (nr - 1UL > (ULONG_MAX - index) >> order)
+		return -EINVAL;
+	for (i = 0; i < nr; i++)
+		if (WARN_ON_ONCE(xa_is_advanced(entries[i])))
+			return -EINVAL;
+
+	/* Wraps to ULONG_MAX if the batch ends at the top of the array */
+	last = index + ((unsigned long)nr << order) - 1;
+	xas_set_order(&xas, index, order);
+	i = 0;
+	do {
+		xas_lock(&xas);
+		while (i < nr) {
+			void *entry = entries[i];
+
+			if (!entry && xa_track_free(xa))
+				entry = XA_ZERO_ENTRY;
+			xas_store(&xas, entry);
+			if (xas_error(&xas))
+				break;
+			if (xa_track_free(xa))
+				xas_clear_mark(&xas, XA_FREE_MARK);
+			if (++i < nr)
+				xas_next_order(&xas,
+					index + ((unsigned long)i << order),
+					entries[i - 1]);
+		}
+		xas_unlock(&xas);
+	} while (xas_nomem_range(&xas, last, gfp));
+
+	return xas_error(&xas);
+}
+EXPORT_SYMBOL(xa_store_batch);
+
+/**
+ * xa_load_range() - Load every index of a range into an array.
+ * @xa: XArray.
+ * @first: First index to load.
+ * @last: Last index to load.
+ * @entries: Array of @last - @first + 1 slots.
+ *
+ * Sets @entries[i] to the entry at @first + i, as xa_load() would, so a
+ * multi-index entry fills every slot it covers and empty indices read as
+ * %NULL.  The array is walked one node at a time instead of once per index.
+ * Like xa_extract(), the result is not a snapshot if the XArray is modified
+ * concurrently.
+ *
+ * Context: Any context.  Takes and releases the RCU lock.
+ * Return: The number of distinct entries found.
+ */
+unsigned long xa_load_range(struct xarray *xa, unsigned long first,
+		unsigned long last, void **entries)
+{
+	XA_STATE(xas, xa, first);
+	unsigned long count = 0;
+	void *entry;
+
+	if (last < first)
+		return 0;
+
+	memset(entries, 0, (last - first + 1) * sizeof(*entries));
+	rcu_read_lock();
+	xas_for_each(&xas, entry, last) {
+		unsigned long start, end, mask;
+
+		if (xas_retry(&xas, entry))
+			continue;
+
+		mask = (1UL << xas_get_order(&xas)) - 1;
+		start = max(xas.xa_index & ~mask, first);
+		end = min(xas.xa_index | mask, last);
+		for (;;) {
+			entries[start - first] = entry;
+			if (start++ == end)
+				break;
+		}
+		count++;
+	}
+	rcu_read_unlock();
+
+	return count;
+}
+EXPORT_SYMBOL(xa_load_range);
+
+/**
+ * xa_erase_range() - Erase every entry in a range of indices.
+ * @xa: XArray.
+ * @first: First index to erase.
+ * @last: Last index to erase.
+ *
+ * Walks the present entries between @first and @last one node at a time
+ * and erases them, as calling xa_erase() on each would.  A multi-index
+ * entry which overlaps the range is erased in its entirety, and reserved
+ * entries are released.
+ *
+ * Context: Process context.  Takes and releases the xa_lock, and drops it
+ * every %XA_CHECK_SCHED entries to reschedule.
+ * Return: The number of entries erased.
+ */
+unsigned long xa_erase_range(struct xarray *xa, unsigned long first,
+		unsigned long last)
+{
+	XA_STATE(xas, xa, first);
+	unsigned long count = 0;
+	void *entry;
+
+	if (last < first)
+		return 0;
+
+	xas_lock(&xas);
+	xas_for_each(&xas, entry, last) {
+		xas_store(&xas, NULL);
+		if (++count % XA_CHECK_SCHED)
+			continue;
+		xas_pause(&xas);
+		xas_unlock(&xas);
+		cond_resched();
+		xas_lock(&xas);
+	}
+	xas_unlock(&xas);
+
+	return count;
+}
+EXPORT_SYMBOL(xa_erase_range);
+
 /**
  * xa_delete_node() - Private interface for workingset code.
  * @node: Node to be removed from the tree.
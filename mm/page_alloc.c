@@ -1256,6 +1256,7 @@ void __pgalloc_tag_add(struct page *page, struct task_struct *task,
 		alloc_tag_add(&ref, task->alloc_tag, PAGE_SIZE * nr);
 		update_page_tag_ref(handle, &ref);
 		put_page_tag_ref(handle);
+		alloc_tag_sample(task->alloc_tag, PAGE_SIZE * nr, page);
 	}
 }
 
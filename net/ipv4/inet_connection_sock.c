@@ -737,8 +737,13 @@ void inet_csk_init_xmit_timers(struct sock *sk,
 {
 	struct inet_connection_sock *icsk = inet_csk(sk);
 
-	timer_setup(&icsk->icsk_retransmit_timer, retransmit_handler, 0);
-	timer_setup(&icsk->icsk_delack_timer, delack_handler, 0);
+	/*
+	 * The retransmit and delack timers are pushed out on nearly every
+	 * ack, but rarely fire: let the timer wheel requeue them lazily.
+	 */
+	timer_setup(&icsk->icsk_retransmit_timer, retransmit_handler,
+		    TIMER_LAZY);
+	timer_setup(&icsk->icsk_delack_timer, delack_handler, TIMER_LAZY);
 	timer_setup(&sk->sk_timer, keepalive_handler, 0);
 	icsk->icsk_pending = icsk->icsk_ack.pending = 0;
 }
@@ -34,6 +34,16 @@ void *kmalloc(size_t size, gfp_t gfp);
 void kfree(void *p);
 void *kmalloc_array(size_t n, size_t size, gfp_t gfp);
 
+static inline void *kvmalloc_array(size_t n, size_t size, gfp_t gfp)
+{
+	return kmalloc_array(n, size, gfp);
+}
+
+static inline void kvfree(void *p)
+{
+	kfree(p);
+}
+
 bool slab_is_available(void);
 
 enum slab_state {